@@ -0,0 +1,357 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * arena.c - Flickcurl bump pointer allocator for result objects
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+/* allocations are aligned for any of the result structure members */
+#define FLICKCURL_ARENA_ALIGN (2 * sizeof(void*))
+
+#define FLICKCURL_ARENA_MIN_BLOCK_SIZE 4096
+#define FLICKCURL_ARENA_MAX_BLOCK_SIZE (256 * 1024)
+
+typedef struct flickcurl_arena_block_s {
+  struct flickcurl_arena_block_s* next;
+  size_t size;
+  size_t used;
+  /* aligned data follows */
+} flickcurl_arena_block;
+
+#define FLICKCURL_ARENA_BLOCK_HEADER_SIZE \
+  ((sizeof(flickcurl_arena_block) + FLICKCURL_ARENA_ALIGN - 1) & \
+   ~(FLICKCURL_ARENA_ALIGN - 1))
+
+/* strings longer than this are copied without interning */
+#define FLICKCURL_ARENA_INTERN_MAX_LENGTH 64
+
+typedef struct {
+  unsigned int hash;
+  const char* string;
+} flickcurl_arena_intern_entry;
+
+struct flickcurl_arena_s {
+  /* current block first */
+  flickcurl_arena_block* blocks;
+  /* size of the next block */
+  size_t block_size;
+
+  /* open addressing table of interned strings or NULL */
+  flickcurl_arena_intern_entry* intern_table;
+  unsigned int intern_size;
+  unsigned int intern_count;
+};
+
+
+/*
+ * flickcurl_new_arena:
+ * @block_size: size of the first block or 0 for the default
+ *
+ * INTERNAL - Constructor for an arena of result objects
+ *
+ * Memory from the arena is only released by flickcurl_free_arena()
+ * so it suits objects that are built once and freed together.
+ * Blocks double in size as the arena grows.
+ *
+ * Return value: new arena or NULL on failure
+ */
+flickcurl_arena*
+flickcurl_new_arena(size_t block_size)
+{
+  flickcurl_arena* arena;
+
+  arena=(flickcurl_arena*)calloc(1, sizeof(flickcurl_arena));
+  if(!arena)
+    return NULL;
+
+  if(block_size < FLICKCURL_ARENA_MIN_BLOCK_SIZE)
+    block_size=FLICKCURL_ARENA_MIN_BLOCK_SIZE;
+  else if(block_size > FLICKCURL_ARENA_MAX_BLOCK_SIZE)
+    block_size=FLICKCURL_ARENA_MAX_BLOCK_SIZE;
+  arena->block_size=block_size;
+
+  return arena;
+}
+
+
+/*
+ * flickcurl_free_arena:
+ * @arena: arena
+ *
+ * INTERNAL - Destructor for an arena and everything allocated from it
+ */
+void
+flickcurl_free_arena(flickcurl_arena* arena)
+{
+  flickcurl_arena_block* block;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(arena, flickcurl_arena);
+
+  block=arena->blocks;
+  while(block) {
+    flickcurl_arena_block* next=block->next;
+    free(block);
+    block=next;
+  }
+  if(arena->intern_table)
+    free(arena->intern_table);
+  free(arena);
+}
+
+
+/*
+ * flickcurl_arena_alloc:
+ * @arena: arena
+ * @size: bytes wanted
+ *
+ * INTERNAL - Allocate uninitialised memory from an arena
+ *
+ * Return value: pointer to memory or NULL on failure
+ */
+void*
+flickcurl_arena_alloc(flickcurl_arena* arena, size_t size)
+{
+  flickcurl_arena_block* block=arena->blocks;
+  void* ptr;
+
+  size=(size + FLICKCURL_ARENA_ALIGN - 1) & ~(FLICKCURL_ARENA_ALIGN - 1);
+  if(!size)
+    size=FLICKCURL_ARENA_ALIGN;
+
+  if(!block || block->size - block->used < size) {
+    size_t block_size=arena->block_size;
+
+    if(size > block_size / 4) {
+      /* a large allocation gets a block of its own behind the current one */
+      block=(flickcurl_arena_block*)malloc(FLICKCURL_ARENA_BLOCK_HEADER_SIZE + size);
+      if(!block)
+        return NULL;
+      block->size=size;
+      block->used=size;
+      if(arena->blocks) {
+        block->next=arena->blocks->next;
+        arena->blocks->next=block;
+      } else {
+        block->next=NULL;
+        arena->blocks=block;
+      }
+      return (char*)block + FLICKCURL_ARENA_BLOCK_HEADER_SIZE;
+    }
+
+    block=(flickcurl_arena_block*)malloc(FLICKCURL_ARENA_BLOCK_HEADER_SIZE + block_size);
+    if(!block)
+      return NULL;
+    block->size=block_size;
+    block->used=0;
+    block->next=arena->blocks;
+    arena->blocks=block;
+
+    if(arena->block_size < FLICKCURL_ARENA_MAX_BLOCK_SIZE)
+      arena->block_size*=2;
+  }
+
+  ptr=(char*)block + FLICKCURL_ARENA_BLOCK_HEADER_SIZE + block->used;
+  block->used+=size;
+  return ptr;
+}
+
+
+/*
+ * flickcurl_arena_calloc:
+ * @arena: arena
+ * @nmemb: number of members
+ * @size: size of a member
+ *
+ * INTERNAL - Allocate zeroed memory from an arena
+ *
+ * Return value: pointer to memory or NULL on failure
+ */
+void*
+flickcurl_arena_calloc(flickcurl_arena* arena, size_t nmemb, size_t size)
+{
+  void* ptr;
+
+  if(size && nmemb > ((size_t)-1) / size)
+    return NULL;
+
+  ptr=flickcurl_arena_alloc(arena, nmemb * size);
+  if(ptr)
+    memset(ptr, '\0', nmemb * size);
+  return ptr;
+}
+
+
+/*
+ * flickcurl_arena_strndup:
+ * @arena: arena
+ * @string: string
+ * @len: length of @string
+ *
+ * INTERNAL - Copy a string into an arena
+ *
+ * Return value: NUL terminated copy or NULL on failure
+ */
+char*
+flickcurl_arena_strndup(flickcurl_arena* arena, const char* string,
+                        size_t len)
+{
+  char* copy;
+
+  copy=(char*)flickcurl_arena_alloc(arena, len + 1);
+  if(copy) {
+    memcpy(copy, string, len);
+    copy[len]='\0';
+  }
+  return copy;
+}
+
+
+/*
+ * flickcurl_arena_set_intern:
+ * @arena: arena
+ *
+ * INTERNAL - Make flickcurl_arena_intern() share copies of equal strings
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_arena_set_intern(flickcurl_arena* arena)
+{
+  if(arena->intern_table)
+    return 0;
+
+  arena->intern_size=256;
+  arena->intern_table=(flickcurl_arena_intern_entry*)calloc(arena->intern_size,
+                                                            sizeof(flickcurl_arena_intern_entry));
+  if(!arena->intern_table)
+    return 1;
+  arena->intern_count=0;
+  return 0;
+}
+
+
+static int
+flickcurl_arena_intern_grow(flickcurl_arena* arena)
+{
+  flickcurl_arena_intern_entry* table;
+  unsigned int size=arena->intern_size * 2;
+  unsigned int i;
+
+  table=(flickcurl_arena_intern_entry*)calloc(size,
+                                              sizeof(flickcurl_arena_intern_entry));
+  if(!table)
+    return 1;
+
+  for(i=0; i < arena->intern_size; i++) {
+    flickcurl_arena_intern_entry* entry=&arena->intern_table[i];
+    unsigned int slot;
+
+    if(!entry->string)
+      continue;
+    for(slot=entry->hash & (size - 1); table[slot].string;
+        slot=(slot + 1) & (size - 1))
+      ;
+    table[slot]=*entry;
+  }
+
+  free(arena->intern_table);
+  arena->intern_table=table;
+  arena->intern_size=size;
+  return 0;
+}
+
+
+/*
+ * flickcurl_arena_intern:
+ * @arena: arena
+ * @string: string
+ * @len: length of @string
+ *
+ * INTERNAL - Get a shared copy of a string in an arena
+ *
+ * If interning was enabled with flickcurl_arena_set_intern(), equal
+ * short strings get the same copy, otherwise this is
+ * flickcurl_arena_strndup().  The result must not be modified.
+ *
+ * Return value: NUL terminated copy or NULL on failure
+ */
+char*
+flickcurl_arena_intern(flickcurl_arena* arena, const char* string, size_t len)
+{
+  unsigned int hash=2166136261U;
+  unsigned int mask;
+  unsigned int slot;
+  size_t i;
+  char* copy;
+
+  if(!arena->intern_table || len > FLICKCURL_ARENA_INTERN_MAX_LENGTH)
+    return flickcurl_arena_strndup(arena, string, len);
+
+  /* FNV-1a */
+  for(i=0; i < len; i++) {
+    hash ^= (unsigned char)string[i];
+    hash *= 16777619U;
+  }
+
+  mask=arena->intern_size - 1;
+  for(slot=hash & mask; arena->intern_table[slot].string;
+      slot=(slot + 1) & mask) {
+    flickcurl_arena_intern_entry* entry=&arena->intern_table[slot];
+    if(entry->hash == hash && !strncmp(entry->string, string, len) &&
+       !entry->string[len])
+      return (char*)entry->string;
+  }
+
+  copy=flickcurl_arena_strndup(arena, string, len);
+  if(!copy)
+    return NULL;
+
+  /* keep the table at most half full */
+  if((arena->intern_count + 1) * 2 > arena->intern_size) {
+    if(flickcurl_arena_intern_grow(arena))
+      return copy;
+    mask=arena->intern_size - 1;
+    for(slot=hash & mask; arena->intern_table[slot].string;
+        slot=(slot + 1) & mask)
+      ;
+  }
+  arena->intern_table[slot].hash=hash;
+  arena->intern_table[slot].string=copy;
+  arena->intern_count++;
+
+  return copy;
+}
@@ -60,7 +60,7 @@ flickcurl_build_args(flickcurl* fc,
   xmlNodeSetPtr nodes;
   
   /* Now do args */
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -80,7 +80,7 @@ flickcurl_build_blogs(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlXPathObjectPtr xpathObj=NULL;
   xmlNodeSetPtr nodes;
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -192,7 +192,7 @@ flickcurl_build_blog_Services(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlXPathObjectPtr xpathObj = NULL;
   xmlNodeSetPtr nodes;
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -0,0 +1,1347 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * cache.c - Flickcurl web service response cache
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#include <time.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+#include <libxml/parser.h>
+
+
+/* default maximum number of entries if none is given */
+#define FLICKCURL_CACHE_DEFAULT_MAX_ENTRIES 1024
+
+/* rough size of a parsed DOM relative to its serialized content */
+#define FLICKCURL_CACHE_DOM_FACTOR 4
+
+/* default size cap of a persistent cache file */
+#define FLICKCURL_CACHE_DEFAULT_DISK_BYTES (16 * 1024 * 1024)
+
+
+/* default time to live in seconds of read-only methods worth caching */
+static const struct {
+  const char* method;
+  int ttl;
+} flickcurl_cache_default_ttls[]={
+  { "flickr.people.findByEmail",       3600 },
+  { "flickr.people.findByUsername",    3600 },
+  { "flickr.people.getInfo",           3600 },
+  { "flickr.photos.getInfo",            300 },
+  { "flickr.photos.getSizes",          3600 },
+  { "flickr.photos.licenses.getInfo", 86400 },
+  { "flickr.places.getInfo",          86400 },
+  { "flickr.places.resolvePlaceId",   86400 },
+  { "flickr.places.resolvePlaceURL",  86400 },
+  { "flickr.reflection.getMethodInfo", 86400 },
+  { "flickr.reflection.getMethods",   86400 },
+  { NULL, 0 }
+};
+
+
+typedef struct flickcurl_cache_entry_s flickcurl_cache_entry;
+
+struct flickcurl_cache_entry_s {
+  char* key;
+  unsigned int hash;
+
+  /* response content */
+  char* content;
+  size_t content_length;
+
+  /* DOM of @content parsed on first use or NULL */
+  xmlDocPtr doc;
+
+  /* time after which the entry is stale */
+  time_t expires;
+
+  /* bytes accounted to this entry */
+  size_t size;
+
+  /* hash bucket chain */
+  flickcurl_cache_entry* bucket_next;
+
+  /* LRU list - most recently used first */
+  flickcurl_cache_entry* prev;
+  flickcurl_cache_entry* next;
+};
+
+
+typedef struct {
+  char* method;
+  int ttl;
+} flickcurl_cache_method_ttl;
+
+
+#ifdef HAVE_SYS_MMAN_H
+/*
+ * Persistent cache file layout
+ *
+ * A 16 byte header then an append-only sequence of records, each a
+ * flickcurl_disk_record followed by the key, the content, a NUL and
+ * padding to a multiple of 8 bytes.  A later record for the same key
+ * replaces an earlier one.  The file is mapped read-only and indexed
+ * in memory by the MD5 of the key, rebuilt by scanning it when opened.
+ * When the file would grow past its size cap, the live records are
+ * copied to a new file (oldest first dropped) that replaces it.
+ * Appending, resetting and truncating the file are done holding a
+ * write lock on it and reading records holding a read lock.
+ */
+#define FLICKCURL_DISK_MAGIC "FLCKCSH1"
+#define FLICKCURL_DISK_HEADER_SIZE 16
+#define FLICKCURL_DISK_RECORD_MARKER 0x46435245U
+
+typedef struct {
+  unsigned int marker;
+  unsigned int key_length;
+  unsigned int content_length;
+  /* unix time after which the record is stale */
+  unsigned int expires;
+  unsigned char key_md5[16];
+} flickcurl_disk_record;
+
+#define FLICKCURL_DISK_RECORD_SIZE(key_len, content_len) \
+  ((sizeof(flickcurl_disk_record) + (key_len) + (content_len) + 1 + 7) & ~(size_t)7)
+
+typedef struct {
+  unsigned char key_md5[16];
+  /* offset of record or 0 for an empty slot */
+  size_t offset;
+} flickcurl_disk_slot;
+#endif
+
+typedef struct {
+  char* path;
+  size_t max_bytes;
+
+#ifdef HAVE_SYS_MMAN_H
+  int fd;
+  dev_t dev;
+  ino_t ino;
+
+  /* read-only mapping of the file */
+  unsigned char* map;
+  size_t map_size;
+
+  /* end of the last record indexed */
+  size_t end;
+
+  /* open addressing index of record offsets by key MD5 */
+  flickcurl_disk_slot* slots;
+  unsigned int slots_count;
+  unsigned int slots_used;
+#endif
+} flickcurl_cache_disk;
+
+
+struct flickcurl_cache_s {
+  int max_entries;
+  size_t max_bytes;
+
+  flickcurl_cache_entry** buckets;
+  unsigned int buckets_count;
+
+  flickcurl_cache_entry* lru_head;
+  flickcurl_cache_entry* lru_tail;
+  int entries_count;
+  size_t bytes;
+
+  /* per-method time to live table */
+  flickcurl_cache_method_ttl* ttls;
+  int ttls_count;
+
+  /* persistent store or NULL - flickcurl_cache_set_persistent() */
+  flickcurl_cache_disk* disk;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t lock;
+#endif
+};
+
+
+#ifdef HAVE_PTHREAD_H
+#define FLICKCURL_CACHE_LOCK(cache) pthread_mutex_lock(&(cache)->lock)
+#define FLICKCURL_CACHE_UNLOCK(cache) pthread_mutex_unlock(&(cache)->lock)
+#else
+#define FLICKCURL_CACHE_LOCK(cache) do { } while(0)
+#define FLICKCURL_CACHE_UNLOCK(cache) do { } while(0)
+#endif
+
+
+#ifdef HAVE_SYS_MMAN_H
+static int
+flickcurl_cache_disk_remap(flickcurl_cache_disk* disk, size_t size)
+{
+  void* map;
+
+  if(size <= disk->map_size)
+    return 0;
+
+  /* map up to the size cap at once so appending rarely needs a remap;
+   * only the part of the mapping inside the file is ever read
+   */
+  if(size < disk->max_bytes)
+    size=disk->max_bytes;
+
+  if(disk->map)
+    munmap(disk->map, disk->map_size);
+  disk->map=NULL;
+  disk->map_size=0;
+
+  map=mmap(NULL, size, PROT_READ, MAP_SHARED, disk->fd, 0);
+  if(map == MAP_FAILED)
+    return 1;
+
+  disk->map=(unsigned char*)map;
+  disk->map_size=size;
+  return 0;
+}
+
+
+static flickcurl_disk_slot*
+flickcurl_cache_disk_find_slot(flickcurl_disk_slot* slots,
+                               unsigned int slots_count,
+                               const unsigned char* key_md5)
+{
+  unsigned int i;
+
+  memcpy(&i, key_md5, sizeof(i));
+  for(i &= (slots_count-1); slots[i].offset; i=(i+1) & (slots_count-1)) {
+    if(!memcmp(slots[i].key_md5, key_md5, 16))
+      break;
+  }
+
+  /* matching slot or empty slot to insert at */
+  return &slots[i];
+}
+
+
+static int
+flickcurl_cache_disk_index(flickcurl_cache_disk* disk,
+                           const unsigned char* key_md5, size_t offset)
+{
+  flickcurl_disk_slot* slot;
+
+  /* keep the table at most half full */
+  if((disk->slots_used + 1) * 2 > disk->slots_count) {
+    unsigned int count=disk->slots_count ? disk->slots_count * 2 : 256;
+    flickcurl_disk_slot* slots;
+    unsigned int i;
+
+    slots=(flickcurl_disk_slot*)calloc(count, sizeof(flickcurl_disk_slot));
+    if(!slots)
+      return 1;
+
+    for(i=0; i < disk->slots_count; i++) {
+      if(disk->slots[i].offset)
+        *flickcurl_cache_disk_find_slot(slots, count,
+                                        disk->slots[i].key_md5)=disk->slots[i];
+    }
+    if(disk->slots)
+      free(disk->slots);
+    disk->slots=slots;
+    disk->slots_count=count;
+  }
+
+  slot=flickcurl_cache_disk_find_slot(disk->slots, disk->slots_count, key_md5);
+  if(!slot->offset) {
+    memcpy(slot->key_md5, key_md5, 16);
+    disk->slots_used++;
+  }
+  slot->offset=offset;
+
+  return 0;
+}
+
+
+/* Index records appended since the last scan.  Returns non-0 if the
+ * file has a damaged record at disk->end
+ */
+static int
+flickcurl_cache_disk_scan(flickcurl_cache_disk* disk)
+{
+  struct stat sb;
+  size_t size;
+
+  if(fstat(disk->fd, &sb))
+    return 1;
+  size=(size_t)sb.st_size;
+
+  if(size <= disk->end)
+    return 0;
+
+  if(flickcurl_cache_disk_remap(disk, size))
+    return 1;
+
+  while(disk->end + sizeof(flickcurl_disk_record) <= size) {
+    flickcurl_disk_record rec;
+    size_t rec_size;
+
+    memcpy(&rec, disk->map + disk->end, sizeof(rec));
+    if(rec.marker != FLICKCURL_DISK_RECORD_MARKER)
+      return 1;
+
+    rec_size=FLICKCURL_DISK_RECORD_SIZE(rec.key_length, rec.content_length);
+    if(disk->end + rec_size > size)
+      return 1;
+
+    if(flickcurl_cache_disk_index(disk, rec.key_md5, disk->end))
+      return 1;
+    disk->end += rec_size;
+  }
+
+  return 0;
+}
+
+
+static void
+flickcurl_cache_disk_close_file(flickcurl_cache_disk* disk)
+{
+  if(disk->map)
+    munmap(disk->map, disk->map_size);
+  disk->map=NULL;
+  disk->map_size=0;
+
+  if(disk->fd >= 0)
+    close(disk->fd);
+  disk->fd= -1;
+
+  if(disk->slots)
+    free(disk->slots);
+  disk->slots=NULL;
+  disk->slots_count=0;
+  disk->slots_used=0;
+  disk->end=0;
+}
+
+
+/* Lock the open file: @type is F_RDLCK, F_WRLCK or F_UNLCK */
+static int
+flickcurl_cache_disk_lock(flickcurl_cache_disk* disk, int type)
+{
+  struct flock fl;
+
+  if(disk->fd < 0)
+    return 1;
+
+  memset(&fl, '\0', sizeof(fl));
+  fl.l_type=type;
+  fl.l_whence=SEEK_SET;
+
+  while(fcntl(disk->fd, F_SETLKW, &fl) < 0) {
+    if(errno != EINTR)
+      return 1;
+  }
+  return 0;
+}
+
+
+static int
+flickcurl_cache_disk_open_file(flickcurl_cache_disk* disk)
+{
+  char header[FLICKCURL_DISK_HEADER_SIZE];
+  struct stat sb;
+
+  disk->fd=open(disk->path, O_RDWR | O_CREAT, 0600);
+  if(disk->fd < 0)
+    return 1;
+
+  /* other processes may be appending; only check or change the file
+   * while holding the lock
+   */
+  if(flickcurl_cache_disk_lock(disk, F_WRLCK) || fstat(disk->fd, &sb))
+    goto failed;
+  disk->dev=sb.st_dev;
+  disk->ino=sb.st_ino;
+
+  if(sb.st_size < FLICKCURL_DISK_HEADER_SIZE ||
+     pread(disk->fd, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+     memcmp(header, FLICKCURL_DISK_MAGIC, 8)) {
+    /* new or unusable file - start again */
+    memset(header, '\0', sizeof(header));
+    memcpy(header, FLICKCURL_DISK_MAGIC, 8);
+    if(ftruncate(disk->fd, 0) ||
+       pwrite(disk->fd, header, sizeof(header), 0) != (ssize_t)sizeof(header))
+      goto failed;
+  }
+
+  if(flickcurl_cache_disk_remap(disk, FLICKCURL_DISK_HEADER_SIZE))
+    goto failed;
+
+  disk->end=FLICKCURL_DISK_HEADER_SIZE;
+  if(flickcurl_cache_disk_scan(disk)) {
+    /* drop a damaged tail such as from an interrupted write */
+    if(ftruncate(disk->fd, (off_t)disk->end))
+      goto failed;
+  }
+
+  flickcurl_cache_disk_lock(disk, F_UNLCK);
+  return 0;
+
+  failed:
+  /* closing the file also releases the lock on it */
+  flickcurl_cache_disk_close_file(disk);
+  return 1;
+}
+
+
+/* Check if another process replaced the file by compacting */
+static int
+flickcurl_cache_disk_is_replaced(flickcurl_cache_disk* disk)
+{
+  struct stat sb;
+
+  return !(disk->fd >= 0 && !stat(disk->path, &sb) &&
+           sb.st_dev == disk->dev && sb.st_ino == disk->ino);
+}
+
+
+static int
+flickcurl_cache_disk_check_file(flickcurl_cache_disk* disk)
+{
+  if(!flickcurl_cache_disk_is_replaced(disk))
+    return 0;
+
+  flickcurl_cache_disk_close_file(disk);
+  return flickcurl_cache_disk_open_file(disk);
+}
+
+
+/* Lock the current file for reading (F_RDLCK) or writing (F_WRLCK),
+ * reopening it if another process replaced it
+ */
+static int
+flickcurl_cache_disk_lock_current(flickcurl_cache_disk* disk, int type)
+{
+  while(1) {
+    if(flickcurl_cache_disk_check_file(disk) ||
+       flickcurl_cache_disk_lock(disk, type))
+      return 1;
+    /* the file may have been replaced while waiting for the lock */
+    if(!flickcurl_cache_disk_is_replaced(disk))
+      return 0;
+    flickcurl_cache_disk_lock(disk, F_UNLCK);
+  }
+}
+
+
+static int
+flickcurl_cache_disk_compare_offsets(const void *a, const void *b)
+{
+  size_t oa=(*(const flickcurl_disk_slot**)a)->offset;
+  size_t ob=(*(const flickcurl_disk_slot**)b)->offset;
+
+  return (oa > ob) - (oa < ob);
+}
+
+
+/* Rewrite the file with only fresh records, dropping the oldest until
+ * there is room for @need more bytes
+ */
+static int
+flickcurl_cache_disk_compact(flickcurl_cache_disk* disk, size_t need)
+{
+  flickcurl_disk_slot** live;
+  char header[FLICKCURL_DISK_HEADER_SIZE];
+  char* tmp_path;
+  size_t total=FLICKCURL_DISK_HEADER_SIZE;
+  size_t target;
+  unsigned int now=(unsigned int)time(NULL);
+  unsigned int i;
+  int count=0;
+  int first;
+  int fd;
+  int rc=1;
+
+  live=(flickcurl_disk_slot**)malloc((disk->slots_used+1) * sizeof(flickcurl_disk_slot*));
+  tmp_path=(char*)malloc(strlen(disk->path) + 8);
+  if(!live || !tmp_path)
+    goto tidy;
+
+  for(i=0; i < disk->slots_count; i++) {
+    flickcurl_disk_record rec;
+
+    if(!disk->slots[i].offset)
+      continue;
+    memcpy(&rec, disk->map + disk->slots[i].offset, sizeof(rec));
+    if(rec.expires <= now)
+      continue;
+    live[count++]=&disk->slots[i];
+    total += FLICKCURL_DISK_RECORD_SIZE(rec.key_length, rec.content_length);
+  }
+
+  qsort(live, count, sizeof(flickcurl_disk_slot*),
+        flickcurl_cache_disk_compare_offsets);
+
+  /* leave a quarter of the cap free so compacting is not done often */
+  target=disk->max_bytes - disk->max_bytes / 4;
+  target= (need < target) ? target - need : 0;
+  for(first=0; first < count && total > target; first++) {
+    flickcurl_disk_record rec;
+    memcpy(&rec, disk->map + live[first]->offset, sizeof(rec));
+    total -= FLICKCURL_DISK_RECORD_SIZE(rec.key_length, rec.content_length);
+  }
+
+  strcpy(tmp_path, disk->path);
+  strcat(tmp_path, ".XXXXXX");
+  fd=mkstemp(tmp_path);
+  if(fd < 0)
+    goto tidy;
+
+  memset(header, '\0', sizeof(header));
+  memcpy(header, FLICKCURL_DISK_MAGIC, 8);
+  if(write(fd, header, sizeof(header)) != (ssize_t)sizeof(header))
+    goto failed;
+
+  for(i=first; (int)i < count; i++) {
+    flickcurl_disk_record rec;
+    size_t rec_size;
+
+    memcpy(&rec, disk->map + live[i]->offset, sizeof(rec));
+    rec_size=FLICKCURL_DISK_RECORD_SIZE(rec.key_length, rec.content_length);
+    if(write(fd, disk->map + live[i]->offset, rec_size) != (ssize_t)rec_size)
+      goto failed;
+  }
+
+  if(rename(tmp_path, disk->path))
+    goto failed;
+  close(fd);
+
+  /* closing the old file also releases the lock on it */
+  flickcurl_cache_disk_close_file(disk);
+  rc=flickcurl_cache_disk_open_file(disk);
+  if(!rc)
+    rc=flickcurl_cache_disk_lock(disk, F_WRLCK);
+  if(!rc)
+    rc=flickcurl_cache_disk_scan(disk);
+  goto tidy;
+
+  failed:
+  close(fd);
+  unlink(tmp_path);
+
+  tidy:
+  if(live)
+    free(live);
+  if(tmp_path)
+    free(tmp_path);
+
+  return rc;
+}
+
+
+static flickcurl_cache_disk*
+flickcurl_cache_disk_open(const char* path, size_t max_bytes)
+{
+  flickcurl_cache_disk* disk;
+
+  disk=(flickcurl_cache_disk*)calloc(1, sizeof(flickcurl_cache_disk));
+  if(!disk)
+    return NULL;
+
+  disk->fd= -1;
+  disk->max_bytes=max_bytes;
+  disk->path=strdup(path);
+  if(!disk->path || flickcurl_cache_disk_open_file(disk)) {
+    if(disk->path)
+      free(disk->path);
+    free(disk);
+    return NULL;
+  }
+
+  return disk;
+}
+
+
+static void
+flickcurl_cache_disk_close(flickcurl_cache_disk* disk)
+{
+  flickcurl_cache_disk_close_file(disk);
+  free(disk->path);
+  free(disk);
+}
+
+
+static int
+flickcurl_cache_disk_get(flickcurl_cache_disk* disk, const char* key,
+                         char** content_p, size_t* content_length_p,
+                         time_t* expires_p)
+{
+  unsigned char key_md5[16];
+  size_t key_length=strlen(key);
+  flickcurl_disk_slot* slot;
+  flickcurl_disk_record rec;
+  const unsigned char* p;
+  char* c;
+  int rc=1;
+
+  MD5_digest(key, key_length, key_md5);
+
+  /* keep appends out while reading records */
+  if(flickcurl_cache_disk_lock_current(disk, F_RDLCK))
+    return 1;
+
+  slot=NULL;
+  if(disk->slots_count)
+    slot=flickcurl_cache_disk_find_slot(disk->slots, disk->slots_count,
+                                        key_md5);
+  if(!slot || !slot->offset) {
+    /* look for records appended by other processes */
+    flickcurl_cache_disk_scan(disk);
+    if(!disk->slots_count)
+      goto unlock;
+    slot=flickcurl_cache_disk_find_slot(disk->slots, disk->slots_count,
+                                        key_md5);
+    if(!slot->offset)
+      goto unlock;
+  }
+
+  p=disk->map + slot->offset;
+  memcpy(&rec, p, sizeof(rec));
+  p += sizeof(rec);
+
+  if(rec.key_length != key_length || memcmp(p, key, key_length) ||
+     (time_t)rec.expires <= time(NULL))
+    goto unlock;
+  p += key_length;
+
+  c=(char*)malloc(rec.content_length+1);
+  if(!c)
+    goto unlock;
+  memcpy(c, p, rec.content_length);
+  c[rec.content_length]='\0';
+
+  *content_p=c;
+  *content_length_p=rec.content_length;
+  *expires_p=(time_t)rec.expires;
+  rc=0;
+
+  unlock:
+  flickcurl_cache_disk_lock(disk, F_UNLCK);
+
+  return rc;
+}
+
+
+static void
+flickcurl_cache_disk_put(flickcurl_cache_disk* disk, const char* key,
+                         const char* content, size_t content_length,
+                         time_t expires)
+{
+  flickcurl_disk_record rec;
+  size_t key_length=strlen(key);
+  size_t rec_size=FLICKCURL_DISK_RECORD_SIZE(key_length, content_length);
+  unsigned char* buffer;
+
+  /* do not let one response take over the file */
+  if(rec_size > disk->max_bytes / 4)
+    return;
+
+  buffer=(unsigned char*)calloc(1, rec_size);
+  if(!buffer)
+    return;
+
+  rec.marker=FLICKCURL_DISK_RECORD_MARKER;
+  rec.key_length=(unsigned int)key_length;
+  rec.content_length=(unsigned int)content_length;
+  rec.expires=(unsigned int)expires;
+  MD5_digest(key, key_length, rec.key_md5);
+
+  memcpy(buffer, &rec, sizeof(rec));
+  memcpy(buffer + sizeof(rec), key, key_length);
+  memcpy(buffer + sizeof(rec) + key_length, content, content_length);
+
+  if(flickcurl_cache_disk_lock_current(disk, F_WRLCK))
+    goto tidy;
+
+  /* pick up records appended by other processes */
+  if(flickcurl_cache_disk_scan(disk))
+    goto unlock;
+
+  if(disk->end + rec_size > disk->max_bytes &&
+     flickcurl_cache_disk_compact(disk, rec_size))
+    goto unlock;
+
+  if(pwrite(disk->fd, buffer, rec_size, (off_t)disk->end) == (ssize_t)rec_size &&
+     !flickcurl_cache_disk_remap(disk, disk->end + rec_size)) {
+    flickcurl_cache_disk_index(disk, rec.key_md5, disk->end);
+    disk->end += rec_size;
+  }
+
+  unlock:
+  flickcurl_cache_disk_lock(disk, F_UNLCK);
+
+  tidy:
+  free(buffer);
+}
+#endif
+
+
+/**
+ * flickcurl_new_cache:
+ * @max_entries: maximum number of responses to keep or 0 for the default (1024)
+ * @max_bytes: maximum bytes of responses to keep or 0 for no limit
+ *
+ * Create a Flickcurl response cache
+ *
+ * A cache attached to sessions with flickcurl_set_cache() returns
+ * responses of read-only methods without calling the web service
+ * while they are younger than the method's time to live.  Responses
+ * are keyed on the method name and all parameters, except the
+ * signature, so different users' results are kept apart.  The least
+ * recently used responses are dropped when either limit is reached.
+ *
+ * A set of common read-only methods is cached by default; use
+ * flickcurl_cache_set_method_ttl() to change it.  When built with
+ * pthreads, a cache may be used by sessions on different threads.
+ *
+ * The cache must be freed after all sessions using it.
+ *
+ * Return value: new object or NULL on failure
+ */
+flickcurl_cache*
+flickcurl_new_cache(int max_entries, size_t max_bytes)
+{
+  flickcurl_cache* cache;
+  int i;
+
+  cache=(flickcurl_cache*)calloc(1, sizeof(flickcurl_cache));
+  if(!cache)
+    return NULL;
+
+  if(max_entries <= 0)
+    max_entries=FLICKCURL_CACHE_DEFAULT_MAX_ENTRIES;
+  cache->max_entries=max_entries;
+  cache->max_bytes=max_bytes;
+
+  /* power of 2 buckets, around 1 entry per bucket when full */
+  cache->buckets_count=16;
+  while(cache->buckets_count < (unsigned int)max_entries &&
+        cache->buckets_count < (1U << 20))
+    cache->buckets_count <<= 1;
+
+  cache->buckets=(flickcurl_cache_entry**)calloc(cache->buckets_count,
+                                                  sizeof(flickcurl_cache_entry*));
+  if(!cache->buckets) {
+    free(cache);
+    return NULL;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&cache->lock, NULL);
+#endif
+
+  for(i=0; flickcurl_cache_default_ttls[i].method; i++)
+    flickcurl_cache_set_method_ttl(cache, flickcurl_cache_default_ttls[i].method,
+                                   flickcurl_cache_default_ttls[i].ttl);
+
+  return cache;
+}
+
+
+static void
+flickcurl_free_cache_entry(flickcurl_cache_entry* entry)
+{
+  if(entry->key)
+    free(entry->key);
+  if(entry->content)
+    free(entry->content);
+  if(entry->doc)
+    xmlFreeDoc(entry->doc);
+  free(entry);
+}
+
+
+/**
+ * flickcurl_free_cache:
+ * @cache: flickcurl cache object
+ *
+ * Destructor for Flickcurl response cache
+ */
+void
+flickcurl_free_cache(flickcurl_cache* cache)
+{
+  flickcurl_cache_entry* entry;
+  int i;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(cache, flickcurl_cache);
+
+  for(entry=cache->lru_head; entry; ) {
+    flickcurl_cache_entry* next=entry->next;
+    flickcurl_free_cache_entry(entry);
+    entry=next;
+  }
+  free(cache->buckets);
+
+  for(i=0; i < cache->ttls_count; i++)
+    free(cache->ttls[i].method);
+  if(cache->ttls)
+    free(cache->ttls);
+
+#ifdef HAVE_SYS_MMAN_H
+  if(cache->disk)
+    flickcurl_cache_disk_close(cache->disk);
+#endif
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&cache->lock);
+#endif
+
+  free(cache);
+}
+
+
+/**
+ * flickcurl_cache_set_persistent:
+ * @cache: flickcurl cache object
+ * @path: cache file name
+ * @max_bytes: size cap of the file or 0 for the default (16 megabytes)
+ *
+ * Keep cached responses in a file so they survive between processes
+ *
+ * Responses are appended to the file (created if needed) and looked up
+ * from a memory map of it, so short-lived programs run one after
+ * another reuse each other's results.  Stale responses and, if still
+ * needed, the oldest ones are dropped when the file would grow past
+ * @max_bytes.  Several processes may share the file.
+ *
+ * Not available on systems without mmap().
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_cache_set_persistent(flickcurl_cache* cache, const char* path,
+                               size_t max_bytes)
+{
+#ifdef HAVE_SYS_MMAN_H
+  flickcurl_cache_disk* disk;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(cache, flickcurl_cache, 1);
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(path, char*, 1);
+
+  if(!max_bytes)
+    max_bytes=FLICKCURL_CACHE_DEFAULT_DISK_BYTES;
+
+  disk=flickcurl_cache_disk_open(path, max_bytes);
+  if(!disk)
+    return 1;
+
+  FLICKCURL_CACHE_LOCK(cache);
+  if(cache->disk)
+    flickcurl_cache_disk_close(cache->disk);
+  cache->disk=disk;
+  FLICKCURL_CACHE_UNLOCK(cache);
+
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+
+/**
+ * flickcurl_cache_set_method_ttl:
+ * @cache: flickcurl cache object
+ * @method: Flickr API method name such as "flickr.photos.getInfo"
+ * @ttl: time to live in seconds or 0 to not cache the method
+ *
+ * Set how long responses of a method are cached
+ *
+ * Only read-only methods should be cached.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_cache_set_method_ttl(flickcurl_cache* cache, const char* method,
+                               int ttl)
+{
+  flickcurl_cache_method_ttl* ttls;
+  int i;
+  int rc=0;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(cache, flickcurl_cache, 1);
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(method, char*, 1);
+
+  if(ttl < 0)
+    ttl=0;
+
+  FLICKCURL_CACHE_LOCK(cache);
+
+  for(i=0; i < cache->ttls_count; i++) {
+    if(!strcmp(cache->ttls[i].method, method)) {
+      cache->ttls[i].ttl=ttl;
+      goto unlock;
+    }
+  }
+
+  ttls=(flickcurl_cache_method_ttl*)realloc(cache->ttls,
+                                            (cache->ttls_count+1) * sizeof(*ttls));
+  if(!ttls) {
+    rc=1;
+    goto unlock;
+  }
+  cache->ttls=ttls;
+
+  ttls[cache->ttls_count].method=strdup(method);
+  if(!ttls[cache->ttls_count].method) {
+    rc=1;
+    goto unlock;
+  }
+  ttls[cache->ttls_count].ttl=ttl;
+  cache->ttls_count++;
+
+  unlock:
+  FLICKCURL_CACHE_UNLOCK(cache);
+
+  return rc;
+}
+
+
+static int
+flickcurl_cache_get_method_ttl(flickcurl_cache* cache, const char* method)
+{
+  int i;
+  int ttl=0;
+
+  FLICKCURL_CACHE_LOCK(cache);
+  for(i=0; i < cache->ttls_count; i++) {
+    if(!strcmp(cache->ttls[i].method, method)) {
+      ttl=cache->ttls[i].ttl;
+      break;
+    }
+  }
+  FLICKCURL_CACHE_UNLOCK(cache);
+
+  return ttl;
+}
+
+
+static int
+flickcurl_cache_compare_params(const void *a, const void *b)
+{
+  const char** pa=*(const char***)a;
+  const char** pb=*(const char***)b;
+  int rc;
+
+  rc=strcmp(pa[0], pb[0]);
+  if(!rc)
+    rc=strcmp(pa[1], pb[1]);
+  return rc;
+}
+
+
+/*
+ * flickcurl_cache_make_key:
+ * @fc: flickcurl session with a prepared request
+ * @ttl_p: pointer to store time to live of the response
+ *
+ * INTERNAL - Get the cache key of the request prepared in @fc
+ *
+ * The key is made of the parameters (including method, API key and
+ * auth token) sorted by name, excluding the signature.
+ *
+ * Return value: new key or NULL if the request is not to be cached
+ */
+char*
+flickcurl_cache_make_key(flickcurl* fc, int* ttl_p)
+{
+  const char** pairs;
+  const char*** params;
+  size_t len=1;
+  char* key=NULL;
+  char* p;
+  int ttl;
+  int count=0;
+  int i;
+
+  if(!fc->cache || !fc->method || fc->is_write || fc->data ||
+     fc->upload_field || !fc->param_fields)
+    return NULL;
+
+  ttl=flickcurl_cache_get_method_ttl(fc->cache, fc->method);
+  if(ttl <= 0)
+    return NULL;
+
+  for(i=0; fc->param_fields[i]; i++)
+    ;
+
+  pairs=(const char**)malloc((i * 2 + 1) * sizeof(const char*));
+  params=(const char***)malloc((i + 1) * sizeof(const char**));
+  if(!pairs || !params)
+    goto tidy;
+
+  for(i=0; fc->param_fields[i]; i++) {
+    if(!strcmp(fc->param_fields[i], "api_sig"))
+      continue;
+    pairs[count*2]=fc->param_fields[i];
+    pairs[count*2+1]=fc->param_values[i];
+    params[count]=&pairs[count*2];
+    len += strlen(fc->param_fields[i]) + strlen(fc->param_values[i]) + 2;
+    count++;
+  }
+
+  qsort(params, count, sizeof(const char**), flickcurl_cache_compare_params);
+
+  key=(char*)malloc(len);
+  if(!key)
+    goto tidy;
+
+  p=key;
+  for(i=0; i < count; i++) {
+    size_t l=strlen(params[i][0]);
+    memcpy(p, params[i][0], l); p+= l;
+    *p++='=';
+    l=strlen(params[i][1]);
+    memcpy(p, params[i][1], l); p+= l;
+    /* a byte that cannot appear in a parameter separates pairs */
+    *p++='\x01';
+  }
+  *p='\0';
+
+  if(ttl_p)
+    *ttl_p=ttl;
+
+  tidy:
+  if(pairs)
+    free(pairs);
+  if(params)
+    free(params);
+
+  return key;
+}
+
+
+static unsigned int
+flickcurl_cache_hash(const char* key)
+{
+  unsigned int hash=5381;
+  const unsigned char* p;
+
+  for(p=(const unsigned char*)key; *p; p++)
+    hash=((hash << 5) + hash) + *p;
+
+  return hash;
+}
+
+
+static void
+flickcurl_cache_unlink(flickcurl_cache* cache, flickcurl_cache_entry* entry)
+{
+  flickcurl_cache_entry** bucketp;
+
+  for(bucketp=&cache->buckets[entry->hash & (cache->buckets_count-1)];
+      *bucketp; bucketp=&(*bucketp)->bucket_next) {
+    if(*bucketp == entry) {
+      *bucketp=entry->bucket_next;
+      break;
+    }
+  }
+
+  if(entry->prev)
+    entry->prev->next=entry->next;
+  else
+    cache->lru_head=entry->next;
+  if(entry->next)
+    entry->next->prev=entry->prev;
+  else
+    cache->lru_tail=entry->prev;
+
+  cache->entries_count--;
+  cache->bytes -= entry->size;
+}
+
+
+static void
+flickcurl_cache_touch(flickcurl_cache* cache, flickcurl_cache_entry* entry)
+{
+  if(cache->lru_head == entry)
+    return;
+
+  /* move to front of LRU list */
+  entry->prev->next=entry->next;
+  if(entry->next)
+    entry->next->prev=entry->prev;
+  else
+    cache->lru_tail=entry->prev;
+
+  entry->prev=NULL;
+  entry->next=cache->lru_head;
+  cache->lru_head->prev=entry;
+  cache->lru_head=entry;
+}
+
+
+static flickcurl_cache_entry*
+flickcurl_cache_find(flickcurl_cache* cache, const char* key, unsigned int hash)
+{
+  flickcurl_cache_entry* entry;
+
+  for(entry=cache->buckets[hash & (cache->buckets_count-1)]; entry;
+      entry=entry->bucket_next) {
+    if(entry->hash == hash && !strcmp(entry->key, key))
+      return entry;
+  }
+  return NULL;
+}
+
+
+/* Evict least recently used entries other than @keep until @entries
+ * more entries and @size more bytes fit.  Call with the cache locked.
+ */
+static void
+flickcurl_cache_evict(flickcurl_cache* cache, int entries, size_t size,
+                      flickcurl_cache_entry* keep)
+{
+  while(cache->lru_tail && cache->lru_tail != keep &&
+        (cache->entries_count + entries > cache->max_entries ||
+         (cache->max_bytes && cache->bytes + size > cache->max_bytes))) {
+    flickcurl_cache_entry* victim=cache->lru_tail;
+    flickcurl_cache_unlink(cache, victim);
+    flickcurl_free_cache_entry(victim);
+  }
+}
+
+
+/* Add an entry to the memory cache taking ownership of @content.
+ * Call with the cache locked.
+ */
+static flickcurl_cache_entry*
+flickcurl_cache_insert(flickcurl_cache* cache, const char* key,
+                       unsigned int hash, char* content, size_t content_length,
+                       time_t expires)
+{
+  flickcurl_cache_entry* entry;
+  size_t size=strlen(key) + content_length + sizeof(flickcurl_cache_entry);
+
+  entry=flickcurl_cache_find(cache, key, hash);
+  if(entry) {
+    flickcurl_cache_unlink(cache, entry);
+    flickcurl_free_cache_entry(entry);
+  }
+
+  /* never going to fit */
+  if(cache->max_bytes && size > cache->max_bytes) {
+    free(content);
+    return NULL;
+  }
+
+  entry=(flickcurl_cache_entry*)calloc(1, sizeof(flickcurl_cache_entry));
+  if(!entry) {
+    free(content);
+    return NULL;
+  }
+
+  entry->content=content;
+  entry->content_length=content_length;
+  entry->key=strdup(key);
+  if(!entry->key) {
+    flickcurl_free_cache_entry(entry);
+    return NULL;
+  }
+  entry->hash=hash;
+  entry->expires=expires;
+  entry->size=size;
+
+  /* evict least recently used until the new entry fits */
+  flickcurl_cache_evict(cache, 1, size, NULL);
+
+  entry->bucket_next=cache->buckets[hash & (cache->buckets_count-1)];
+  cache->buckets[hash & (cache->buckets_count-1)]=entry;
+
+  entry->next=cache->lru_head;
+  if(cache->lru_head)
+    cache->lru_head->prev=entry;
+  else
+    cache->lru_tail=entry;
+  cache->lru_head=entry;
+
+  cache->entries_count++;
+  cache->bytes += size;
+
+  return entry;
+}
+
+
+/*
+ * flickcurl_cache_get:
+ * @cache: flickcurl cache object
+ * @key: request key from flickcurl_cache_make_key()
+ * @doc_p: pointer to store a new copy of the response DOM (or NULL)
+ * @content_p: pointer to store a new copy of the response content (or NULL)
+ * @size_p: pointer to store length of response content (or NULL)
+ *
+ * INTERNAL - Get a fresh cached response
+ *
+ * Looks in memory and then in the persistent store, if any.
+ *
+ * Return value: non-0 if there is no fresh response for @key
+ */
+int
+flickcurl_cache_get(flickcurl_cache* cache, const char* key,
+                    xmlDocPtr* doc_p, char** content_p, size_t* size_p)
+{
+  flickcurl_cache_entry* entry;
+  unsigned int hash=flickcurl_cache_hash(key);
+  int rc=1;
+
+  FLICKCURL_CACHE_LOCK(cache);
+
+  entry=flickcurl_cache_find(cache, key, hash);
+  if(entry && entry->expires <= time(NULL)) {
+    flickcurl_cache_unlink(cache, entry);
+    flickcurl_free_cache_entry(entry);
+    entry=NULL;
+  }
+
+#ifdef HAVE_SYS_MMAN_H
+  if(!entry && cache->disk) {
+    char* c;
+    size_t len;
+    time_t expires;
+
+    if(!flickcurl_cache_disk_get(cache->disk, key, &c, &len, &expires))
+      entry=flickcurl_cache_insert(cache, key, hash, c, len, expires);
+  }
+#endif
+
+  if(!entry)
+    goto unlock;
+
+  flickcurl_cache_touch(cache, entry);
+
+  if(doc_p) {
+    size_t dom_size=entry->content_length * FLICKCURL_CACHE_DOM_FACTOR;
+
+    if(!entry->doc) {
+      entry->doc=xmlReadMemory(entry->content, (int)entry->content_length,
+                               NULL, NULL, XML_PARSE_NONET);
+      if(!entry->doc)
+        goto unlock;
+      entry->size += dom_size;
+      cache->bytes += dom_size;
+
+      /* the parsed DOM counts against the size cap too */
+      flickcurl_cache_evict(cache, 0, 0, entry);
+    }
+    *doc_p=xmlCopyDoc(entry->doc, 1);
+
+    /* too big to keep the DOM even alone */
+    if(cache->max_bytes && entry->size > cache->max_bytes) {
+      xmlFreeDoc(entry->doc);
+      entry->doc=NULL;
+      entry->size -= dom_size;
+      cache->bytes -= dom_size;
+    }
+
+    if(!*doc_p)
+      goto unlock;
+  }
+
+  if(content_p) {
+    char* c=(char*)malloc(entry->content_length+1);
+    if(!c) {
+      if(doc_p) {
+        xmlFreeDoc(*doc_p);
+        *doc_p=NULL;
+      }
+      goto unlock;
+    }
+    memcpy(c, entry->content, entry->content_length+1);
+    *content_p=c;
+  }
+  if(size_p)
+    *size_p=entry->content_length;
+
+  rc=0;
+
+  unlock:
+  FLICKCURL_CACHE_UNLOCK(cache);
+
+  return rc;
+}
+
+
+/*
+ * flickcurl_cache_put:
+ * @cache: flickcurl cache object
+ * @key: request key from flickcurl_cache_make_key()
+ * @ttl: time to live in seconds
+ * @content: response content
+ * @content_length: length of @content
+ *
+ * INTERNAL - Add a response to the cache and the persistent store, if any
+ */
+void
+flickcurl_cache_put(flickcurl_cache* cache, const char* key, int ttl,
+                    const char* content, size_t content_length)
+{
+  time_t expires=time(NULL) + ttl;
+  char* c;
+
+  c=(char*)malloc(content_length+1);
+  if(!c)
+    return;
+  memcpy(c, content, content_length);
+  c[content_length]='\0';
+
+  FLICKCURL_CACHE_LOCK(cache);
+
+  flickcurl_cache_insert(cache, key, flickcurl_cache_hash(key),
+                         c, content_length, expires);
+
+#ifdef HAVE_SYS_MMAN_H
+  if(cache->disk)
+    flickcurl_cache_disk_put(cache->disk, key, content, content_length,
+                             expires);
+#endif
+
+  FLICKCURL_CACHE_UNLOCK(cache);
+}
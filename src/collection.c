@@ -183,7 +183,7 @@ flickcurl_build_collections(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xpathExpr_len = strlen((const char*)xpathExpr);
   strncpy((char*)full_xpath, (const char*)xpathExpr, xpathExpr_len+1);
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -93,7 +93,7 @@ flickcurl_build_comments(flickcurl* fc,
   xmlNodeSetPtr nodes;
   
   /* Now do comments */
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -109,60 +109,174 @@ flickcurl_error(flickcurl* fc, const char *message, ...)
 }
 
   
+/* largest Content-Length used to size a content buffer in advance */
+#define FLICKCURL_CONTENT_PRESIZE_MAX (16 * 1024 * 1024)
+
+/* largest content buffer kept by a session for reuse */
+#define FLICKCURL_CONTENT_SPARE_MAX (4 * 1024 * 1024)
+
+/* shortest time in msecs between progress handler calls for a transfer */
+#define FLICKCURL_PROGRESS_INTERVAL_MSEC 250
+
+
+/* Make room for @length more bytes of saved content plus a NUL */
+static int
+flickcurl_transfer_reserve(flickcurl_transfer* t, size_t length)
+{
+  flickcurl* fc=t->fc;
+  size_t needed=t->content_length + length + 1;
+  size_t size;
+  char* content;
+
+  if(!t->content && fc->content_buffer) {
+    /* reuse the session's spare buffer */
+    t->content=fc->content_buffer;
+    t->content_size=fc->content_buffer_size;
+    fc->content_buffer=NULL;
+    fc->content_buffer_size=0;
+  }
+
+  if(needed <= t->content_size)
+    return 0;
+
+  size=t->content_size ? t->content_size * 2 : 4096;
+  if(size < needed)
+    size=needed;
+
+  content=(char*)realloc(t->content, size);
+  if(!content)
+    return 1;
+
+  t->content=content;
+  t->content_size=size;
+
+  return 0;
+}
+
+
+/* SAX2 callbacks for streamed responses: note the rsp/@stat and
+ * rsp/err then pass events on to the transfer's handler
+ */
+static void
+flickcurl_sax_start_element(void* ctx, const xmlChar* localname,
+                            const xmlChar* prefix, const xmlChar* URI,
+                            int nb_namespaces, const xmlChar** namespaces,
+                            int nb_attributes, int nb_defaulted,
+                            const xmlChar** attributes)
+{
+  flickcurl_transfer* t=(flickcurl_transfer*)ctx;
+  int i;
+
+  if(!t->sax_depth && !strcmp((const char*)localname, "rsp")) {
+    for(i=0; i < nb_attributes; i++) {
+      const xmlChar** attr=&attributes[i * 5];
+      if(!strcmp((const char*)attr[0], "stat"))
+        t->rsp_failed=((attr[4] - attr[3]) != 2 ||
+                       strncmp((const char*)attr[3], "ok", 2));
+    }
+  } else if(t->sax_depth == 1 && t->rsp_failed &&
+            !strcmp((const char*)localname, "err")) {
+    for(i=0; i < nb_attributes; i++) {
+      const xmlChar** attr=&attributes[i * 5];
+      size_t len=attr[4] - attr[3];
+      if(!strcmp((const char*)attr[0], "code"))
+        t->error_code=atoi((const char*)attr[3]);
+      else if(!strcmp((const char*)attr[0], "msg")) {
+        if(t->error_msg)
+          free(t->error_msg);
+        t->error_msg=(char*)malloc(len + 1);
+        if(t->error_msg) {
+          memcpy(t->error_msg, attr[3], len);
+          t->error_msg[len]='\0';
+        }
+      }
+    }
+  }
+
+  if(t->sax->start)
+    t->sax->start(t->sax_data, t->sax_depth, localname, nb_attributes,
+                  attributes);
+  t->sax_depth++;
+}
+
+
+static void
+flickcurl_sax_end_element(void* ctx, const xmlChar* localname,
+                          const xmlChar* prefix, const xmlChar* URI)
+{
+  flickcurl_transfer* t=(flickcurl_transfer*)ctx;
+
+  t->sax_depth--;
+  if(t->sax->end)
+    t->sax->end(t->sax_data, t->sax_depth, localname);
+}
+
+
+static void
+flickcurl_sax_characters(void* ctx, const xmlChar* ch, int len)
+{
+  flickcurl_transfer* t=(flickcurl_transfer*)ctx;
+
+  if(t->sax->text)
+    t->sax->text(t->sax_data, ch, len);
+}
+
+
 static size_t
 flickcurl_write_callback(void *ptr, size_t size, size_t nmemb, 
                          void *userdata) 
 {
-  flickcurl* fc=(flickcurl*)userdata;
+  flickcurl_transfer* t=(flickcurl_transfer*)userdata;
+  flickcurl* fc=t->fc;
   int len=size*nmemb;
   int rc=0;
   
-  if(fc->failed)
+  if(t->failed)
     return 0;
 
-  fc->total_bytes += len;
+  t->total_bytes += len;
 
-  if(fc->save_content) {
-    char *b;
-    flickcurl_chunk *chunk;
-    
-    b=(char*)malloc(len);
-    chunk=(flickcurl_chunk*)malloc(sizeof(*chunk));
-    if(b && chunk) {
-      fc->chunks_count++;
-
-      memcpy(b, ptr, len);
-      chunk->content=b;
-      chunk->size=len;
-      chunk->prev= fc->chunks;
-
-      fc->chunks=chunk;
-    } else {
-      if(b)
-        free(b);
-      if(chunk)
-        free(chunk);
+  if(t->save_content) {
+    if(flickcurl_transfer_reserve(t, len)) {
       flickcurl_error(fc, "Out of memory");
+      t->failed=1;
+      return 0;
     }
-      
+    memcpy(t->content + t->content_length, ptr, len);
+    t->content_length += len;
   }
   
-  if(fc->xml_parse_content) {
-    if(!fc->xc) {
+  if(t->xml_parse_content) {
+    if(!t->xc) {
       xmlParserCtxtPtr xc;
 
-      xc = xmlCreatePushParserCtxt(NULL, NULL,
-                                   (const char*)ptr, len,
-                                   (const char*)fc->uri);
+      if(t->sax) {
+        /* no DOM is built; events go to the transfer's handler */
+        xmlSAXHandler sax;
+
+        memset(&sax, '\0', sizeof(sax));
+        sax.startElementNs=flickcurl_sax_start_element;
+        sax.endElementNs=flickcurl_sax_end_element;
+        sax.characters=flickcurl_sax_characters;
+        sax.cdataBlock=flickcurl_sax_characters;
+        sax.initialized=XML_SAX2_MAGIC;
+
+        xc = xmlCreatePushParserCtxt(&sax, t,
+                                     (const char*)ptr, len,
+                                     (const char*)t->uri);
+      } else
+        xc = xmlCreatePushParserCtxt(NULL, NULL,
+                                     (const char*)ptr, len,
+                                     (const char*)t->uri);
       if(!xc)
         rc=1;
       else {
         xc->replaceEntities = 1;
         xc->loadsubset = 1;
       }
-      fc->xc=xc;
+      t->xc=xc;
     } else
-      rc=xmlParseChunk(fc->xc, (const char*)ptr, len, 0);
+      rc=xmlParseChunk(t->xc, (const char*)ptr, len, 0);
 
 #if FLICKCURL_DEBUG > 2
     fprintf(stderr, "Got >>%s<< (%d bytes)\n", (const char*)ptr, len);
@@ -202,31 +316,18 @@ flickcurl_new(void)
 
   /* DEFAULT delay between requests is 1000ms i.e 1 request/second max */
   fc->request_delay=1000;
+
+  /* DEFAULT ask for compressed responses */
+  fc->compression=1;
   
   if(!fc->curl_handle) {
     fc->curl_handle=curl_easy_init();
     fc->curl_init_here=1;
   }
 
-#ifndef CURLOPT_WRITEDATA
-#define CURLOPT_WRITEDATA CURLOPT_FILE
-#endif
-
-  /* send all data to this function  */
-  curl_easy_setopt(fc->curl_handle, CURLOPT_WRITEFUNCTION, 
-                   flickcurl_write_callback);
-  /* ... using this data pointer */
-  curl_easy_setopt(fc->curl_handle, CURLOPT_WRITEDATA, fc);
-
-
-  /* Make it follow Location: headers */
-  curl_easy_setopt(fc->curl_handle, CURLOPT_FOLLOWLOCATION, 1);
-
-#if FLICKCURL_DEBUG > 2
-  curl_easy_setopt(fc->curl_handle, CURLOPT_VERBOSE, (void*)1);
-#endif
-
-  curl_easy_setopt(fc->curl_handle, CURLOPT_ERRORBUFFER, fc->error_buffer);
+  /* callbacks and per-request options are set by
+   * flickcurl_transfer_setup() for each call
+   */
 
   return fc;
 }
@@ -250,6 +351,15 @@ flickcurl_free(flickcurl *fc)
     xmlFreeParserCtxt(fc->xc); 
   }
 
+  if(fc->cached_doc)
+    xmlFreeDoc(fc->cached_doc);
+
+  if(fc->retry_params)
+    flickcurl_free_retry_params(fc->retry_params);
+
+  if(fc->content_buffer)
+    free(fc->content_buffer);
+
   if(fc->api_key)
     free(fc->api_key);
   if(fc->secret)
@@ -288,18 +398,14 @@ flickcurl_free(flickcurl *fc)
   }
 
   if(fc->param_fields) {
-    int i;
-    
-    for(i=0; fc->param_fields[i]; i++) {
-      free(fc->param_fields[i]);
-      free(fc->param_values[i]);
-    }
     free(fc->param_fields);
     free(fc->param_values);
     fc->param_fields=NULL;
     fc->param_values=NULL;
     fc->parameter_count=0;
   }
+  if(fc->param_storage)
+    free(fc->param_storage);
   if(fc->upload_field)
     free(fc->upload_field);
   if(fc->upload_value)
@@ -348,6 +454,8 @@ void
 flickcurl_finish(void)
 {
   flickcurl_serializer_terminate();
+  flickcurl_field_maps_terminate();
+  flickcurl_xpath_cache_terminate();
   xmlCleanupParser();
   curl_global_cleanup();
 }
@@ -427,6 +535,121 @@ flickcurl_set_proxy(flickcurl* fc, const char *proxy)
 }
 
 
+/**
+ * flickcurl_set_cache:
+ * @fc: flickcurl object
+ * @cache: flickcurl cache object or NULL
+ *
+ * Set response cache for flickcurl requests
+ *
+ * See flickcurl_new_cache().
+ */
+void
+flickcurl_set_cache(flickcurl* fc, flickcurl_cache* cache)
+{
+  fc->cache=cache;
+}
+
+
+/**
+ * flickcurl_set_dedupe_index:
+ * @fc: flickcurl object
+ * @index: flickcurl dedupe index object or NULL
+ *
+ * Set upload deduplication index for flickcurl uploads
+ *
+ * See flickcurl_new_dedupe_index().
+ */
+void
+flickcurl_set_dedupe_index(flickcurl* fc, flickcurl_dedupe_index* index)
+{
+  fc->dedupe_index=index;
+}
+
+
+/**
+ * flickcurl_set_rate_limiter:
+ * @fc: flickcurl object
+ * @limiter: flickcurl rate limiter object or NULL
+ *
+ * Set token bucket rate limiter for flickcurl requests
+ *
+ * When set, requests wait only when the limiter has no tokens left
+ * and the fixed delay set by flickcurl_set_request_delay() is not
+ * used.  See flickcurl_new_rate_limiter().
+ */
+void
+flickcurl_set_rate_limiter(flickcurl* fc, flickcurl_rate_limiter* limiter)
+{
+  fc->rate_limiter=limiter;
+}
+
+
+/**
+ * flickcurl_set_progress_handler:
+ * @fc: flickcurl object
+ * @progress_handler: progress handler function or NULL
+ * @progress_data: progress handler data
+ *
+ * Set transfer progress handler for flickcurl requests
+ *
+ * The handler is called with the bytes sent and received and the
+ * current and average rates of each transfer of the session as it
+ * runs, every quarter second or so, including each of the transfers
+ * run at once by a #flickcurl_multi or upload queue.  It may return
+ * non-0 to abort the transfer, which then fails and is not retried.
+ */
+void
+flickcurl_set_progress_handler(flickcurl* fc,
+                               flickcurl_progress_handler progress_handler,
+                               void *progress_data)
+{
+  fc->progress_handler=progress_handler;
+  fc->progress_data=progress_data;
+}
+
+
+/**
+ * flickcurl_set_bandwidth_limit:
+ * @fc: flickcurl object
+ * @max_upload_rate: most bytes/second to send or 0 for no limit
+ * @max_download_rate: most bytes/second to receive or 0 for no limit
+ *
+ * Set bandwidth limits for flickcurl requests
+ *
+ * The limits are for the session as a whole: when it runs several
+ * transfers at once, such as with a #flickcurl_multi or an upload
+ * queue, they are shared equally between those in progress.  libcurl
+ * enforces them by pausing each transfer as needed, so short bursts
+ * above the limits are possible.  Limits set while transfers are
+ * running apply to transfers started afterwards.
+ */
+void
+flickcurl_set_bandwidth_limit(flickcurl* fc, long max_upload_rate,
+                              long max_download_rate)
+{
+  fc->max_upload_rate=(max_upload_rate > 0) ? max_upload_rate : 0;
+  fc->max_download_rate=(max_download_rate > 0) ? max_download_rate : 0;
+}
+
+
+/**
+ * flickcurl_set_share:
+ * @fc: flickcurl object
+ * @share: flickcurl share object or NULL
+ *
+ * Set shared connection, DNS and TLS session caches for flickcurl requests
+ *
+ * See flickcurl_new_share().  Requests made through a
+ * #flickcurl_multi use the share of the session they were added with.
+ */
+void
+flickcurl_set_share(flickcurl* fc, flickcurl_share* share)
+{
+  fc->share=share;
+}
+
+
 /**
  * flickcurl_set_http_accept:
  * @fc: flickcurl object
@@ -582,6 +805,11 @@ flickcurl_set_shared_secret(flickcurl* fc, const char *secret)
   if(fc->secret)
     free(fc->secret);
   fc->secret=strdup(secret);
+
+  /* every signature starts with the secret so hash it once here */
+  MD5_init(&fc->secret_md5_context);
+  if(fc->secret)
+    MD5_update(&fc->secret_md5_context, fc->secret, strlen(fc->secret));
 }
 
 
@@ -676,6 +904,42 @@ flickcurl_sort_args(flickcurl *fc, const char *parameters[][2], int count)
 }
 
 
+/* non-0 for URI unreserved characters (RFC 3986) that are not escaped */
+static const unsigned char flickcurl_uri_unreserved[256]={
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, /* - . */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, /* 0-9 */
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* A-O */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1, /* P-Z _ */
+  0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* a-o */
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0  /* p-z ~ */
+  /* 0x80-0xff are all escaped */
+};
+
+
+/* %-escape @len bytes of @value into @p, return the end */
+static char*
+flickcurl_uri_escape_copy(char* p, const char* value, size_t len)
+{
+  static const char hex[]="0123456789ABCDEF";
+  size_t i;
+
+  for(i=0; i < len; i++) {
+    unsigned char c=(unsigned char)value[i];
+
+    if(flickcurl_uri_unreserved[c])
+      *p++=(char)c;
+    else {
+      *p++='%';
+      *p++=hex[c >> 4];
+      *p++=hex[c & 0xf];
+    }
+  }
+  return p;
+}
+
+
 static int
 flickcurl_prepare_common(flickcurl *fc, 
                          const char* url,
@@ -685,9 +949,11 @@ flickcurl_prepare_common(flickcurl *fc,
                          int parameters_in_url, int need_auth)
 {
   int i;
-  char *md5_string=NULL;
-  size_t* values_len=NULL;
-  unsigned int fc_uri_len = 0;
+  int sign;
+  size_t url_len;
+  size_t fc_uri_len;
+  size_t storage_len;
+  char* p;
   
   if(!url || !parameters)
     return 1;
@@ -712,17 +978,10 @@ flickcurl_prepare_common(flickcurl *fc,
     fc->data_length=0;
     fc->data_is_xml=0;
   }
-  if(fc->param_fields) {
-    for(i=0; fc->param_fields[i]; i++) {
-      free(fc->param_fields[i]);
-      free(fc->param_values[i]);
-    }
-    free(fc->param_fields);
-    free(fc->param_values);
-    fc->param_fields=NULL;
-    fc->param_values=NULL;
-    fc->parameter_count=0;
-  }
+  /* the parameter arrays and storage are kept for the next request */
+  if(fc->param_fields)
+    fc->param_fields[0]=NULL;
+  fc->parameter_count=0;
   if(fc->upload_field) {
     free(fc->upload_field);
     fc->upload_field=NULL;
@@ -731,6 +990,7 @@ flickcurl_prepare_common(flickcurl *fc,
     free(fc->upload_value);
     fc->upload_value=NULL;
   }
+  fc->upload_stream=NULL;
   
   if(!fc->secret) {
     flickcurl_error(fc, "No shared secret");
@@ -742,12 +1002,15 @@ flickcurl_prepare_common(flickcurl *fc,
   }
 
   
-  if(fc->method)
-    free(fc->method);
-  if(method)
-    fc->method=strdup(method);
-  else
-    fc->method=NULL;
+  /* usually the same method as the last request */
+  if(!method || !fc->method || strcmp(fc->method, method)) {
+    if(fc->method)
+      free(fc->method);
+    if(method)
+      fc->method=strdup(method);
+    else
+      fc->method=NULL;
+  }
 
   if(fc->method) {
     parameters[count][0]  = "method";
@@ -764,137 +1027,169 @@ flickcurl_prepare_common(flickcurl *fc,
 
   parameters[count][0]  = NULL;
 
-  /* +1 for api_sig +1 for NULL terminating pointer */
-  fc->param_fields=(char**)calloc(count+2, sizeof(char*));
-  fc->param_values=(char**)calloc(count+2, sizeof(char*));
-  values_len=(size_t*)calloc(count+2, sizeof(size_t));
-
-  if((need_auth && fc->auth_token) || fc->sign)
+  sign=((need_auth && fc->auth_token) || fc->sign);
+  if(sign)
     flickcurl_sort_args(fc, parameters, count);
 
-  fc_uri_len = strlen(url);
-  
-  /* Save away the parameters and calculate the value lengths */
+  /* +1 for api_sig +1 for NULL terminating pointer */
+  if(fc->param_capacity < count + 2) {
+    char** fields;
+    char** values;
+    int capacity=(count + 2 < 16) ? 16 : count + 2;
+
+    fields=(char**)malloc(capacity * sizeof(char*));
+    values=(char**)malloc(capacity * sizeof(char*));
+    if(!fields || !values) {
+      if(fields)
+        free(fields);
+      if(values)
+        free(values);
+      flickcurl_error(fc, "Out of memory");
+      return 1;
+    }
+    if(fc->param_fields) {
+      free(fc->param_fields);
+      free(fc->param_values);
+    }
+    fc->param_fields=fields;
+    fc->param_values=values;
+    fc->param_capacity=capacity;
+  }
+
+  /* Size the parameter copies and the URI */
+  url_len=strlen(url);
+  storage_len=7 + 1 + 32 + 1; /* api_sig=MD5 */
+  fc_uri_len=url_len + 7 + 1 + 32; /* api_sig=MD5: never escaped */
   for(i=0; parameters[i][0]; i++) {
     size_t param_len=strlen(parameters[i][0]);
+    size_t value_len;
 
-    if(parameters[i][1])
-      values_len[i]=strlen(parameters[i][1]);
-    else {
-      values_len[i] = 0;
+    if(!parameters[i][1])
       parameters[i][1] = "";
-    }
-    fc->param_fields[i]=(char*)malloc(param_len+1);
-    strcpy(fc->param_fields[i], parameters[i][0]);
-    fc->param_values[i]=(char*)malloc(values_len[i]+1);
-    strcpy(fc->param_values[i], parameters[i][1]);
+    value_len=strlen(parameters[i][1]);
 
-    /* 3x value len is conservative URI %XX escaping on every char */
-    fc_uri_len += param_len + 1 /* = */ + 3 * values_len[i];
+    storage_len += param_len + 1 + value_len + 1;
+    /* 3x value len is conservative URI %XX escaping on every char,
+     * +1 for = and +1 for & */
+    fc_uri_len += param_len + 1 + 3 * value_len + 1;
   }
 
-  if(upload_field) {
-    fc->upload_field=(char*)malloc(strlen(upload_field)+1);
-    strcpy(fc->upload_field, upload_field);
+  if(fc->param_storage_len < storage_len) {
+    char* storage=(char*)malloc(storage_len);
+    if(!storage) {
+      flickcurl_error(fc, "Out of memory");
+      return 1;
+    }
+    if(fc->param_storage)
+      free(fc->param_storage);
+    fc->param_storage=storage;
+    fc->param_storage_len=storage_len;
+  }
 
-    fc->upload_value=(char*)malloc(strlen(upload_value)+1);
-    strcpy(fc->upload_value, upload_value);
+  /* reuse or grow uri buffer */
+  if(fc->uri_len < fc_uri_len) {
+    char* uri=(char*)malloc(fc_uri_len+1);
+    if(!uri) {
+      flickcurl_error(fc, "Out of memory");
+      return 1;
+    }
+    if(fc->uri)
+      free(fc->uri);
+    fc->uri = uri;
+    fc->uri_len = (unsigned int)fc_uri_len;
   }
 
-  if((need_auth && fc->auth_token) || fc->sign) {
-    size_t buf_len=0;
-    char *buf;
-    
-    buf_len=strlen(fc->secret);
-    for(i=0; parameters[i][0]; i++)
-      buf_len += strlen(parameters[i][0]) + values_len[i];
-
-    buf=(char*)malloc(buf_len+1);
-    strcpy(buf, fc->secret);
-    for(i=0; parameters[i][0]; i++) {
-      strcat(buf, parameters[i][0]);
-      strcat(buf, parameters[i][1]);
+  /* Save away the parameters, write the URI and sign in one pass */
+  if(sign)
+    memcpy(&fc->md5_context, &fc->secret_md5_context,
+           sizeof(fc->md5_context));
+
+  p=fc->param_storage;
+  memcpy(fc->uri, url, url_len);
+  fc_uri_len=url_len;
+
+  for(i=0; parameters[i][0]; i++) {
+    const char* name=parameters[i][0];
+    const char* value=parameters[i][1];
+    size_t param_len=strlen(name);
+    size_t value_len=strlen(value);
+
+    fc->param_fields[i]=p;
+    memcpy(p, name, param_len + 1);
+    p += param_len + 1;
+    fc->param_values[i]=p;
+    memcpy(p, value, value_len + 1);
+    p += value_len + 1;
+
+    if(sign) {
+      MD5_update(&fc->md5_context, name, param_len);
+      MD5_update(&fc->md5_context, value, value_len);
     }
-    
-#ifdef FLICKCURL_DEBUG
-    fprintf(stderr, "MD5 Buffer '%s'\n", buf);
-#endif
-    md5_string=MD5_string(buf);
-    
-    parameters[count][0]  = "api_sig";
-    parameters[count][1]= md5_string;
 
-    /* Add a new parameter pair */
-    values_len[count]=32; /* MD5 is always 32 */
-    fc->param_fields[count]=(char*)malloc(7+1); /* 7=strlen(api_sig) */
-    strcpy(fc->param_fields[count], parameters[count][0]);
-    fc->param_values[count]=(char*)malloc(32+1); /* 32=MD5 */
-    strcpy(fc->param_values[count], parameters[count][1]);
+    if(parameters_in_url) {
+      char* u=fc->uri + fc_uri_len;
 
-    fc_uri_len += 7 /* "api_sig" */ + 1 /* = */ + 32 /* MD5 value: never escaped */;
+      memcpy(u, name, param_len);
+      u += param_len;
+      *u++='=';
+      if(!strcmp(name, "method")) {
+        /* do not touch method name */
+        memcpy(u, value, value_len);
+        u += value_len;
+      } else
+        u=flickcurl_uri_escape_copy(u, value, value_len);
+      *u++='&';
+      fc_uri_len=u - fc->uri;
+    }
+  }
+
+  if(sign) {
+    fc->param_fields[count]=p;
+    memcpy(p, "api_sig", 8);
+    p += 8;
+    fc->param_values[count]=p;
+    MD5_final_hex(&fc->md5_context, p);
 
-    count++;
-    
 #ifdef FLICKCURL_DEBUG
-    fprintf(stderr, "Signature: '%s'\n", parameters[count-1][1]);
+    fprintf(stderr, "Signature: '%s'\n", p);
 #endif
-    
-    free(buf);
-    
-    parameters[count][0] = NULL;
-  }
 
-  /* add &s between parameters */
-  fc_uri_len += count-1;
+    if(parameters_in_url) {
+      memcpy(fc->uri + fc_uri_len, "api_sig=", 8);
+      memcpy(fc->uri + fc_uri_len + 8, p, 32);
+      fc_uri_len += 8 + 32 + 1;
+    }
 
-  /* reuse or grow uri buffer */
-  if(fc->uri_len < fc_uri_len) {
-    free(fc->uri);
-    fc->uri = (char*)malloc(fc_uri_len+1);
-    fc->uri_len = fc_uri_len;
+    parameters[count][0]  = "api_sig";
+    parameters[count][1]  = p;
+    count++;
+    parameters[count][0] = NULL;
   }
-  strcpy(fc->uri, url);
 
-  if(parameters_in_url) {
-    for(i=0; parameters[i][0]; i++) {
-      char *value=(char*)parameters[i][1];
-      char *escaped_value=NULL;
+  fc->param_fields[count]=NULL;
+  fc->param_values[count]=NULL;
+  fc->parameter_count=count;
 
-      if(!parameters[i][1])
-        continue;
-
-      strcat(fc->uri, parameters[i][0]);
-      strcat(fc->uri, "=");
-      if(!strcmp(parameters[i][0], "method")) {
-        /* do not touch method name */
-      } else
-        escaped_value=curl_escape(value, values_len[i]);
+  /* zap last & */
+  if(parameters_in_url && count)
+    fc_uri_len--;
+  fc->uri[fc_uri_len]='\0';
 
-      if(escaped_value) {
-        strcat(fc->uri, escaped_value);
-        curl_free(escaped_value);
-      } else
-        strcat(fc->uri, value);
-      strcat(fc->uri, "&");
-    }
+  if(upload_field) {
+    fc->upload_field=(char*)malloc(strlen(upload_field)+1);
+    strcpy(fc->upload_field, upload_field);
 
-    /* zap last & */
-    fc->uri[strlen(fc->uri)-1]= '\0';
+    fc->upload_value=(char*)malloc(strlen(upload_value)+1);
+    strcpy(fc->upload_value, upload_value);
   }
 
 #ifdef FLICKCURL_DEBUG
   fprintf(stderr, "URI is '%s'\n", fc->uri);
 
-  FLICKCURL_ASSERT((strlen(fc->uri) == fc_uri_len),
-                   "Final URI does not match expected length");
+  FLICKCURL_ASSERT((strlen(fc->uri) > fc->uri_len),
+                   "Final URI overflows the URI buffer");
 #endif
 
-  if(md5_string)
-    free(md5_string);
-
-  if(values_len)
-    free(values_len);
-
   return 0;
 }
 
@@ -1050,35 +1345,82 @@ nanosleep(const struct timespec *rqtp, struct timespec *rmtp)
 /* end HAVE_NANOSLEEP */
 
 
+/*
+ * flickcurl_msleep:
+ * @msec: milliseconds
+ *
+ * INTERNAL - Sleep for a while
+ */
+void
+flickcurl_msleep(long msec)
+{
+  struct timespec nwait;
+
+  if(msec <= 0)
+    return;
+
+  nwait.tv_sec= msec / 1000;
+  nwait.tv_nsec= 1000000 * (msec % 1000);
+  nanosleep(&nwait, NULL);
+}
+
+
 static size_t 
 flickcurl_curl_header_callback(void* ptr,  size_t  size, size_t nmemb,
                                void *userdata) 
 {
-  flickcurl* fc=(flickcurl*)userdata;
+  flickcurl_transfer* t=(flickcurl_transfer*)userdata;
   int bytes=size*nmemb;
 
-  /* If flickcurl has already failed, return nothing so that
+  /* If the transfer has already failed, return nothing so that
    * libcurl will abort the transfer
    */
-  if(fc->failed)
+  if(t->failed)
     return 0;
   
 #define EC_HEADER_LEN 17
 #define EM_HEADER_LEN 20
+#define RA_HEADER_LEN 13
+#define CL_HEADER_LEN 16
 
   if(!strncmp((char*)ptr, "X-FlickrErrCode: ", EC_HEADER_LEN)) {
-    fc->error_code=atoi((char*)ptr+EC_HEADER_LEN);
+    t->error_code=atoi((char*)ptr+EC_HEADER_LEN);
   } else if(!strncmp((char*)ptr, "X-FlickrErrMessage: ", EM_HEADER_LEN)) {
     int len=bytes-EM_HEADER_LEN;
-    if(fc->error_msg)
-      free(fc->error_msg);
-    fc->error_msg=(char*)malloc(len+1);
-    strncpy(fc->error_msg, (char*)ptr+EM_HEADER_LEN, len);
-    fc->error_msg[len]='\0';
-    while(fc->error_msg[len-1]=='\r' || fc->error_msg[len-1]=='\n') {
-      fc->error_msg[len-1]='\0';
+    if(t->error_msg)
+      free(t->error_msg);
+    t->error_msg=(char*)malloc(len+1);
+    strncpy(t->error_msg, (char*)ptr+EM_HEADER_LEN, len);
+    t->error_msg[len]='\0';
+    while(t->error_msg[len-1]=='\r' || t->error_msg[len-1]=='\n') {
+      t->error_msg[len-1]='\0';
       len--;
     }
+  } else if(t->save_content && bytes > CL_HEADER_LEN &&
+            curl_strnequal((char*)ptr, "Content-Length: ", CL_HEADER_LEN)) {
+    /* size the content buffer once instead of growing it */
+    long length=atol((char*)ptr+CL_HEADER_LEN);
+    if(length > 0 && length <= FLICKCURL_CONTENT_PRESIZE_MAX &&
+       !t->content_length)
+      flickcurl_transfer_reserve(t, (size_t)length);
+  } else if(bytes > RA_HEADER_LEN &&
+            curl_strnequal((char*)ptr, "Retry-After: ", RA_HEADER_LEN)) {
+    /* delay in seconds or an HTTP date */
+    char value[64];
+    int len=bytes-RA_HEADER_LEN;
+    if(len > (int)sizeof(value)-1)
+      len=sizeof(value)-1;
+    memcpy(value, (char*)ptr+RA_HEADER_LEN, len);
+    value[len]='\0';
+    if(value[0] >= '0' && value[0] <= '9')
+      t->retry_after=atol(value);
+    else {
+      time_t date=curl_getdate(value, NULL);
+      if(date != (time_t)-1) {
+        time_t now=time(NULL);
+        t->retry_after=(date > now) ? (long)(date - now) : 0;
+      }
+    }
   }
   
   return bytes;
@@ -1094,7 +1436,8 @@ flickcurl_curl_header_callback(void* ptr,  size_t  size, size_t nmemb,
  * Returns the wait time that would be applied in order to delay a
  * web service request such that the web service rate limit is met.
  *
- * See flickcurl_set_request_delay() which by default is set to 1000ms.
+ * See flickcurl_set_request_delay() which by default is set to
+ * 1000ms or flickcurl_set_rate_limiter().
  * 
  * Return value: delay in usecs or < 0 if delay is more than 247 seconds ('infinity')
  */
@@ -1108,6 +1451,11 @@ flickcurl_get_current_request_wait(flickcurl *fc)
   struct timeval now;
   struct timeval uwait;
   
+  if(fc->rate_limiter) {
+    long wait=flickcurl_rate_limiter_get_wait(fc->rate_limiter);
+    return (wait > 247 * 1000000L) ? -1 : (int)wait;
+  }
+
   /* If there was no previous request, return 0 */
   if(!fc->last_request_time.tv_sec)
     return 0;
@@ -1146,12 +1494,887 @@ flickcurl_get_current_request_wait(flickcurl *fc)
 }
 
 
-static int
-flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
-                        xmlDocPtr* docptr_p)
+/**
+ * flickcurl_get_transfer_stats:
+ * @fc: flickcurl object
+ * @stats: pointer to store the stats
+ *
+ * Get the bytes transferred and rates of the last request
+ *
+ * The stats are of the last request made by flickcurl_invoke() or
+ * completed by a #flickcurl_multi in the session, and are all 0 if it
+ * was answered from a response cache.  For a request that was retried
+ * they are of the last attempt.
+ */
+void
+flickcurl_get_transfer_stats(flickcurl* fc, flickcurl_transfer_stats* stats)
 {
-  struct curl_slist *slist=NULL;
-  xmlDocPtr doc=NULL;
+  memcpy(stats, &fc->transfer_stats, sizeof(flickcurl_transfer_stats));
+}
+
+
+/*
+ * flickcurl_transfer_init:
+ * @fc: flickcurl session with a prepared request
+ * @t: transfer to initialise
+ * @save_content: non-0 to save raw content rather than parse XML
+ *
+ * INTERNAL - Take a copy of the request prepared in @fc into @t
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_transfer_init(flickcurl* fc, flickcurl_transfer* t, int save_content)
+{
+  memset(t, '\0', sizeof(*t));
+  t->fc=fc;
+  t->retry_after= -1;
+
+  if(!fc->uri) {
+    flickcurl_error(fc, "No Flickr URI prepared to invoke");
+    return 1;
+  }
+
+  if(save_content)
+    t->save_content=1;
+  else
+    t->xml_parse_content=1;
+
+  t->uri=strdup(fc->uri);
+  if(!t->uri)
+    goto oom;
+
+  if(fc->method) {
+    t->method=strdup(fc->method);
+    if(!t->method)
+      goto oom;
+  }
+
+  t->is_write=fc->is_write;
+
+  t->sax=fc->sax;
+  t->sax_data=fc->sax_data;
+
+  t->cache_key=flickcurl_cache_make_key(fc, &t->cache_ttl);
+  if(t->cache_key) {
+    t->cache=fc->cache;
+    /* keep the content to add to the cache */
+    t->save_content=1;
+  }
+  
+  if(fc->data) {
+    t->data=(char*)malloc(fc->data_length);
+    if(!t->data)
+      goto oom;
+    memcpy(t->data, fc->data, fc->data_length);
+    t->data_length=fc->data_length;
+  }
+
+  /* Insert HTTP Accept: header */
+  if(fc->http_accept)
+    t->slist=curl_slist_append(t->slist, (const char*)fc->http_accept);
+
+  if(t->data)
+    /* Replace default POST content type 'application/x-www-form-urlencoded' */
+    t->slist=curl_slist_append(t->slist, (const char*)"Content-Type: application/xml");
+
+  if(fc->upload_field) {
+    struct curl_httppost* last = NULL;
+    int i;
+    
+    /* Main parameters */
+    for(i=0; fc->param_fields[i]; i++) {
+      curl_formadd(&t->post, &last, CURLFORM_COPYNAME, fc->param_fields[i],
+                   CURLFORM_COPYCONTENTS, fc->param_values[i],
+                   CURLFORM_END);
+    }
+    
+    /* Upload parameter */
+    if(fc->upload_stream) {
+#if LIBCURL_VERSION_NUM >= 0x071202
+      memcpy(&t->upload_stream, fc->upload_stream,
+             sizeof(flickcurl_upload_stream));
+      t->upload_stream.offset=0;
+
+      /* body is read by flickcurl_upload_stream_read(); the upload
+       * value is only the file name to send
+       */
+      if(t->upload_stream.length >= 0)
+        curl_formadd(&t->post, &last, CURLFORM_COPYNAME, fc->upload_field,
+                     CURLFORM_STREAM, t,
+#if LIBCURL_VERSION_NUM >= 0x072e00
+                     CURLFORM_CONTENTLEN, (curl_off_t)t->upload_stream.length,
+#else
+                     CURLFORM_CONTENTSLENGTH, t->upload_stream.length,
+#endif
+                     CURLFORM_FILENAME, fc->upload_value,
+                     CURLFORM_END);
+      else {
+        curl_formadd(&t->post, &last, CURLFORM_COPYNAME, fc->upload_field,
+                     CURLFORM_STREAM, t,
+                     CURLFORM_FILENAME, fc->upload_value,
+                     CURLFORM_END);
+#if LIBCURL_VERSION_NUM < 0x073800
+        /* libcurl only chunks a form of unknown size itself from 7.56.0 */
+        t->slist=curl_slist_append(t->slist,
+                                   (const char*)"Transfer-Encoding: chunked");
+#endif
+      }
+#else
+      flickcurl_error(fc, "Uploading from a stream needs libcurl 7.18.2 or newer");
+      flickcurl_transfer_clear(t);
+      return 1;
+#endif
+    } else
+      curl_formadd(&t->post, &last, CURLFORM_COPYNAME, fc->upload_field,
+                   CURLFORM_FILE, fc->upload_value, CURLFORM_END);
+  }
+
+  return 0;
+
+  oom:
+  flickcurl_error(fc, "Out of memory");
+  flickcurl_transfer_clear(t);
+  return 1;
+}
+
+
+/* libcurl read callback for an upload body from a flickcurl_upload_stream */
+static size_t
+flickcurl_upload_stream_read(char* ptr, size_t size, size_t nmemb,
+                             void* userdata)
+{
+  flickcurl_transfer* t=(flickcurl_transfer*)userdata;
+  flickcurl_upload_stream* stream=&t->upload_stream;
+  size_t len=size * nmemb;
+
+  if(stream->length >= 0 && (long)len > stream->length - stream->offset)
+    len=(size_t)(stream->length - stream->offset);
+  if(!len)
+    return 0;
+
+  switch(stream->type) {
+    case FLICKCURL_UPLOAD_STREAM_BUFFER:
+      memcpy(ptr, stream->buffer + stream->offset, len);
+      break;
+
+    case FLICKCURL_UPLOAD_STREAM_FD:
+      {
+        int rc;
+        do {
+          rc=(int)read(stream->fd, ptr, len);
+        } while(rc < 0 && errno == EINTR);
+        if(rc < 0)
+          return CURL_READFUNC_ABORT;
+        len=(size_t)rc;
+      }
+      break;
+
+    case FLICKCURL_UPLOAD_STREAM_CALLBACK:
+      {
+        int rc=stream->read_callback(stream->read_callback_data, ptr, len);
+        if(rc < 0)
+          return CURL_READFUNC_ABORT;
+        len=(size_t)rc;
+      }
+      break;
+
+    case FLICKCURL_UPLOAD_STREAM_NONE:
+    default:
+      return CURL_READFUNC_ABORT;
+  }
+
+  /* a known length must all be sent */
+  if(!len && stream->length >= 0)
+    return CURL_READFUNC_ABORT;
+
+  stream->offset+= (long)len;
+  return len;
+}
+
+
+/* msecs from @from to @to */
+static double
+flickcurl_timeval_diff_msec(struct timeval* from, struct timeval* to)
+{
+  return (to->tv_sec - from->tv_sec) * 1000.0 +
+         (to->tv_usec - from->tv_usec) / 1000.0;
+}
+
+
+/* update the stats of a transfer, the current rates only once enough
+ * time has passed to measure them.  Returns non-0 if they were
+ */
+static int
+flickcurl_transfer_update_stats(flickcurl_transfer* t,
+                                double uploaded, double upload_total,
+                                double downloaded, double download_total)
+{
+  flickcurl_transfer_stats* stats=&t->stats;
+  struct timeval now;
+  double msec;
+
+  gettimeofday(&now, NULL);
+
+  stats->uploaded=uploaded;
+  stats->upload_total=upload_total;
+  stats->downloaded=downloaded;
+  stats->download_total=download_total;
+  stats->elapsed=flickcurl_timeval_diff_msec(&t->start_time, &now) / 1000.0;
+  if(stats->elapsed > 0) {
+    stats->upload_average=uploaded / stats->elapsed;
+    stats->download_average=downloaded / stats->elapsed;
+  }
+
+  msec=flickcurl_timeval_diff_msec(&t->rate_time, &now);
+  if(msec < FLICKCURL_PROGRESS_INTERVAL_MSEC)
+    return 0;
+
+  stats->upload_rate=(uploaded - t->rate_uploaded) * 1000.0 / msec;
+  stats->download_rate=(downloaded - t->rate_downloaded) * 1000.0 / msec;
+  t->rate_uploaded=uploaded;
+  t->rate_downloaded=downloaded;
+  t->rate_time=now;
+
+  return 1;
+}
+
+
+static int
+flickcurl_transfer_progress(flickcurl_transfer* t,
+                            double uploaded, double upload_total,
+                            double downloaded, double download_total)
+{
+  flickcurl* fc=t->fc;
+
+  if(!flickcurl_transfer_update_stats(t, uploaded, upload_total,
+                                      downloaded, download_total) ||
+     !fc->progress_handler)
+    return 0;
+
+  if(fc->progress_handler(fc->progress_data, &t->stats)) {
+    t->aborted=1;
+    return 1;
+  }
+  return 0;
+}
+
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+/* libcurl transfer progress callback */
+static int
+flickcurl_curl_xferinfo_callback(void* clientp,
+                                 curl_off_t dltotal, curl_off_t dlnow,
+                                 curl_off_t ultotal, curl_off_t ulnow)
+{
+  return flickcurl_transfer_progress((flickcurl_transfer*)clientp,
+                                     (double)ulnow, (double)ultotal,
+                                     (double)dlnow, (double)dltotal);
+}
+#else
+/* libcurl transfer progress callback */
+static int
+flickcurl_curl_progress_callback(void* clientp,
+                                 double dltotal, double dlnow,
+                                 double ultotal, double ulnow)
+{
+  return flickcurl_transfer_progress((flickcurl_transfer*)clientp,
+                                     ulnow, ultotal, dlnow, dltotal);
+}
+#endif
+
+
+/* share the session bandwidth limits between its transfers in progress */
+static void
+flickcurl_share_bandwidth(flickcurl* fc)
+{
+#if LIBCURL_VERSION_NUM >= 0x070f05
+  curl_off_t max_send=0;
+  curl_off_t max_recv=0;
+  flickcurl_transfer* t;
+
+  if(fc->active_transfers_count) {
+    max_send=(curl_off_t)(fc->max_upload_rate / fc->active_transfers_count);
+    max_recv=(curl_off_t)(fc->max_download_rate / fc->active_transfers_count);
+    /* 0 would be no limit */
+    if(fc->max_upload_rate && !max_send)
+      max_send=1;
+    if(fc->max_download_rate && !max_recv)
+      max_recv=1;
+  }
+
+  for(t=fc->active_transfers; t; t=t->active_next) {
+    curl_easy_setopt(t->curl_handle, CURLOPT_MAX_SEND_SPEED_LARGE, max_send);
+    curl_easy_setopt(t->curl_handle, CURLOPT_MAX_RECV_SPEED_LARGE, max_recv);
+  }
+#endif
+}
+
+
+/* add a transfer starting to the session's transfers in progress */
+static void
+flickcurl_transfer_activate(flickcurl_transfer* t)
+{
+  flickcurl* fc=t->fc;
+
+  t->active=1;
+  t->active_prev=NULL;
+  t->active_next=fc->active_transfers;
+  if(fc->active_transfers)
+    fc->active_transfers->active_prev=t;
+  fc->active_transfers=t;
+  fc->active_transfers_count++;
+
+  if(fc->max_upload_rate || fc->max_download_rate)
+    flickcurl_share_bandwidth(fc);
+#if LIBCURL_VERSION_NUM >= 0x070f05
+  else {
+    /* the handle may have been limited by an earlier transfer */
+    curl_easy_setopt(t->curl_handle, CURLOPT_MAX_SEND_SPEED_LARGE, (curl_off_t)0);
+    curl_easy_setopt(t->curl_handle, CURLOPT_MAX_RECV_SPEED_LARGE, (curl_off_t)0);
+  }
+#endif
+}
+
+
+/* remove a transfer from the session's transfers in progress */
+static void
+flickcurl_transfer_deactivate(flickcurl_transfer* t)
+{
+  flickcurl* fc=t->fc;
+
+  if(!t->active)
+    return;
+
+  if(t->active_prev)
+    t->active_prev->active_next=t->active_next;
+  else
+    fc->active_transfers=t->active_next;
+  if(t->active_next)
+    t->active_next->active_prev=t->active_prev;
+  t->active=0;
+  t->active_prev=NULL;
+  t->active_next=NULL;
+  fc->active_transfers_count--;
+
+  if(fc->max_upload_rate || fc->max_download_rate)
+    flickcurl_share_bandwidth(fc);
+}
+
+
+/*
+ * flickcurl_transfer_setup:
+ * @t: transfer
+ * @curl_handle: curl easy handle
+ *
+ * INTERNAL - Set the options on a curl easy handle to run transfer @t
+ */
+void
+flickcurl_transfer_setup(flickcurl_transfer* t, CURL* curl_handle)
+{
+  flickcurl* fc=t->fc;
+
+  t->curl_handle=curl_handle;
+
+#ifndef CURLOPT_WRITEDATA
+#define CURLOPT_WRITEDATA CURLOPT_FILE
+#endif
+
+  /* send all data to this function  */
+  curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, 
+                   flickcurl_write_callback);
+  /* ... using this data pointer */
+  curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, t);
+
+  /* send all headers to this function */
+  curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, 
+                   flickcurl_curl_header_callback);
+  /* ... using this data pointer */
+  curl_easy_setopt(curl_handle, CURLOPT_WRITEHEADER, t);
+
+  /* so the transfer can be found from the handle when run by multi.c */
+  curl_easy_setopt(curl_handle, CURLOPT_PRIVATE, t);
+
+  /* Make it follow Location: headers */
+  curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1);
+
+#if LIBCURL_VERSION_NUM < 0x071506
+#define CURLOPT_ACCEPT_ENCODING CURLOPT_ENCODING
+#endif
+
+  /* "" asks for all encodings libcurl supports; the write callback
+   * gets decoded data
+   */
+  curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING,
+                   fc->compression ? "" : NULL);
+
+  curl_easy_setopt(curl_handle, CURLOPT_SHARE,
+                   fc->share ? flickcurl_share_get_curl_share(fc->share) : NULL);
+
+#if FLICKCURL_DEBUG > 2
+  curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, (void*)1);
+#endif
+
+  curl_easy_setopt(curl_handle, CURLOPT_ERRORBUFFER, t->error_buffer);
+
+  if(fc->proxy)
+    curl_easy_setopt(curl_handle, CURLOPT_PROXY, fc->proxy);
+
+  if(fc->user_agent)
+    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, fc->user_agent);
+
+  /* specify URL to call */
+  curl_easy_setopt(curl_handle, CURLOPT_URL, t->uri);
+
+  /* default: read with no data: GET */
+  curl_easy_setopt(curl_handle, CURLOPT_NOBODY, 1);
+  curl_easy_setopt(curl_handle, CURLOPT_HTTPGET, 1);
+
+  if(t->data) {
+    /* write with some data: POST */
+    /* CURLOPT_NOBODY=0 sets http request to HEAD - do it first to override */
+    curl_easy_setopt(curl_handle, CURLOPT_NOBODY, 0);
+    /* this function only resets no-body flag for curl >= 7.14.1 */
+    curl_easy_setopt(curl_handle, CURLOPT_POST, 1);
+    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDS, t->data);
+    curl_easy_setopt(curl_handle, CURLOPT_POSTFIELDSIZE, (long)t->data_length);
+    /* curl_easy_setopt(curl_handle, CURLOPT_CUSTOMREQUEST, fc->verb); */
+  } else if(t->is_write) {
+    /* write with no data: POST */
+    /* CURLOPT_NOBODY=0 sets http request to HEAD - do it first to override */
+    curl_easy_setopt(curl_handle, CURLOPT_NOBODY, 0);
+    /* this function only resets no-body flag for curl >= 7.14.1 */
+    curl_easy_setopt(curl_handle, CURLOPT_POST, 1);
+  }
+
+  /* set slist always - either a list of headers or none (NULL) */
+  curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, t->slist);
+
+  /* Set the form info */
+  if(t->post)
+    curl_easy_setopt(curl_handle, CURLOPT_HTTPPOST, t->post);
+  if(t->upload_stream.type != FLICKCURL_UPLOAD_STREAM_NONE)
+    curl_easy_setopt(curl_handle, CURLOPT_READFUNCTION,
+                     flickcurl_upload_stream_read);
+
+  gettimeofday(&t->start_time, NULL);
+  t->rate_time=t->start_time;
+  t->rate_uploaded=0;
+  t->rate_downloaded=0;
+  memset(&t->stats, '\0', sizeof(t->stats));
+
+  /* progress is only needed for the handler; stats are got at the end */
+#if LIBCURL_VERSION_NUM >= 0x072000
+  curl_easy_setopt(curl_handle, CURLOPT_XFERINFOFUNCTION,
+                   flickcurl_curl_xferinfo_callback);
+  curl_easy_setopt(curl_handle, CURLOPT_XFERINFODATA, t);
+#else
+  curl_easy_setopt(curl_handle, CURLOPT_PROGRESSFUNCTION,
+                   flickcurl_curl_progress_callback);
+  curl_easy_setopt(curl_handle, CURLOPT_PROGRESSDATA, t);
+#endif
+  curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS,
+                   fc->progress_handler ? 0L : 1L);
+
+  flickcurl_transfer_activate(t);
+
+#ifdef FLICKCURL_DEBUG
+  fprintf(stderr, "Resolving URI '%s' with method %s\n", 
+          t->uri, ((t->is_write || t->post) ? "POST" : "GET"));
+#endif
+}
+
+
+/* set the stats of a transfer libcurl has finished */
+static void
+flickcurl_transfer_final_stats(flickcurl_transfer* t)
+{
+  double uploaded=0;
+  double downloaded=0;
+  int measured;
+
+#if LIBCURL_VERSION_NUM >= 0x073700
+  curl_off_t size;
+
+  if(curl_easy_getinfo(t->curl_handle, CURLINFO_SIZE_UPLOAD_T, &size) == CURLE_OK)
+    uploaded=(double)size;
+  if(curl_easy_getinfo(t->curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &size) == CURLE_OK)
+    downloaded=(double)size;
+#else
+  curl_easy_getinfo(t->curl_handle, CURLINFO_SIZE_UPLOAD, &uploaded);
+  curl_easy_getinfo(t->curl_handle, CURLINFO_SIZE_DOWNLOAD, &downloaded);
+#endif
+
+  measured=(t->rate_time.tv_sec != t->start_time.tv_sec ||
+            t->rate_time.tv_usec != t->start_time.tv_usec);
+  flickcurl_transfer_update_stats(t, uploaded, uploaded,
+                                  downloaded, downloaded);
+  if(!measured) {
+    /* too short to have measured a current rate */
+    t->stats.upload_rate=t->stats.upload_average;
+    t->stats.download_rate=t->stats.download_average;
+  }
+}
+
+
+/*
+ * flickcurl_transfer_complete:
+ * @t: transfer
+ * @code: result of running the transfer
+ *
+ * INTERNAL - Record the HTTP status of a transfer once libcurl has finished it
+ */
+void
+flickcurl_transfer_complete(flickcurl_transfer* t, CURLcode code)
+{
+  flickcurl* fc=t->fc;
+  long lstatus;
+
+  flickcurl_transfer_deactivate(t);
+  flickcurl_transfer_final_stats(t);
+  
+  if(code != CURLE_OK) {
+    /* failed */
+    t->failed=1;
+    flickcurl_error(fc, "%s", t->error_buffer[0] ? t->error_buffer :
+                    curl_easy_strerror(code));
+    return;
+  }
+
+#ifndef CURLINFO_RESPONSE_CODE
+#define CURLINFO_RESPONSE_CODE CURLINFO_HTTP_CODE
+#endif
+
+  /* Requires pointer to a long */
+  if(CURLE_OK == 
+     curl_easy_getinfo(t->curl_handle, CURLINFO_RESPONSE_CODE, &lstatus) ) {
+    t->status_code=lstatus;
+    if(t->status_code != 200) {
+      if(t->method)
+        flickcurl_error(fc, "Method %s failed with error %d - %s (HTTP %d)", 
+                        t->method, t->error_code, t->error_msg,
+                        t->status_code);
+      else
+        flickcurl_error(fc, "Call failed with error %d - %s (HTTP %d)", 
+                        t->error_code, t->error_msg,
+                        t->status_code);
+      t->failed=1;
+    }
+  }
+}
+
+
+/* Check if raw response content in some format is a stat fail response */
+static int
+flickcurl_content_failed(const char* content, size_t content_length)
+{
+  static const char* const fail_stats[]={
+    "stat=\"fail\"",          /* rest, xml-rpc and soap */
+    "\"stat\":\"fail\"",      /* json */
+    "s:4:\"stat\";s:4:\"fail\"", /* php_serial */
+    NULL
+  };
+  size_t i;
+
+  /* the status comes first in a failure response */
+  if(content_length > 256)
+    content_length=256;
+
+  for(i=0; i < content_length; i++) {
+    int j;
+
+    for(j=0; fail_stats[j]; j++) {
+      size_t len=strlen(fail_stats[j]);
+      if(i + len <= content_length && !memcmp(content + i, fail_stats[j], len))
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/*
+ * flickcurl_transfer_finish:
+ * @t: completed transfer
+ * @docptr_p: pointer to store XML DOM (or NULL)
+ *
+ * INTERNAL - Turn the response of a completed transfer into a result
+ *
+ * The returned DOM is owned by the transfer parser context @t->xc.
+ * Saved content is left NUL-terminated in @t->content; take it by
+ * setting that to NULL.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_transfer_finish(flickcurl_transfer* t, xmlDocPtr* docptr_p)
+{
+  flickcurl* fc=t->fc;
+  xmlDocPtr doc=NULL;
+
+  if(t->failed)
+    goto tidy;
+  
+  if(t->save_content) {
+    if(flickcurl_transfer_reserve(t, 0)) {
+      flickcurl_error(fc, "Out of memory");
+      t->failed=1;
+      goto tidy;
+    }
+    t->content[t->content_length]='\0';
+
+    /* raw content is returned as is but a failure is not worth caching */
+    if(!t->xml_parse_content)
+      t->rsp_failed=flickcurl_content_failed(t->content, t->content_length);
+  }
+
+  if(t->xml_parse_content) {
+    xmlNodePtr xnp;
+    xmlAttr* attr;
+    int failed=0;
+    
+    if(!t->xc) {
+      flickcurl_error(fc, "No content returned from URI '%s'", t->uri);
+      t->failed=1;
+      goto tidy;
+    }
+
+    xmlParseChunk(t->xc, NULL, 0, 1);
+
+#ifdef FLICKCURL_DEBUG
+    fprintf(stderr, "Got %d bytes content from URI '%s'\n",
+            t->total_bytes, t->uri);
+#endif
+
+    if(t->sax) {
+      /* streamed: there is no DOM to check */
+      if(!t->xc->wellFormed) {
+        flickcurl_error(fc, "Failed to parse XML");
+        t->failed=1;
+      } else if(t->rsp_failed) {
+        if(t->method)
+          flickcurl_error(fc, "Method %s failed with error %d - %s", 
+                          t->method, t->error_code, t->error_msg);
+        else
+          flickcurl_error(fc, "Call failed with error %d - %s", 
+                          t->error_code, t->error_msg);
+        t->failed=1;
+      }
+      goto tidy;
+    }
+
+    doc=t->xc->myDoc;
+    if(!doc) {
+      flickcurl_error(fc, "Failed to create XML DOM for document");
+      t->failed=1;
+      goto tidy;
+    }
+
+    xnp = xmlDocGetRootElement(doc);
+    if(!xnp) {
+      flickcurl_error(fc, "Failed to parse XML");
+      t->failed=1;
+      goto tidy;
+    }
+
+    for(attr=xnp->properties; attr; attr=attr->next) {
+      if(!strcmp((const char*)attr->name, "stat")) {
+        const char *attr_value=(const char*)attr->children->content;
+#ifdef FLICKCURL_DEBUG
+        fprintf(stderr, "Request returned stat '%s'\n", attr_value);
+#endif
+        if(strcmp(attr_value, "ok"))
+          failed=1;
+        break;
+      }
+    }
+
+    if(failed) {
+      xmlNodePtr err=xnp->children->next;
+      for(attr=err->properties; attr; attr=attr->next) {
+        const char *attr_name=(const char*)attr->name;
+        const char *attr_value=(const char*)attr->children->content;
+        if(!strcmp(attr_name, "code"))
+          t->error_code=atoi(attr_value);
+        else if(!strcmp(attr_name, "msg")) {
+          if(t->error_msg)
+            free(t->error_msg);
+          t->error_msg=strdup(attr_value);
+        }
+      }
+      if(t->method)
+        flickcurl_error(fc, "Method %s failed with error %d - %s", 
+                        t->method, t->error_code, t->error_msg);
+      else
+        flickcurl_error(fc, "Call failed with error %d - %s", 
+                        t->error_code, t->error_msg);
+      t->failed=1;
+    } else {
+      /* pass DOM as an output parameter */
+      if(docptr_p)
+        *docptr_p=doc;
+    }
+  }
+
+  tidy:
+  return t->failed;
+}
+
+
+/*
+ * flickcurl_transfer_report:
+ * @t: finished transfer
+ *
+ * INTERNAL - Copy the result status of a transfer to its session
+ */
+void
+flickcurl_transfer_report(flickcurl_transfer* t)
+{
+  flickcurl* fc=t->fc;
+
+  fc->failed=t->failed;
+  fc->error_code=t->error_code;
+  fc->status_code=t->status_code;
+  fc->total_bytes=t->total_bytes;
+  memcpy(&fc->transfer_stats, &t->stats, sizeof(flickcurl_transfer_stats));
+  if(fc->error_msg)
+    free(fc->error_msg);
+  fc->error_msg=t->error_msg;
+  t->error_msg=NULL;
+}
+
+
+/*
+ * flickcurl_transfer_reset:
+ * @t: failed transfer
+ *
+ * INTERNAL - Discard the response of a transfer so it can be run again
+ *
+ * The curl easy handle, if any, is detached but not cleaned up.
+ */
+void
+flickcurl_transfer_reset(flickcurl_transfer* t)
+{
+  flickcurl_transfer_deactivate(t);
+  t->curl_handle=NULL;
+  t->error_buffer[0]='\0';
+
+  /* keep the buffer for the next attempt */
+  t->content_length=0;
+  t->total_bytes=0;
+
+  if(t->xc) {
+    if(t->xc->myDoc) {
+      xmlFreeDoc(t->xc->myDoc);
+      t->xc->myDoc=NULL;
+    }
+    xmlFreeParserCtxt(t->xc); 
+    t->xc=NULL;
+  }
+
+  if(t->error_msg) {
+    free(t->error_msg);
+    t->error_msg=NULL;
+  }
+  t->failed=0;
+  t->error_code=0;
+  t->status_code=0;
+  t->retry_after= -1;
+
+  t->sax_depth=0;
+  t->rsp_failed=0;
+  if(t->sax && t->sax->reset)
+    t->sax->reset(t->sax_data);
+}
+
+
+/*
+ * flickcurl_transfer_clear:
+ * @t: transfer
+ *
+ * INTERNAL - Free all resources held by a transfer
+ *
+ * The curl easy handle, if any, is detached but not cleaned up.
+ */
+void
+flickcurl_transfer_clear(flickcurl_transfer* t)
+{
+  flickcurl_transfer_deactivate(t);
+
+  if(t->curl_handle) {
+    /* headers and form are about to be freed */
+    curl_easy_setopt(t->curl_handle, CURLOPT_HTTPHEADER, NULL);
+    curl_easy_setopt(t->curl_handle, CURLOPT_HTTPPOST, NULL);
+    if(t->upload_stream.type != FLICKCURL_UPLOAD_STREAM_NONE)
+      curl_easy_setopt(t->curl_handle, CURLOPT_READFUNCTION, NULL);
+    curl_easy_setopt(t->curl_handle, CURLOPT_ERRORBUFFER, NULL);
+    curl_easy_setopt(t->curl_handle, CURLOPT_NOPROGRESS, 1L);
+    t->curl_handle=NULL;
+  }
+  
+  if(t->slist) {
+    curl_slist_free_all(t->slist);
+    t->slist=NULL;
+  }
+  
+  if(t->post) {
+    curl_formfree(t->post);
+    t->post=NULL;
+  }
+
+  if(t->content) {
+    flickcurl* fc=t->fc;
+
+    /* give the buffer back to the session for the next transfer */
+    if(!fc->content_buffer && t->content_size <= FLICKCURL_CONTENT_SPARE_MAX) {
+      fc->content_buffer=t->content;
+      fc->content_buffer_size=t->content_size;
+    } else
+      free(t->content);
+    t->content=NULL;
+    t->content_length=0;
+    t->content_size=0;
+  }
+
+  if(t->xc) {
+    if(t->xc->myDoc) {
+      xmlFreeDoc(t->xc->myDoc);
+      t->xc->myDoc=NULL;
+    }
+    xmlFreeParserCtxt(t->xc); 
+    t->xc=NULL;
+  }
+  
+  if(t->uri) {
+    free(t->uri);
+    t->uri=NULL;
+  }
+  if(t->method) {
+    free(t->method);
+    t->method=NULL;
+  }
+  if(t->data) {
+    free(t->data);
+    t->data=NULL;
+  }
+  if(t->error_msg) {
+    free(t->error_msg);
+    t->error_msg=NULL;
+  }
+  if(t->cache_key) {
+    free(t->cache_key);
+    t->cache_key=NULL;
+  }
+}
+
+
+static int
+flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
+                        xmlDocPtr* docptr_p)
+{
+  flickcurl_transfer transfer;
+  char* content;
   struct timeval now;
 #if defined(OFFLINE) || defined(CAPTURE)
   char filename[200];
@@ -1196,14 +2419,68 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
     return 1;
   }
 
-  if(content_p)
-    fc->save_content=1;
-  else
-    fc->xml_parse_content=1;
+  if(fc->xc) {
+    if(fc->xc->myDoc) {
+      xmlFreeDoc(fc->xc->myDoc);
+      fc->xc->myDoc=NULL;
+    }
+    xmlFreeParserCtxt(fc->xc); 
+    fc->xc=NULL;
+  }
+
+  if(fc->cached_doc) {
+    xmlFreeDoc(fc->cached_doc);
+    fc->cached_doc=NULL;
+  }
+
+  if(flickcurl_transfer_init(fc, &transfer, (content_p != NULL))) {
+    fc->failed=1;
+    rc=1;
+    goto tidy;
+  }
   
+  if(transfer.cache_key && transfer.sax) {
+    char* cached;
+    size_t cached_length;
+
+    if(!flickcurl_cache_get(transfer.cache, transfer.cache_key, NULL,
+                            &cached, &cached_length)) {
+      /* stream the cached response to the callbacks */
+      transfer.save_content=0;
+      flickcurl_write_callback(cached, 1, cached_length, &transfer);
+      free(cached);
+      rc=flickcurl_transfer_finish(&transfer, NULL);
+      flickcurl_transfer_report(&transfer);
+      flickcurl_transfer_clear(&transfer);
+      goto tidy;
+    }
+  } else if(transfer.cache_key &&
+     !flickcurl_cache_get(transfer.cache, transfer.cache_key,
+                          (docptr_p ? &fc->cached_doc : NULL),
+                          content_p, size_p)) {
+    /* answered from the cache without a request */
+    if(docptr_p)
+      *docptr_p=fc->cached_doc;
+    flickcurl_transfer_report(&transfer);
+    flickcurl_transfer_clear(&transfer);
+    goto tidy;
+  }
+
+  retry:
   gettimeofday(&now, NULL);
 #ifndef OFFLINE
-  if(fc->last_request_time.tv_sec) {
+  if(fc->rate_limiter) {
+    long wait;
+
+    /* wait only while the bucket is empty */
+    while((wait=flickcurl_rate_limiter_take(fc->rate_limiter)) > 0) {
+      struct timespec nwait;
+      nwait.tv_sec= wait / 1000000;
+      nwait.tv_nsec= 1000 * (wait % 1000000);
+      nanosleep(&nwait, NULL);
+    }
+    gettimeofday(&now, NULL);
+  } else if(fc->last_request_time.tv_sec) {
     /* If there was a previous request, check it's not too soon to
      * do another
      */
@@ -1274,246 +2551,65 @@ flickcurl_invoke_common(flickcurl *fc, char** content_p, size_t* size_p,
   }
 #endif
 
-  if(fc->xc) {
-    if(fc->xc->myDoc) {
-      xmlFreeDoc(fc->xc->myDoc);
-      fc->xc->myDoc=NULL;
-    }
-    xmlFreeParserCtxt(fc->xc); 
-    fc->xc=NULL;
-  }
-
-  if(fc->proxy)
-    curl_easy_setopt(fc->curl_handle, CURLOPT_PROXY, fc->proxy);
-
-  if(fc->user_agent)
-    curl_easy_setopt(fc->curl_handle, CURLOPT_USERAGENT, fc->user_agent);
-
-  /* Insert HTTP Accept: header */
-  if(fc->http_accept)
-    slist=curl_slist_append(slist, (const char*)fc->http_accept);
-
-  /* specify URL to call */
-  curl_easy_setopt(fc->curl_handle, CURLOPT_URL, fc->uri);
-
-  fc->total_bytes=0;
-
-  /* default: read with no data: GET */
-  curl_easy_setopt(fc->curl_handle, CURLOPT_NOBODY, 1);
-  curl_easy_setopt(fc->curl_handle, CURLOPT_HTTPGET, 1);
-
-  if(fc->data) {
-    /* write with some data: POST */
-    /* CURLOPT_NOBODY=0 sets http request to HEAD - do it first to override */
-    curl_easy_setopt(fc->curl_handle, CURLOPT_NOBODY, 0);
-    /* this function only resets no-body flag for curl >= 7.14.1 */
-    curl_easy_setopt(fc->curl_handle, CURLOPT_POST, 1);
-    curl_easy_setopt(fc->curl_handle, CURLOPT_POSTFIELDS, fc->data);
-    curl_easy_setopt(fc->curl_handle, CURLOPT_POSTFIELDSIZE, fc->data_length);
-    /* Replace default POST content type 'application/x-www-form-urlencoded' */
-    slist=curl_slist_append(slist, (const char*)"Content-Type: application/xml");
-    /* curl_easy_setopt(fc->curl_handle, CURLOPT_CUSTOMREQUEST, fc->verb); */
-  } else if(fc->is_write) {
-    /* write with no data: POST */
-    /* CURLOPT_NOBODY=0 sets http request to HEAD - do it first to override */
-    curl_easy_setopt(fc->curl_handle, CURLOPT_NOBODY, 0);
-    /* this function only resets no-body flag for curl >= 7.14.1 */
-    curl_easy_setopt(fc->curl_handle, CURLOPT_POST, 1);
-  }
-
+  flickcurl_transfer_setup(&transfer, fc->curl_handle);
 
-  /* set slist always - either a list of headers or none (NULL) */
-  curl_easy_setopt(fc->curl_handle, CURLOPT_HTTPHEADER, slist);
-
-  /* send all headers to this function */
-  curl_easy_setopt(fc->curl_handle, CURLOPT_HEADERFUNCTION, 
-                   flickcurl_curl_header_callback);
-  /* ... using this data pointer */
-  curl_easy_setopt(fc->curl_handle, CURLOPT_WRITEHEADER, fc);
-
-
-  if(fc->upload_field) {
-    struct curl_httppost* post = NULL;
-    struct curl_httppost* last = NULL;
-    int i;
-    
-    /* Main parameters */
-    for(i=0; fc->param_fields[i]; i++) {
-      curl_formadd(&post, &last, CURLFORM_PTRNAME, fc->param_fields[i],
-                   CURLFORM_PTRCONTENTS, fc->param_values[i],
-                   CURLFORM_END);
-    }
-    
-    /* Upload parameter */
-    curl_formadd(&post, &last, CURLFORM_PTRNAME, fc->upload_field,
-                 CURLFORM_FILE, fc->upload_value, CURLFORM_END);
+  flickcurl_transfer_complete(&transfer, curl_easy_perform(fc->curl_handle));
 
-    /* Set the form info */
-    curl_easy_setopt(fc->curl_handle, CURLOPT_HTTPPOST, post);
-  }
-  
+  rc=flickcurl_transfer_finish(&transfer, docptr_p);
 
-#ifdef FLICKCURL_DEBUG
-  fprintf(stderr, "Resolving URI '%s' with method %s\n", 
-          fc->uri, ((fc->is_write || fc->upload_field) ? "POST" : "GET"));
-#endif
-  
-  if(curl_easy_perform(fc->curl_handle)) {
-    /* failed */
-    fc->failed=1;
-    flickcurl_error(fc, fc->error_buffer);
-  } else {
-    long lstatus;
+  if(rc) {
+    long delay=flickcurl_transfer_get_retry_delay(&transfer);
+    if(delay >= 0) {
+      struct timespec nwait;
 
-#ifndef CURLINFO_RESPONSE_CODE
-#define CURLINFO_RESPONSE_CODE CURLINFO_HTTP_CODE
+#ifdef CAPTURE
+      if(fc->fh) {
+        fclose(fc->fh);
+        fc->fh=NULL;
+      }
 #endif
+      flickcurl_transfer_reset(&transfer);
 
-    /* Requires pointer to a long */
-    if(CURLE_OK == 
-       curl_easy_getinfo(fc->curl_handle, CURLINFO_RESPONSE_CODE, &lstatus) ) {
-      fc->status_code=lstatus;
-      if(fc->status_code != 200) {
-        if(fc->method)
-          flickcurl_error(fc, "Method %s failed with error %d - %s (HTTP %d)", 
-                          fc->method, fc->error_code, fc->error_msg,
-                          fc->status_code);
-        else
-          flickcurl_error(fc, "Call failed with error %d - %s (HTTP %d)", 
-                          fc->error_code, fc->error_msg,
-                          fc->status_code);
-        fc->failed=1;
-      }
+      nwait.tv_sec= delay / 1000;
+      nwait.tv_nsec= 1000000 * (delay % 1000);
+      nanosleep(&nwait, NULL);
+      goto retry;
     }
-
   }
 
-  if(slist)
-    curl_slist_free_all(slist);
-
-  if(fc->failed)
-    goto tidy;
-  
-  if(fc->save_content) {
-    char* c;
-    flickcurl_chunk** chunks;
-
-    c=(char*)malloc(fc->total_bytes+1); /* +1 for NUL */
-    chunks=(flickcurl_chunk**)malloc(sizeof(flickcurl_chunk*) * fc->chunks_count);
-    if(c && chunks) {
-      flickcurl_chunk* chunk=fc->chunks;
-      int i;
-      char *p;
-
-      /* create the ordered list of chunks */
-      for(i=fc->chunks_count-1; i >= 0; i--) {
-        chunks[i]=chunk;
-        chunk=chunk->prev;
-      }
-
-      p=c;
-      for(i=0; i < fc->chunks_count; i++) {
-        memcpy(p, chunks[i]->content, chunks[i]->size);
-        p += chunks[i]->size;
-
-        /* free saved chunk once it has been copied */
-        free(chunks[i]->content);
-        free(chunks[i]);
-      }
-      free(chunks);
-
-      /* saved chunks list is now freed */
-      fc->chunks=NULL; 
-      fc->chunks_count=0;
-
-      *p='\0';
-      
-      if(content_p)
-        *content_p=c;
-      else
-        free(c);
-      if(size_p)
-        *size_p=fc->total_bytes;
-      
-    } else {
-      if(c)
-        free(c);
-      if(chunks)
-        free(chunks);
-      flickcurl_error(fc, "Out of memory");
+  if(!rc && transfer.content && transfer.cache_key && !transfer.rsp_failed)
+    flickcurl_cache_put(transfer.cache, transfer.cache_key, transfer.cache_ttl,
+                        transfer.content, transfer.content_length);
+
+  if(!rc && content_p && transfer.content) {
+    /* hand the buffer over rather than copying it */
+    content=transfer.content;
+    if(transfer.content_size > 2 * transfer.content_length + 4096) {
+      char* shrunk=(char*)realloc(content, transfer.content_length + 1);
+      if(shrunk)
+        content=shrunk;
     }
+    *content_p=content;
+    if(size_p)
+      *size_p=transfer.content_length;
+    transfer.content=NULL;
   }
 
-  if(fc->xml_parse_content) {
-    xmlNodePtr xnp;
-    xmlAttr* attr;
-    int failed=0;
-    
-    xmlParseChunk(fc->xc, NULL, 0, 1);
-
-#ifdef FLICKCURL_DEBUG
-    fprintf(stderr, "Got %d bytes content from URI '%s'\n",
-            fc->total_bytes, fc->uri);
-#endif
-
-    doc=fc->xc->myDoc;
-    if(!doc) {
-      flickcurl_error(fc, "Failed to create XML DOM for document");
-      fc->failed=1;
-      goto tidy;
-    }
-
-    xnp = xmlDocGetRootElement(doc);
-    if(!xnp) {
-      flickcurl_error(fc, "Failed to parse XML");
-      fc->failed=1;
-      goto tidy;
-    }
-
-    for(attr=xnp->properties; attr; attr=attr->next) {
-      if(!strcmp((const char*)attr->name, "stat")) {
-        const char *attr_value=(const char*)attr->children->content;
-#ifdef FLICKCURL_DEBUG
-        fprintf(stderr, "Request returned stat '%s'\n", attr_value);
-#endif
-        if(strcmp(attr_value, "ok"))
-          failed=1;
-        break;
-      }
-    }
+  flickcurl_transfer_report(&transfer);
 
-    if(failed) {
-      xmlNodePtr err=xnp->children->next;
-      for(attr=err->properties; attr; attr=attr->next) {
-        const char *attr_name=(const char*)attr->name;
-        const char *attr_value=(const char*)attr->children->content;
-        if(!strcmp(attr_name, "code"))
-          fc->error_code=atoi(attr_value);
-        else if(!strcmp(attr_name, "msg"))
-          fc->error_msg=strdup(attr_value);
-      }
-      if(fc->method)
-        flickcurl_error(fc, "Method %s failed with error %d - %s", 
-                        fc->method, fc->error_code, fc->error_msg);
-      else
-        flickcurl_error(fc, "Call failed with error %d - %s", 
-                        fc->error_code, fc->error_msg);
-      fc->failed=1;
-    } else {
-      /* pass DOM as an output parameter */
-      if(docptr_p)
-        *docptr_p=doc;
-    }
-  }
+  /* the session keeps the parser and DOM until the next call */
+  fc->xc=transfer.xc;
+  transfer.xc=NULL;
+  
+  flickcurl_transfer_clear(&transfer);
 
   tidy:
-  if(fc->failed)
-    rc=1;
-  
 #ifdef CAPTURE
   if(1) {
-    if(fc->fh)
+    if(fc->fh) {
       fclose(fc->fh);
+      fc->fh=NULL;
+    }
   }
 #endif
 
@@ -1534,6 +2630,35 @@ flickcurl_invoke(flickcurl *fc)
 }
 
 
+/*
+ * flickcurl_invoke_sax:
+ * @fc: flickcurl object
+ * @sax: callbacks
+ * @sax_data: user data for callbacks
+ *
+ * INTERNAL - Invoke the prepared request streaming the XML response to @sax
+ *
+ * No DOM is made.  The response rsp/@stat and errors are checked as
+ * for flickcurl_invoke().
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_invoke_sax(flickcurl *fc, flickcurl_sax_handler* sax,
+                     void* sax_data)
+{
+  int rc;
+
+  fc->sax=sax;
+  fc->sax_data=sax_data;
+  rc=flickcurl_invoke_common(fc, NULL, NULL, NULL);
+  fc->sax=NULL;
+  fc->sax_data=NULL;
+
+  return rc;
+}
+
+
 char*
 flickcurl_invoke_get_content(flickcurl *fc, size_t* size_p)
 {
@@ -1544,22 +2669,51 @@ flickcurl_invoke_get_content(flickcurl *fc, size_t* size_p)
 }
 
 
+/*
+ * flickcurl_unixtime_format_isotime:
+ * @unix_time: time
+ * @buffer: buffer of at least FLICKCURL_ISO_DATE_LEN + 1 bytes
+ *
+ * INTERNAL - Format a unix time as an ISO 8601 UTC date into a buffer
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_unixtime_format_isotime(time_t unix_time, char* buffer)
+{
+#define ISO_DATE_FORMAT "%Y-%m-%dT%H:%M:%SZ"
+  struct tm* structured_time;
+#ifdef HAVE_GMTIME_R
+  struct tm tm_buffer;
+
+  structured_time=gmtime_r(&unix_time, &tm_buffer);
+#else
+  structured_time=(struct tm*)gmtime(&unix_time);
+#endif
+  if(!structured_time)
+    return 1;
+
+  if(!strftime(buffer, FLICKCURL_ISO_DATE_LEN + 1, ISO_DATE_FORMAT,
+               structured_time))
+    return 1;
+  return 0;
+}
+
+
 char*
 flickcurl_unixtime_to_isotime(time_t unix_time)
 {
-  struct tm* structured_time;
-#define ISO_DATE_FORMAT "%Y-%m-%dT%H:%M:%SZ"
-#define ISO_DATE_LEN 20
-  static char date_buffer[ISO_DATE_LEN + 1];
+  char date_buffer[FLICKCURL_ISO_DATE_LEN + 1];
   size_t len;
   char *value=NULL;
   
-  structured_time=(struct tm*)gmtime(&unix_time);
-  len=ISO_DATE_LEN;
-  strftime(date_buffer, len+1, ISO_DATE_FORMAT, structured_time);
+  if(flickcurl_unixtime_format_isotime(unix_time, date_buffer))
+    date_buffer[0]='\0';
+  len=strlen(date_buffer);
   
   value=(char*)malloc(len + 1);
-  strncpy((char*)value, date_buffer, len+1);
+  if(value)
+    memcpy(value, date_buffer, len + 1);
   return value;
 }
 
@@ -1575,7 +2729,7 @@ flickcurl_unixtime_to_sqltimestamp(time_t unix_time)
   char *value=NULL;
   
   structured_time=(struct tm*)gmtime(&unix_time);
-  len=ISO_DATE_LEN;
+  len=SQL_DATETIME_LEN;
   strftime(date_buffer, len+1, SQL_DATETIME_FORMAT, structured_time);
   
   value=(char*)malloc(len + 1);
@@ -1616,7 +2770,7 @@ flickcurl_xpath_eval(flickcurl *fc, xmlXPathContextPtr xpathCtx,
   int i;
   char* value=NULL;
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -1663,7 +2817,7 @@ flickcurl_xpath_eval_to_tree_string(flickcurl* fc,
   size_t value_len = 0;
   xmlNodeSetPtr nodes;
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathNodeCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathNodeCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -1722,6 +2876,97 @@ flickcurl_set_write(flickcurl *fc, int is_write)
 }
 
 
+/**
+ * flickcurl_set_compression:
+ * @fc: flickcurl object
+ * @enabled: non-0 to request compressed responses
+ *
+ * Set whether to request compressed web service responses
+ *
+ * When enabled (the default) requests advertise every content
+ * encoding libcurl can decode, such as gzip and deflate, with an
+ * Accept-Encoding header.  Compressed responses are decoded as they
+ * arrive and passed piece by piece to the XML parser, so large
+ * responses are never held in memory in either form.
+ */
+void
+flickcurl_set_compression(flickcurl* fc, int enabled)
+{
+  fc->compression=enabled;
+}
+
+
+/**
+ * flickcurl_set_lazy_photo_fields:
+ * @fc: flickcurl object
+ * @enabled: non-0 to convert photo date fields on first access
+ *
+ * Set whether photo date fields are converted when first read
+ *
+ * When enabled, the date fields of photos built from responses keep
+ * the value as sent by Flickr and are converted to ISO dates and
+ * unix times only when read with flickcurl_photo_get_field_string(),
+ * flickcurl_photo_get_field_integer() or
+ * flickcurl_photo_get_field_type(), which saves the work for
+ * callers that never look at most dates in a large photos list.
+ * Until converted, the @fields of #flickcurl_photo hold the raw
+ * value.  Default is disabled.
+ */
+void
+flickcurl_set_lazy_photo_fields(flickcurl* fc, int enabled)
+{
+  fc->lazy_photo_fields=enabled;
+}
+
+
+/**
+ * flickcurl_set_photos_list_arena:
+ * @fc: flickcurl object
+ * @enabled: non-0 to allocate photos lists in one arena
+ *
+ * Set whether photos lists are allocated from an arena owned by the list
+ *
+ * When enabled, the photos, tags, videos and their strings in a
+ * #flickcurl_photos_list are carved from a few large blocks instead of
+ * thousands of small allocations and flickcurl_free_photos_list()
+ * releases them in a few calls.  The photos must then not be freed
+ * with flickcurl_free_photo() or kept after the list is freed.
+ * Default is disabled.  Lists that need full XPath to decode are
+ * allocated normally.
+ */
+void
+flickcurl_set_photos_list_arena(flickcurl* fc, int enabled)
+{
+  fc->photos_list_arena=enabled;
+}
+
+
+/**
+ * flickcurl_set_photos_list_intern:
+ * @fc: flickcurl object
+ * @enabled: non-0 to share copies of equal strings in photos lists
+ *
+ * Set whether equal strings in a photos list share one copy
+ *
+ * When enabled, values that repeat across the photos of a
+ * #flickcurl_photos_list such as owner NSIDs and names, server, farm,
+ * license, format, place and tag strings are stored once per list and
+ * equal values within one list have equal pointers.  Values that are
+ * usually unique such as IDs, secrets, titles and dates are copied.
+ *
+ * The shared strings belong to the list: they must not be modified or
+ * freed and are invalid after flickcurl_free_photos_list().  Interned
+ * strings are kept in the list arena, so enabling this also applies
+ * the ownership rules of flickcurl_set_photos_list_arena().  Default
+ * is disabled.
+ */
+void
+flickcurl_set_photos_list_intern(flickcurl* fc, int enabled)
+{
+  fc->photos_list_intern=enabled;
+}
+
+
 /**
  * flickcurl_set_data:
  * @fc: flickcurl object
@@ -2119,6 +3364,7 @@ flickcurl_get_feed_format_info(int feed_format,
 
 /*
  * flickcurl_append_photos_list_params:
+ * @fc: flickcurl context
  * @list_params: in parameter - photos list paramater
  * @parameters: in/out parameter - array of name/value parameters
  * @count_p: in/out parameter - updated as new parameters added
@@ -2129,14 +3375,16 @@ flickcurl_get_feed_format_info(int feed_format,
  * Return value: number of parameters added
  */
 int
-flickcurl_append_photos_list_params(flickcurl_photos_list_params* list_params,
+flickcurl_append_photos_list_params(flickcurl* fc,
+                                    flickcurl_photos_list_params* list_params,
                                     const char* parameters[][2], int* count_p,
                                     const char** format_p)
 {
-  /* NOTE: These are SHARED and pointed to by flickcurl_prepare() to
+  /* NOTE: These are in the session so that sessions in other threads
+   * do not share them, and pointed to by flickcurl_prepare() to
    * build the URL */
-  static char per_page_s[4];
-  static char page_s[4];
+  char* per_page_s=fc->list_per_page_string;
+  char* page_s=fc->list_page_string;
   int this_count=0;
   
   if(format_p)
@@ -2161,7 +3409,7 @@ flickcurl_append_photos_list_params(flickcurl_photos_list_params* list_params,
     }
   }
   if(list_params->page) {
-    if(list_params->page >= 0 && list_params->page <= 999) {
+    if(list_params->page >= 0) {
       sprintf(page_s, "%d", list_params->page);
       parameters[*count_p][0]  = "page";
       parameters[*count_p][1]= page_s;
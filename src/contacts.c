@@ -92,7 +92,7 @@ flickcurl_build_contacts(flickcurl* fc,
   xmlNodeSetPtr nodes;
   
   /* Now do contacts */
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -0,0 +1,400 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * cursor.c - Flickcurl photos list cursor over all pages of a list
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+struct flickcurl_photos_cursor_s {
+  flickcurl* fc;
+
+  flickcurl_photos_list_getter getter;
+  void* getter_data;
+
+  /* copy of the list parameters; @extras points to @extras_copy */
+  flickcurl_photos_list_params list_params;
+  char* extras_copy;
+
+  /* page being read and the index of the next photo in it */
+  flickcurl_photos_list* list;
+  int index;
+
+  /* page number of @list, or the page before the first one */
+  int page;
+  /* from the last page read or -1 if not known */
+  int pages;
+  int total;
+
+  int failed;
+  int finished;
+
+  /* session used to get the next page in the background or NULL */
+  flickcurl* prefetch_fc;
+#ifdef HAVE_PTHREAD_H
+  pthread_t prefetch_thread;
+  int prefetch_running;
+  flickcurl_photos_list_params prefetch_params;
+  flickcurl_photos_list* prefetch_list;
+#endif
+};
+
+
+/**
+ * flickcurl_new_photos_cursor:
+ * @fc: flickcurl session
+ * @getter: function to get one page of the photos list
+ * @user_data: user data for @getter
+ * @list_params: photos list parameters or NULL
+ *
+ * Create a cursor over all the pages of a photos list
+ *
+ * The cursor returns the photos from each page in turn with
+ * flickcurl_photos_cursor_next(), calling @getter to get each page
+ * starting from the page in @list_params, or page 1.  It stops after
+ * the last page given by the pages attribute of the responses, or at
+ * the first empty page if that is not known.  The @format of
+ * @list_params is ignored since photos are always wanted.
+ *
+ * @getter is usually a small wrapper around one of the list
+ * functions taking a #flickcurl_photos_list_params such as
+ * flickcurl_photos_search_params(), passing the method arguments
+ * from @user_data.  @list_params is copied.
+ *
+ * Return value: new cursor or NULL on failure
+ */
+flickcurl_photos_cursor*
+flickcurl_new_photos_cursor(flickcurl* fc,
+                            flickcurl_photos_list_getter getter,
+                            void* user_data,
+                            flickcurl_photos_list_params* list_params)
+{
+  flickcurl_photos_cursor* cursor;
+
+  if(!fc || !getter)
+    return NULL;
+
+  cursor=(flickcurl_photos_cursor*)calloc(1, sizeof(flickcurl_photos_cursor));
+  if(!cursor)
+    return NULL;
+
+  cursor->fc=fc;
+  cursor->getter=getter;
+  cursor->getter_data=user_data;
+
+  flickcurl_photos_list_params_init(&cursor->list_params);
+  if(list_params) {
+    cursor->list_params.per_page=list_params->per_page;
+    cursor->list_params.page=list_params->page;
+    if(list_params->extras) {
+      cursor->extras_copy=strdup(list_params->extras);
+      if(!cursor->extras_copy) {
+        free(cursor);
+        return NULL;
+      }
+      cursor->list_params.extras=cursor->extras_copy;
+    }
+  }
+
+  cursor->page=(cursor->list_params.page > 0) ? cursor->list_params.page - 1 : 0;
+  cursor->pages= -1;
+  cursor->total= -1;
+
+  return cursor;
+}
+
+
+#ifdef HAVE_PTHREAD_H
+static void*
+flickcurl_photos_cursor_prefetch_run(void* arg)
+{
+  flickcurl_photos_cursor* cursor=(flickcurl_photos_cursor*)arg;
+
+  cursor->prefetch_list=cursor->getter(cursor->getter_data,
+                                       cursor->prefetch_fc,
+                                       &cursor->prefetch_params);
+  return NULL;
+}
+
+
+/* wait for a page being got in the background, return it */
+static flickcurl_photos_list*
+flickcurl_photos_cursor_prefetch_join(flickcurl_photos_cursor* cursor)
+{
+  flickcurl_photos_list* list;
+
+  pthread_join(cursor->prefetch_thread, NULL);
+  cursor->prefetch_running=0;
+
+  list=cursor->prefetch_list;
+  cursor->prefetch_list=NULL;
+  return list;
+}
+#endif
+
+
+/**
+ * flickcurl_free_photos_cursor:
+ * @cursor: photos cursor
+ *
+ * Destructor for a photos cursor
+ *
+ * Waits for any page being got in the background.
+ */
+void
+flickcurl_free_photos_cursor(flickcurl_photos_cursor* cursor)
+{
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(cursor, flickcurl_photos_cursor);
+
+#ifdef HAVE_PTHREAD_H
+  if(cursor->prefetch_running) {
+    flickcurl_photos_list* list=flickcurl_photos_cursor_prefetch_join(cursor);
+    if(list)
+      flickcurl_free_photos_list(list);
+  }
+#endif
+
+  if(cursor->list)
+    flickcurl_free_photos_list(cursor->list);
+  if(cursor->extras_copy)
+    free(cursor->extras_copy);
+  free(cursor);
+}
+
+
+/**
+ * flickcurl_photos_cursor_set_prefetch:
+ * @cursor: photos cursor
+ * @prefetch_fc: flickcurl session for getting pages in the background or NULL
+ *
+ * Set a session to get the next page with while the current one is read
+ *
+ * When set, as soon as a page has been got the cursor starts getting
+ * the next page in a background thread, calling the
+ * #flickcurl_photos_list_getter with @prefetch_fc, so network time
+ * overlaps with the time the caller takes over each page.
+ *
+ * @prefetch_fc must be a different session from the one the cursor
+ * was created with, set up with the same API key, secret and auth
+ * token, and must not be used by anything else while the cursor
+ * exists.  The getter and its user data must be safe to use from
+ * another thread.  Set this before the first call to
+ * flickcurl_photos_cursor_next().
+ *
+ * Return value: non-0 on failure such as no thread support
+ */
+int
+flickcurl_photos_cursor_set_prefetch(flickcurl_photos_cursor* cursor,
+                                     flickcurl* prefetch_fc)
+{
+#ifdef HAVE_PTHREAD_H
+  if(prefetch_fc == cursor->fc || cursor->prefetch_running)
+    return 1;
+
+  cursor->prefetch_fc=prefetch_fc;
+  return 0;
+#else
+  return (prefetch_fc != NULL);
+#endif
+}
+
+
+/* start getting the page after the current one in the background */
+static void
+flickcurl_photos_cursor_prefetch(flickcurl_photos_cursor* cursor)
+{
+#ifdef HAVE_PTHREAD_H
+  if(!cursor->prefetch_fc || cursor->prefetch_running)
+    return;
+
+  if(cursor->pages >= 0 && cursor->page >= cursor->pages)
+    return;
+
+  memcpy(&cursor->prefetch_params, &cursor->list_params,
+         sizeof(flickcurl_photos_list_params));
+  cursor->prefetch_params.page=cursor->page + 1;
+  cursor->prefetch_list=NULL;
+
+  if(!pthread_create(&cursor->prefetch_thread, NULL,
+                     flickcurl_photos_cursor_prefetch_run, cursor))
+    cursor->prefetch_running=1;
+#endif
+}
+
+
+/* replace the current page with the next one */
+static void
+flickcurl_photos_cursor_next_page(flickcurl_photos_cursor* cursor)
+{
+  flickcurl_photos_list* list=NULL;
+  int page=cursor->page + 1;
+
+  if(cursor->list) {
+    flickcurl_free_photos_list(cursor->list);
+    cursor->list=NULL;
+  }
+  cursor->index=0;
+
+  if(cursor->pages >= 0 && page > cursor->pages) {
+    cursor->finished=1;
+    return;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  if(cursor->prefetch_running) {
+    list=flickcurl_photos_cursor_prefetch_join(cursor);
+    if(!list) {
+      cursor->failed=1;
+      return;
+    }
+  }
+#endif
+
+  if(!list) {
+    cursor->list_params.page=page;
+    list=cursor->getter(cursor->getter_data, cursor->fc, &cursor->list_params);
+    if(!list) {
+      cursor->failed=1;
+      return;
+    }
+  }
+
+  cursor->list=list;
+  cursor->page=page;
+  if(list->pages >= 0)
+    cursor->pages=list->pages;
+  if(list->total >= 0)
+    cursor->total=list->total;
+
+  if(!list->photos || !list->photos_count) {
+    cursor->finished=1;
+    return;
+  }
+
+  flickcurl_photos_cursor_prefetch(cursor);
+}
+
+
+/**
+ * flickcurl_photos_cursor_next:
+ * @cursor: photos cursor
+ *
+ * Get the next photo from a photos cursor
+ *
+ * The photo is owned by the cursor and may be freed by the next call
+ * to this function or flickcurl_free_photos_cursor().  A NULL result
+ * is either the end of the list or a failure to get a page; use
+ * flickcurl_photos_cursor_is_failed() to tell them apart.
+ *
+ * Return value: shared photo or NULL at the end of the list or failure
+ */
+flickcurl_photo*
+flickcurl_photos_cursor_next(flickcurl_photos_cursor* cursor)
+{
+  while(1) {
+    if(cursor->list && cursor->list->photos &&
+       cursor->index < cursor->list->photos_count)
+      return cursor->list->photos[cursor->index++];
+
+    if(cursor->finished || cursor->failed)
+      return NULL;
+
+    flickcurl_photos_cursor_next_page(cursor);
+  }
+}
+
+
+/**
+ * flickcurl_photos_cursor_is_failed:
+ * @cursor: photos cursor
+ *
+ * Check if a photos cursor stopped because getting a page failed
+ *
+ * Return value: non-0 if getting a page failed
+ */
+int
+flickcurl_photos_cursor_is_failed(flickcurl_photos_cursor* cursor)
+{
+  return cursor->failed;
+}
+
+
+/**
+ * flickcurl_photos_cursor_get_page:
+ * @cursor: photos cursor
+ *
+ * Get the page number of the last page got by a photos cursor
+ *
+ * Return value: page number or the one before the first page before any
+ */
+int
+flickcurl_photos_cursor_get_page(flickcurl_photos_cursor* cursor)
+{
+  return cursor->page;
+}
+
+
+/**
+ * flickcurl_photos_cursor_get_pages:
+ * @cursor: photos cursor
+ *
+ * Get the number of pages in the list of a photos cursor
+ *
+ * Return value: number of pages from the last page got or -1 if not known
+ */
+int
+flickcurl_photos_cursor_get_pages(flickcurl_photos_cursor* cursor)
+{
+  return cursor->pages;
+}
+
+
+/**
+ * flickcurl_photos_cursor_get_total:
+ * @cursor: photos cursor
+ *
+ * Get the total number of photos in the list of a photos cursor
+ *
+ * Return value: number of photos from the last page got or -1 if not known
+ */
+int
+flickcurl_photos_cursor_get_total(flickcurl_photos_cursor* cursor)
+{
+  return cursor->total;
+}
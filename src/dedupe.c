@@ -0,0 +1,884 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * dedupe.c - Flickcurl upload deduplication index
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+/* bytes read at a time when hashing a file */
+#define FLICKCURL_DEDUPE_READ_SIZE 65536
+
+/* machine tag namespace and predicate added to uploads */
+#define FLICKCURL_DEDUPE_MACHINE_TAG "flickcurl:md5="
+
+
+#ifdef HAVE_SYS_MMAN_H
+/*
+ * Index file layout
+ *
+ * A 16 byte header of magic, slot count and slots used followed by an
+ * open addressing hash table of fixed size slots, probed linearly from
+ * the first 4 bytes of the MD5.  A slot is empty when its photo ID is
+ * empty and removed when it starts with '-', which keeps probing going
+ * past it.  The whole file is mapped shared and updated in place under
+ * a lock; when it is more than 3/4 full a table of twice the size is
+ * written to a new file that replaces it.
+ */
+#define FLICKCURL_DEDUPE_MAGIC "FLCKDUP1"
+#define FLICKCURL_DEDUPE_HEADER_SIZE 16
+#define FLICKCURL_DEDUPE_MIN_SLOTS 1024
+
+/* Flickr photo IDs are decimal numbers, currently 11 digits */
+#define FLICKCURL_DEDUPE_PHOTO_ID_SIZE 16
+
+typedef struct {
+  unsigned char md5[16];
+  char photo_id[FLICKCURL_DEDUPE_PHOTO_ID_SIZE];
+} flickcurl_dedupe_slot;
+
+typedef struct {
+  char magic[8];
+  unsigned int slots_count;
+  unsigned int slots_used;
+} flickcurl_dedupe_header;
+#endif
+
+
+#ifdef HAVE_SYS_MMAN_H
+/*
+ * An index file open in the process
+ *
+ * fcntl() locks belong to the process and closing any descriptor of a
+ * file drops all of them, so all indexes of the same file in a process
+ * share one of these and its mutex keeps their threads apart.
+ */
+typedef struct flickcurl_dedupe_file_s {
+  struct flickcurl_dedupe_file_s* next;
+  /* number of indexes using it */
+  int usage;
+
+  char* path;
+
+  int fd;
+  dev_t dev;
+  ino_t ino;
+
+  /* shared read-write mapping of the whole file */
+  unsigned char* map;
+  size_t map_size;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t lock;
+#endif
+} flickcurl_dedupe_file;
+#endif
+
+
+struct flickcurl_dedupe_index_s {
+  /* add a machine tag of the MD5 to uploads */
+  int machine_tag;
+
+#ifdef HAVE_SYS_MMAN_H
+  flickcurl_dedupe_file* file;
+#endif
+};
+
+
+#ifdef HAVE_SYS_MMAN_H
+/* index files open in the process */
+static flickcurl_dedupe_file* flickcurl_dedupe_files=NULL;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t flickcurl_dedupe_files_lock=PTHREAD_MUTEX_INITIALIZER;
+#define FLICKCURL_DEDUPE_FILES_LOCK pthread_mutex_lock(&flickcurl_dedupe_files_lock)
+#define FLICKCURL_DEDUPE_FILES_UNLOCK pthread_mutex_unlock(&flickcurl_dedupe_files_lock)
+#define FLICKCURL_DEDUPE_LOCK(file) pthread_mutex_lock(&(file)->lock)
+#define FLICKCURL_DEDUPE_UNLOCK(file) pthread_mutex_unlock(&(file)->lock)
+#else
+#define FLICKCURL_DEDUPE_FILES_LOCK
+#define FLICKCURL_DEDUPE_FILES_UNLOCK
+#define FLICKCURL_DEDUPE_LOCK(file) do { } while(0)
+#define FLICKCURL_DEDUPE_UNLOCK(file) do { } while(0)
+#endif
+#endif
+
+
+#ifdef HAVE_SYS_MMAN_H
+#define FLICKCURL_DEDUPE_HEADER(file) ((flickcurl_dedupe_header*)(file)->map)
+#define FLICKCURL_DEDUPE_SLOTS(file) \
+  ((flickcurl_dedupe_slot*)((file)->map + FLICKCURL_DEDUPE_HEADER_SIZE))
+#define FLICKCURL_DEDUPE_FILE_SIZE(slots_count) \
+  (FLICKCURL_DEDUPE_HEADER_SIZE + (size_t)(slots_count) * sizeof(flickcurl_dedupe_slot))
+
+
+static int
+flickcurl_dedupe_parse_hash(const char* hash, unsigned char md5[16])
+{
+  int i;
+
+  if(!hash || strlen(hash) != 32)
+    return 1;
+
+  for(i=0; i < 32; i++) {
+    int c=hash[i];
+    int v;
+
+    if(c >= '0' && c <= '9')
+      v=c - '0';
+    else if(c >= 'a' && c <= 'f')
+      v=c - 'a' + 10;
+    else if(c >= 'A' && c <= 'F')
+      v=c - 'A' + 10;
+    else
+      return 1;
+
+    if(i & 1)
+      md5[i >> 1]|=(unsigned char)v;
+    else
+      md5[i >> 1]=(unsigned char)(v << 4);
+  }
+
+  return 0;
+}
+
+
+static flickcurl_dedupe_slot*
+flickcurl_dedupe_find_slot(flickcurl_dedupe_slot* slots,
+                           unsigned int slots_count,
+                           const unsigned char* md5)
+{
+  unsigned int i;
+
+  memcpy(&i, md5, sizeof(i));
+  for(i &= (slots_count-1); slots[i].photo_id[0]; i=(i+1) & (slots_count-1)) {
+    if(!memcmp(slots[i].md5, md5, 16))
+      break;
+  }
+
+  /* matching slot or empty slot to insert at */
+  return &slots[i];
+}
+
+
+static void
+flickcurl_dedupe_close_file(flickcurl_dedupe_file* file)
+{
+  if(file->map)
+    munmap(file->map, file->map_size);
+  file->map=NULL;
+  file->map_size=0;
+
+  if(file->fd >= 0)
+    close(file->fd);
+  file->fd= -1;
+}
+
+
+static int
+flickcurl_dedupe_lock_file(flickcurl_dedupe_file* file, int type)
+{
+  struct flock fl;
+
+  if(file->fd < 0)
+    return 1;
+
+  memset(&fl, '\0', sizeof(fl));
+  fl.l_type=type;
+  fl.l_whence=SEEK_SET;
+
+  while(fcntl(file->fd, F_SETLKW, &fl) < 0) {
+    if(errno != EINTR)
+      return 1;
+  }
+  return 0;
+}
+
+
+static int
+flickcurl_dedupe_open_file(flickcurl_dedupe_file* file)
+{
+  flickcurl_dedupe_header header;
+  struct stat sb;
+  void* map;
+
+  file->fd=open(file->path, O_RDWR | O_CREAT, 0600);
+  if(file->fd < 0)
+    return 1;
+
+  if(flickcurl_dedupe_lock_file(file, F_WRLCK) || fstat(file->fd, &sb))
+    goto failed;
+  file->dev=sb.st_dev;
+  file->ino=sb.st_ino;
+
+  if(!sb.st_size) {
+    /* new file */
+    memset(&header, '\0', sizeof(header));
+    memcpy(header.magic, FLICKCURL_DEDUPE_MAGIC, 8);
+    header.slots_count=FLICKCURL_DEDUPE_MIN_SLOTS;
+    if(ftruncate(file->fd, (off_t)FLICKCURL_DEDUPE_FILE_SIZE(header.slots_count)) ||
+       pwrite(file->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+      goto failed;
+    sb.st_size=(off_t)FLICKCURL_DEDUPE_FILE_SIZE(header.slots_count);
+  } else if(pread(file->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+            memcmp(header.magic, FLICKCURL_DEDUPE_MAGIC, 8) ||
+            header.slots_count < FLICKCURL_DEDUPE_MIN_SLOTS ||
+            (header.slots_count & (header.slots_count-1)) ||
+            (size_t)sb.st_size != FLICKCURL_DEDUPE_FILE_SIZE(header.slots_count)) {
+    /* not an index - never overwrite it */
+    goto failed;
+  }
+
+  map=mmap(NULL, (size_t)sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+           file->fd, 0);
+  if(map == MAP_FAILED)
+    goto failed;
+  file->map=(unsigned char*)map;
+  file->map_size=(size_t)sb.st_size;
+
+  flickcurl_dedupe_lock_file(file, F_UNLCK);
+  return 0;
+
+  failed:
+  flickcurl_dedupe_close_file(file);
+  return 1;
+}
+
+
+/* Check if another process replaced the file by growing it */
+static int
+flickcurl_dedupe_is_replaced(flickcurl_dedupe_file* file)
+{
+  struct stat sb;
+
+  return !(file->fd >= 0 && !stat(file->path, &sb) &&
+           sb.st_dev == file->dev && sb.st_ino == file->ino);
+}
+
+
+/* Lock the current file for reading or writing */
+static int
+flickcurl_dedupe_lock(flickcurl_dedupe_file* file, int type)
+{
+  while(1) {
+    if(flickcurl_dedupe_is_replaced(file)) {
+      flickcurl_dedupe_close_file(file);
+      if(flickcurl_dedupe_open_file(file))
+        return 1;
+    }
+    if(flickcurl_dedupe_lock_file(file, type))
+      return 1;
+    /* the file may have been replaced while waiting for the lock */
+    if(!flickcurl_dedupe_is_replaced(file))
+      return 0;
+    flickcurl_dedupe_lock_file(file, F_UNLCK);
+  }
+}
+
+
+/* Write a table of twice the size to a new file that replaces the
+ * current one.  Call with the file write locked; returns with the new
+ * file write locked.
+ */
+static int
+flickcurl_dedupe_grow(flickcurl_dedupe_file* file)
+{
+  flickcurl_dedupe_header* header=FLICKCURL_DEDUPE_HEADER(file);
+  flickcurl_dedupe_slot* slots=FLICKCURL_DEDUPE_SLOTS(file);
+  unsigned int count=header->slots_count * 2;
+  unsigned int used=0;
+  unsigned char* buffer;
+  flickcurl_dedupe_header* new_header;
+  flickcurl_dedupe_slot* new_slots;
+  char* tmp_path;
+  size_t size=FLICKCURL_DEDUPE_FILE_SIZE(count);
+  unsigned int i;
+  int fd= -1;
+  int rc=1;
+
+  buffer=(unsigned char*)calloc(1, size);
+  tmp_path=(char*)malloc(strlen(file->path) + 8);
+  if(!buffer || !tmp_path)
+    goto tidy;
+
+  new_header=(flickcurl_dedupe_header*)buffer;
+  new_slots=(flickcurl_dedupe_slot*)(buffer + FLICKCURL_DEDUPE_HEADER_SIZE);
+
+  /* removed slots are dropped */
+  for(i=0; i < header->slots_count; i++) {
+    if(slots[i].photo_id[0] && slots[i].photo_id[0] != '-') {
+      *flickcurl_dedupe_find_slot(new_slots, count, slots[i].md5)=slots[i];
+      used++;
+    }
+  }
+  memcpy(new_header->magic, FLICKCURL_DEDUPE_MAGIC, 8);
+  new_header->slots_count=count;
+  new_header->slots_used=used;
+
+  strcpy(tmp_path, file->path);
+  strcat(tmp_path, ".XXXXXX");
+  fd=mkstemp(tmp_path);
+  if(fd < 0)
+    goto tidy;
+
+  if(write(fd, buffer, size) != (ssize_t)size || rename(tmp_path, file->path)) {
+    unlink(tmp_path);
+    goto tidy;
+  }
+
+  /* closing the old file also releases the lock on it */
+  flickcurl_dedupe_close_file(file);
+  rc=flickcurl_dedupe_open_file(file);
+  if(!rc)
+    rc=flickcurl_dedupe_lock_file(file, F_WRLCK);
+
+  tidy:
+  if(fd >= 0)
+    close(fd);
+  if(buffer)
+    free(buffer);
+  if(tmp_path)
+    free(tmp_path);
+
+  return rc;
+}
+
+
+/* Get the open file for @path, opening it if it is not open in the
+ * process yet.
+ */
+static flickcurl_dedupe_file*
+flickcurl_dedupe_get_file(const char* path)
+{
+  flickcurl_dedupe_file* file;
+  struct stat sb;
+
+  FLICKCURL_DEDUPE_FILES_LOCK;
+
+  /* compare the files the names are for now, whatever the names */
+  if(!stat(path, &sb)) {
+    for(file=flickcurl_dedupe_files; file; file=file->next) {
+      struct stat file_sb;
+
+      if(!stat(file->path, &file_sb) &&
+         file_sb.st_dev == sb.st_dev && file_sb.st_ino == sb.st_ino) {
+        file->usage++;
+        goto unlock;
+      }
+    }
+  }
+
+  file=(flickcurl_dedupe_file*)calloc(1, sizeof(flickcurl_dedupe_file));
+  if(!file)
+    goto unlock;
+
+  file->fd= -1;
+  file->path=strdup(path);
+  if(!file->path || flickcurl_dedupe_open_file(file)) {
+    if(file->path)
+      free(file->path);
+    free(file);
+    file=NULL;
+    goto unlock;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&file->lock, NULL);
+#endif
+
+  file->usage=1;
+  file->next=flickcurl_dedupe_files;
+  flickcurl_dedupe_files=file;
+
+  unlock:
+  FLICKCURL_DEDUPE_FILES_UNLOCK;
+
+  return file;
+}
+
+
+/* Stop using an open file, closing it when no index uses it */
+static void
+flickcurl_dedupe_release_file(flickcurl_dedupe_file* file)
+{
+  flickcurl_dedupe_file** filep;
+
+  FLICKCURL_DEDUPE_FILES_LOCK;
+
+  if(--file->usage) {
+    FLICKCURL_DEDUPE_FILES_UNLOCK;
+    return;
+  }
+
+  for(filep=&flickcurl_dedupe_files; *filep; filep=&(*filep)->next) {
+    if(*filep == file) {
+      *filep=file->next;
+      break;
+    }
+  }
+
+  FLICKCURL_DEDUPE_FILES_UNLOCK;
+
+  flickcurl_dedupe_close_file(file);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&file->lock);
+#endif
+
+  free(file->path);
+  free(file);
+}
+#endif
+
+
+/**
+ * flickcurl_new_dedupe_index:
+ * @path: index file name
+ *
+ * Create an upload deduplication index kept in a file
+ *
+ * The index maps the MD5 of the content of each photo uploaded to the
+ * photo ID it was given.  When attached to a session with
+ * flickcurl_set_dedupe_index(), uploads of files or buffers are
+ * skipped if the content has been uploaded before and successful
+ * uploads are added to it, so re-running an upload job only sends
+ * the new photos.  The file is created if needed and may be shared by
+ * several processes and by several indexes and threads in a process.
+ * An existing file that is not an index is never overwritten.
+ *
+ * Photos deleted from Flickr are not noticed; remove them with
+ * flickcurl_dedupe_index_remove().
+ *
+ * Not available on systems without mmap().
+ *
+ * Return value: new index or NULL on failure
+ */
+flickcurl_dedupe_index*
+flickcurl_new_dedupe_index(const char* path)
+{
+#ifdef HAVE_SYS_MMAN_H
+  flickcurl_dedupe_index* index;
+
+  if(!path)
+    return NULL;
+
+  index=(flickcurl_dedupe_index*)calloc(1, sizeof(flickcurl_dedupe_index));
+  if(!index)
+    return NULL;
+
+  index->file=flickcurl_dedupe_get_file(path);
+  if(!index->file) {
+    free(index);
+    return NULL;
+  }
+
+  return index;
+#else
+  return NULL;
+#endif
+}
+
+
+/**
+ * flickcurl_free_dedupe_index:
+ * @index: dedupe index
+ *
+ * Destructor for an upload deduplication index
+ */
+void
+flickcurl_free_dedupe_index(flickcurl_dedupe_index* index)
+{
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(index, flickcurl_dedupe_index);
+
+#ifdef HAVE_SYS_MMAN_H
+  flickcurl_dedupe_release_file(index->file);
+#endif
+
+  free(index);
+}
+
+
+/**
+ * flickcurl_dedupe_index_set_machine_tag:
+ * @index: dedupe index
+ * @enabled: non-0 to tag uploads
+ *
+ * Set if uploads are tagged with the MD5 of their content
+ *
+ * When enabled, uploads checked against @index are given the machine
+ * tag flickcurl:md5=<hex digest> as well as their own tags, so the
+ * index can be rebuilt from the photos with flickr.photos.search
+ * machine_tags queries.
+ */
+void
+flickcurl_dedupe_index_set_machine_tag(flickcurl_dedupe_index* index,
+                                       int enabled)
+{
+  index->machine_tag=enabled;
+}
+
+
+/**
+ * flickcurl_dedupe_index_get:
+ * @index: dedupe index
+ * @hash: MD5 of the content in hex
+ *
+ * Get the photo ID content was uploaded as
+ *
+ * Return value: new photo ID string or NULL if not found
+ */
+char*
+flickcurl_dedupe_index_get(flickcurl_dedupe_index* index, const char* hash)
+{
+#ifdef HAVE_SYS_MMAN_H
+  flickcurl_dedupe_file* file;
+  unsigned char md5[16];
+  flickcurl_dedupe_slot* slot;
+  char* photo_id=NULL;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(index, flickcurl_dedupe_index, NULL);
+
+  if(flickcurl_dedupe_parse_hash(hash, md5))
+    return NULL;
+
+  file=index->file;
+  FLICKCURL_DEDUPE_LOCK(file);
+  if(flickcurl_dedupe_lock(file, F_RDLCK))
+    goto unlock;
+
+  slot=flickcurl_dedupe_find_slot(FLICKCURL_DEDUPE_SLOTS(file),
+                                  FLICKCURL_DEDUPE_HEADER(file)->slots_count,
+                                  md5);
+  if(slot->photo_id[0] && slot->photo_id[0] != '-') {
+    char id[FLICKCURL_DEDUPE_PHOTO_ID_SIZE];
+
+    memcpy(id, slot->photo_id, sizeof(id));
+    id[sizeof(id)-1]='\0';
+    photo_id=strdup(id);
+  }
+
+  flickcurl_dedupe_lock_file(file, F_UNLCK);
+
+  unlock:
+  FLICKCURL_DEDUPE_UNLOCK(file);
+
+  return photo_id;
+#else
+  return NULL;
+#endif
+}
+
+
+#ifdef HAVE_SYS_MMAN_H
+static int
+flickcurl_dedupe_index_set(flickcurl_dedupe_index* index, const char* hash,
+                           const char* photo_id)
+{
+  flickcurl_dedupe_file* file=index->file;
+  unsigned char md5[16];
+  flickcurl_dedupe_header* header;
+  flickcurl_dedupe_slot* slot;
+  int rc=1;
+
+  if(flickcurl_dedupe_parse_hash(hash, md5))
+    return 1;
+
+  FLICKCURL_DEDUPE_LOCK(file);
+  if(flickcurl_dedupe_lock(file, F_WRLCK))
+    goto unlock;
+
+  header=FLICKCURL_DEDUPE_HEADER(file);
+  slot=flickcurl_dedupe_find_slot(FLICKCURL_DEDUPE_SLOTS(file),
+                                  header->slots_count, md5);
+  if(!slot->photo_id[0]) {
+    /* nothing to remove */
+    if(!photo_id) {
+      rc=0;
+      goto unlock_file;
+    }
+
+    if((header->slots_used + 1) * 4 > header->slots_count * 3) {
+      if(flickcurl_dedupe_grow(file))
+        goto unlock_file;
+      header=FLICKCURL_DEDUPE_HEADER(file);
+      slot=flickcurl_dedupe_find_slot(FLICKCURL_DEDUPE_SLOTS(file),
+                                      header->slots_count, md5);
+    }
+    memcpy(slot->md5, md5, 16);
+    header->slots_used++;
+  }
+
+  /* the first byte of the ID is written last as it marks the slot used */
+  memset(slot->photo_id + 1, '\0', FLICKCURL_DEDUPE_PHOTO_ID_SIZE - 1);
+  if(photo_id) {
+    strcpy(slot->photo_id + 1, photo_id + 1);
+    slot->photo_id[0]=photo_id[0];
+  } else
+    slot->photo_id[0]='-';
+  rc=0;
+
+  unlock_file:
+  flickcurl_dedupe_lock_file(file, F_UNLCK);
+
+  unlock:
+  FLICKCURL_DEDUPE_UNLOCK(file);
+
+  return rc;
+}
+#endif
+
+
+/**
+ * flickcurl_dedupe_index_add:
+ * @index: dedupe index
+ * @hash: MD5 of the content in hex
+ * @photo_id: photo ID the content was uploaded as
+ *
+ * Record that content was uploaded as a photo
+ *
+ * Replaces any photo ID already recorded for @hash.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_dedupe_index_add(flickcurl_dedupe_index* index, const char* hash,
+                           const char* photo_id)
+{
+#ifdef HAVE_SYS_MMAN_H
+  const char* p;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(index, flickcurl_dedupe_index, 1);
+
+  if(!photo_id || !*photo_id ||
+     strlen(photo_id) >= FLICKCURL_DEDUPE_PHOTO_ID_SIZE)
+    return 1;
+  for(p=photo_id; *p; p++) {
+    if(*p < '0' || *p > '9')
+      return 1;
+  }
+
+  return flickcurl_dedupe_index_set(index, hash, photo_id);
+#else
+  return 1;
+#endif
+}
+
+
+/**
+ * flickcurl_dedupe_index_remove:
+ * @index: dedupe index
+ * @hash: MD5 of the content in hex
+ *
+ * Forget that content was uploaded, such as when the photo was deleted
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_dedupe_index_remove(flickcurl_dedupe_index* index, const char* hash)
+{
+#ifdef HAVE_SYS_MMAN_H
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(index, flickcurl_dedupe_index, 1);
+
+  return flickcurl_dedupe_index_set(index, hash, NULL);
+#else
+  return 1;
+#endif
+}
+
+
+/**
+ * flickcurl_dedupe_hash_file:
+ * @filename: file name
+ * @hash: buffer of 33 bytes to store the MD5 of the content in hex
+ *
+ * Get the MD5 of the content of a file as used by a dedupe index
+ *
+ * The file is read a block at a time.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_dedupe_hash_file(const char* filename, char hash[33])
+{
+  struct MD5Context md5;
+  FILE* fh;
+  char* buffer;
+  size_t len;
+  int rc=1;
+
+  if(!filename)
+    return 1;
+
+  buffer=(char*)malloc(FLICKCURL_DEDUPE_READ_SIZE);
+  if(!buffer)
+    return 1;
+
+  fh=fopen(filename, "rb");
+  if(!fh) {
+    free(buffer);
+    return 1;
+  }
+
+  MD5_init(&md5);
+  while((len=fread(buffer, 1, FLICKCURL_DEDUPE_READ_SIZE, fh)) > 0)
+    MD5_update(&md5, buffer, len);
+
+  if(!ferror(fh)) {
+    MD5_final_hex(&md5, hash);
+    rc=0;
+  }
+
+  fclose(fh);
+  free(buffer);
+
+  return rc;
+}
+
+
+/*
+ * flickcurl_dedupe_hash_upload:
+ * @params: upload parameters
+ * @stream: upload body source or NULL for @params photo_file
+ * @hash: buffer of 33 bytes to store the MD5 in hex
+ *
+ * INTERNAL - Get the MD5 of the content of an upload
+ *
+ * Only files and buffers can be hashed; file descriptors and read
+ * callbacks cannot be read twice.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_dedupe_hash_upload(flickcurl_upload_params* params,
+                             flickcurl_upload_stream* stream, char hash[33])
+{
+  if(!stream)
+    return flickcurl_dedupe_hash_file(params->photo_file, hash);
+
+  if(stream->type == FLICKCURL_UPLOAD_STREAM_BUFFER) {
+    struct MD5Context md5;
+
+    MD5_init(&md5);
+    MD5_update(&md5, stream->buffer, (size_t)stream->length);
+    MD5_final_hex(&md5, hash);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+/*
+ * flickcurl_dedupe_find_upload:
+ * @index: dedupe index
+ * @hash: MD5 of the content in hex
+ *
+ * INTERNAL - Get the status of content uploaded before
+ *
+ * Return value: new status with only the photo ID or NULL if not found
+ */
+flickcurl_upload_status*
+flickcurl_dedupe_find_upload(flickcurl_dedupe_index* index, const char* hash)
+{
+  flickcurl_upload_status* status;
+  char* photo_id;
+
+  photo_id=flickcurl_dedupe_index_get(index, hash);
+  if(!photo_id)
+    return NULL;
+
+  status=(flickcurl_upload_status*)calloc(1, sizeof(flickcurl_upload_status));
+  if(!status) {
+    free(photo_id);
+    return NULL;
+  }
+  status->photoid=photo_id;
+
+  return status;
+}
+
+
+/*
+ * flickcurl_dedupe_make_tags:
+ * @index: dedupe index
+ * @tags: upload tags or NULL
+ * @hash: MD5 of the content in hex
+ *
+ * INTERNAL - Add the MD5 machine tag to upload tags if enabled
+ *
+ * Return value: new tags string or NULL if not tagging or on failure
+ */
+char*
+flickcurl_dedupe_make_tags(flickcurl_dedupe_index* index, const char* tags,
+                           const char* hash)
+{
+  size_t tags_len=tags ? strlen(tags) : 0;
+  char* new_tags;
+  char* p;
+
+  if(!index->machine_tag)
+    return NULL;
+
+  new_tags=(char*)malloc(tags_len + 1 + sizeof(FLICKCURL_DEDUPE_MACHINE_TAG) + 32);
+  if(!new_tags)
+    return NULL;
+
+  p=new_tags;
+  if(tags_len) {
+    memcpy(p, tags, tags_len);
+    p+= tags_len;
+    *p++=' ';
+  }
+  strcpy(p, FLICKCURL_DEDUPE_MACHINE_TAG);
+  strcat(p, hash);
+
+  return new_tags;
+}
@@ -91,7 +91,7 @@ flickcurl_build_exifs(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlNodeSetPtr nodes;
   
   /* Now do exifs */
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -0,0 +1,529 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * fieldmap.c - Flickcurl single pass field table matching
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+/*
+ * A field map indexes the entries of a builder field table whose
+ * XPath selects the node text ".", an attribute of the node "./@a",
+ * the text of a child element "./e" or an attribute of a child
+ * element "./e/@a".  The key of an entry is its XPath without the
+ * leading "./" and keys are placed in a perfect hash table so one
+ * walk over the attributes and children of a node finds the value of
+ * every such entry.  Other entries are still evaluated as XPath.
+ */
+struct flickcurl_field_map_s {
+  struct flickcurl_field_map_s* next;
+  const void* table;
+
+  int count;
+  /* per entry: key or NULL if not matched by the walk */
+  char** keys;
+  /* per entry: next entry with the same key or -1 */
+  int* next_entry;
+
+  /* perfect hash: slot to first entry or -1 */
+  unsigned int seed;
+  unsigned int mask;
+  int* slots;
+};
+
+
+/* table entries with a matched key but no value */
+static const xmlChar flickcurl_field_map_no_value[1]={ '\0' };
+
+static flickcurl_field_map* flickcurl_field_maps=NULL;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t flickcurl_field_maps_lock=PTHREAD_MUTEX_INITIALIZER;
+#define FLICKCURL_FIELD_MAPS_LOCK pthread_mutex_lock(&flickcurl_field_maps_lock)
+#define FLICKCURL_FIELD_MAPS_UNLOCK pthread_mutex_unlock(&flickcurl_field_maps_lock)
+#else
+#define FLICKCURL_FIELD_MAPS_LOCK
+#define FLICKCURL_FIELD_MAPS_UNLOCK
+#endif
+
+
+/* FNV-1a over the key pieces @element, "/@" and @attribute */
+static unsigned int
+flickcurl_field_map_hash(unsigned int seed, const xmlChar* element,
+                         const xmlChar* attribute)
+{
+  unsigned int hash=2166136261U ^ seed;
+
+  if(element) {
+    for(; *element; element++) {
+      hash ^= (unsigned int)*element;
+      hash *= 16777619U;
+    }
+  }
+  if(attribute) {
+    if(element) {
+      hash ^= (unsigned int)'/';
+      hash *= 16777619U;
+    }
+    hash ^= (unsigned int)'@';
+    hash *= 16777619U;
+    for(; *attribute; attribute++) {
+      hash ^= (unsigned int)*attribute;
+      hash *= 16777619U;
+    }
+  }
+  return hash;
+}
+
+
+static int
+flickcurl_field_map_key_equals(const char* key, const xmlChar* element,
+                               const xmlChar* attribute)
+{
+  size_t len;
+
+  if(element) {
+    len=strlen((const char*)element);
+    if(strncmp(key, (const char*)element, len))
+      return 0;
+    key+=len;
+    if(attribute) {
+      if(*key++ != '/')
+        return 0;
+    }
+  }
+  if(attribute) {
+    if(*key++ != '@')
+      return 0;
+    return !strcmp(key, (const char*)attribute);
+  }
+  return !*key;
+}
+
+
+/* split a key into element and attribute; modifies @key */
+static void
+flickcurl_field_map_split_key(char* key, const xmlChar** element_p,
+                              const xmlChar** attribute_p)
+{
+  char* at=strchr(key, '@');
+
+  *element_p=NULL;
+  *attribute_p=NULL;
+  if(at) {
+    *attribute_p=(const xmlChar*)(at + 1);
+    if(at != key) {
+      at[-1]='\0';
+      *element_p=(const xmlChar*)key;
+    }
+  } else if(*key)
+    *element_p=(const xmlChar*)key;
+}
+
+
+/* return the key for a simple XPath or NULL */
+static char*
+flickcurl_field_map_xpath_key(const char* xpath)
+{
+  const char* p;
+  int slashes=0;
+  int ats=0;
+  char* key;
+  size_t len;
+
+  if(!strcmp(xpath, "."))
+    return strdup("");
+
+  if(strncmp(xpath, "./", 2) || !xpath[2])
+    return NULL;
+  xpath+=2;
+
+  for(p=xpath; *p; p++) {
+    if(*p == '/') {
+      /* only "e/@a" */
+      if(slashes++ || p == xpath || p[1] != '@')
+        return NULL;
+    } else if(*p == '@') {
+      if(ats++ || (p != xpath && p[-1] != '/') || !p[1])
+        return NULL;
+    } else if(!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+                (*p >= '0' && *p <= '9') || *p == '_' || *p == '-'))
+      return NULL;
+  }
+
+  len=strlen(xpath);
+  key=(char*)malloc(len + 1);
+  if(key)
+    memcpy(key, xpath, len + 1);
+  return key;
+}
+
+
+static void
+flickcurl_free_field_map(flickcurl_field_map* map)
+{
+  int i;
+
+  if(map->keys) {
+    for(i=0; i < map->count; i++)
+      if(map->keys[i])
+        free(map->keys[i]);
+    free(map->keys);
+  }
+  if(map->next_entry)
+    free(map->next_entry);
+  if(map->slots)
+    free(map->slots);
+  free(map);
+}
+
+
+/* try to place the keys with @seed and @mask; returns non-0 on collision */
+static int
+flickcurl_field_map_place(flickcurl_field_map* map)
+{
+  unsigned int size=map->mask + 1;
+  unsigned int i;
+  int expri;
+
+  for(i=0; i < size; i++)
+    map->slots[i]= -1;
+
+  for(expri=0; expri < map->count; expri++) {
+    char* key=map->keys[expri];
+    char* copy;
+    const xmlChar* element;
+    const xmlChar* attribute;
+    int other;
+    unsigned int slot;
+
+    if(!key)
+      continue;
+
+    /* a later entry with the same key as an earlier one is chained */
+    for(other=0; other < expri; other++)
+      if(map->keys[other] && !strcmp(map->keys[other], key))
+        break;
+    if(other < expri)
+      continue;
+
+    copy=strdup(key);
+    if(!copy)
+      return -1;
+    flickcurl_field_map_split_key(copy, &element, &attribute);
+    slot=flickcurl_field_map_hash(map->seed, element, attribute) & map->mask;
+    free(copy);
+
+    if(map->slots[slot] >= 0)
+      return 1;
+    map->slots[slot]=expri;
+  }
+
+  return 0;
+}
+
+
+static flickcurl_field_map*
+flickcurl_new_field_map(const void* table, size_t entry_size)
+{
+  flickcurl_field_map* map;
+  int keys_count=0;
+  unsigned int size;
+  int expri;
+  int rc=1;
+
+  map=(flickcurl_field_map*)calloc(1, sizeof(flickcurl_field_map));
+  if(!map)
+    return NULL;
+  map->table=table;
+
+  /* each table starts with the XPath and ends with a NULL XPath */
+#define FIELD_MAP_XPATH(i) \
+  (*(const xmlChar* const*)((const char*)table + (i) * entry_size))
+
+  while(FIELD_MAP_XPATH(map->count))
+    map->count++;
+
+  map->keys=(char**)calloc(map->count + 1, sizeof(char*));
+  map->next_entry=(int*)calloc(map->count + 1, sizeof(int));
+  if(!map->keys || !map->next_entry)
+    goto failed;
+
+  for(expri=0; expri < map->count; expri++) {
+    int other;
+
+    map->next_entry[expri]= -1;
+    map->keys[expri]=flickcurl_field_map_xpath_key((const char*)FIELD_MAP_XPATH(expri));
+    if(!map->keys[expri])
+      continue;
+    keys_count++;
+
+    for(other=expri - 1; other >= 0; other--) {
+      if(map->keys[other] && !strcmp(map->keys[other], map->keys[expri])) {
+        map->next_entry[other]=expri;
+        break;
+      }
+    }
+  }
+#undef FIELD_MAP_XPATH
+
+  for(size=8; size < (unsigned int)keys_count * 2; size <<= 1)
+    ;
+
+  while(rc > 0 && size <= 65536) {
+    map->mask=size - 1;
+    if(map->slots)
+      free(map->slots);
+    map->slots=(int*)malloc(size * sizeof(int));
+    if(!map->slots)
+      goto failed;
+
+    for(map->seed=1; map->seed < 256; map->seed++) {
+      rc=flickcurl_field_map_place(map);
+      if(rc <= 0)
+        break;
+    }
+    size <<= 1;
+  }
+  if(rc)
+    goto failed;
+
+  return map;
+
+  failed:
+  flickcurl_free_field_map(map);
+  return NULL;
+}
+
+
+/*
+ * flickcurl_get_field_map:
+ * @table: field table whose entries start with a const xmlChar* XPath
+ * @entry_size: size of a table entry
+ *
+ * INTERNAL - Get the field map for a builder field table
+ *
+ * The map is made the first time it is asked for and shared by all
+ * sessions and threads until flickcurl_finish().
+ *
+ * Return value: field map or NULL on failure
+ */
+flickcurl_field_map*
+flickcurl_get_field_map(const void* table, size_t entry_size)
+{
+  flickcurl_field_map* map;
+
+  FLICKCURL_FIELD_MAPS_LOCK;
+  for(map=flickcurl_field_maps; map; map=map->next)
+    if(map->table == table)
+      break;
+
+  if(!map) {
+    map=flickcurl_new_field_map(table, entry_size);
+    if(map) {
+      map->next=flickcurl_field_maps;
+      flickcurl_field_maps=map;
+    }
+  }
+  FLICKCURL_FIELD_MAPS_UNLOCK;
+
+  return map;
+}
+
+
+/*
+ * flickcurl_field_maps_terminate:
+ *
+ * INTERNAL - Free all field maps
+ */
+void
+flickcurl_field_maps_terminate(void)
+{
+  FLICKCURL_FIELD_MAPS_LOCK;
+  while(flickcurl_field_maps) {
+    flickcurl_field_map* next=flickcurl_field_maps->next;
+    flickcurl_free_field_map(flickcurl_field_maps);
+    flickcurl_field_maps=next;
+  }
+  FLICKCURL_FIELD_MAPS_UNLOCK;
+}
+
+
+int
+flickcurl_field_map_get_count(flickcurl_field_map* map)
+{
+  return map->count;
+}
+
+
+/*
+ * flickcurl_field_map_lookup:
+ * @map: field map
+ * @element: child element name or NULL for the node itself
+ * @attribute: attribute name or NULL for the element text
+ *
+ * INTERNAL - Find the first table entry for an element and attribute
+ *
+ * Further entries with the same key are found with
+ * flickcurl_field_map_next().
+ *
+ * Return value: table entry index or < 0 if none
+ */
+int
+flickcurl_field_map_lookup(flickcurl_field_map* map, const xmlChar* element,
+                           const xmlChar* attribute)
+{
+  unsigned int slot;
+  int expri;
+
+  slot=flickcurl_field_map_hash(map->seed, element, attribute) & map->mask;
+  expri=map->slots[slot];
+  if(expri < 0 ||
+     !flickcurl_field_map_key_equals(map->keys[expri], element, attribute))
+    return -1;
+
+  return expri;
+}
+
+
+int
+flickcurl_field_map_next(flickcurl_field_map* map, int expri)
+{
+  return map->next_entry[expri];
+}
+
+
+static void
+flickcurl_field_map_set_values(flickcurl_field_map* map,
+                               const xmlChar** values,
+                               const xmlChar* element,
+                               const xmlChar* attribute, xmlNodePtr node)
+{
+  int expri;
+  const xmlChar* value;
+
+  expri=flickcurl_field_map_lookup(map, element, attribute);
+  if(expri < 0)
+    return;
+
+  /* same value as flickcurl_xpath_eval(): the first child's content */
+  value=(node->children && node->children->content) ?
+    node->children->content : flickcurl_field_map_no_value;
+
+  /* XPath takes the first node in document order */
+  for(; expri >= 0; expri=map->next_entry[expri])
+    if(!values[expri])
+      values[expri]=value;
+}
+
+
+/*
+ * flickcurl_field_map_scan:
+ * @map: field map
+ * @node: element node
+ * @values: array of flickcurl_field_map_get_count() values to fill
+ *
+ * INTERNAL - Find the values of all simple table entries in one pass
+ *
+ * Walks the attributes and child elements of @node once.  The values
+ * point into the document and are read with flickcurl_field_map_eval().
+ */
+void
+flickcurl_field_map_scan(flickcurl_field_map* map, xmlNodePtr node,
+                         const xmlChar** values)
+{
+  xmlAttrPtr attr;
+  xmlNodePtr child;
+
+  memset(values, '\0', sizeof(const xmlChar*) * map->count);
+
+  flickcurl_field_map_set_values(map, values, NULL, NULL, node);
+
+  for(attr=node->properties; attr; attr=attr->next)
+    if(!attr->ns)
+      flickcurl_field_map_set_values(map, values, NULL, attr->name,
+                                     (xmlNodePtr)attr);
+
+  for(child=node->children; child; child=child->next) {
+    if(child->type != XML_ELEMENT_NODE || child->ns)
+      continue;
+
+    flickcurl_field_map_set_values(map, values, child->name, NULL, child);
+
+    for(attr=child->properties; attr; attr=attr->next)
+      if(!attr->ns)
+        flickcurl_field_map_set_values(map, values, child->name, attr->name,
+                                       (xmlNodePtr)attr);
+  }
+}
+
+
+/*
+ * flickcurl_field_map_eval:
+ * @fc: flickcurl context
+ * @map: field map
+ * @values: values from flickcurl_field_map_scan()
+ * @expri: table entry index
+ * @xpathNodeCtx: XPath context for the node
+ * @xpathExpr: table entry XPath
+ *
+ * INTERNAL - Get the value of a table entry for a node
+ *
+ * A replacement for flickcurl_xpath_eval() with the entry XPath that
+ * only evaluates XPath for entries not in the map.
+ *
+ * Return value: new string value or NULL
+ */
+char*
+flickcurl_field_map_eval(flickcurl* fc, flickcurl_field_map* map,
+                         const xmlChar** values, int expri,
+                         xmlXPathContextPtr xpathNodeCtx,
+                         const xmlChar* xpathExpr)
+{
+  const xmlChar* value;
+
+  if(!map->keys[expri])
+    return flickcurl_xpath_eval(fc, xpathNodeCtx, xpathExpr);
+
+  value=values[expri];
+  if(!value || value == flickcurl_field_map_no_value)
+    return NULL;
+
+  return strdup((const char*)value);
+}
@@ -739,6 +739,10 @@ typedef struct {
  *
  * A photo or video.
  *
+ * If the photo was made with flickcurl_set_lazy_photo_fields()
+ * enabled, read @fields with flickcurl_photo_get_field_string(),
+ * flickcurl_photo_get_field_integer() and
+ * flickcurl_photo_get_field_type().
  */
 typedef struct flickcurl_photo_s {
   char *id;
@@ -754,6 +758,10 @@ typedef struct flickcurl_photo_s {
   flickcurl_video* video;
 
   char *media_type;
+
+  /*< private >*/
+  /* bit set for fields still holding the raw value from the response */
+  unsigned int fields_pending[(PHOTO_FIELD_LAST + 32) / 32];
 } flickcurl_photo;
 
 
@@ -1108,8 +1116,17 @@ typedef struct {
  * @photos_count: number of photos in @photos array if @format is NULL. Undefined on failure
  * @content: raw content if @format is not NULL.  Also may be NULL on failure.
  * @content_length: size of @content if @format is not NULL. Undefined on failure
+ * @page: page number of @photos or -1 if not known
+ * @per_page: number of photos per page or -1 if not known
+ * @pages: number of pages of photos or -1 if not known
+ * @total: total number of photos in all pages or -1 if not known
  *
  * Photos List result.
+ *
+ * If the list was made with flickcurl_set_photos_list_arena() or
+ * flickcurl_set_photos_list_intern() enabled, the photos in it are
+ * owned by the list and must not be freed individually or used after
+ * flickcurl_free_photos_list().
  */
 typedef struct {
   char *format;
@@ -1117,6 +1134,12 @@ typedef struct {
   int photos_count;
   char* content;
   size_t content_length;
+  int page;
+  int per_page;
+  int pages;
+  int total;
+  /*< private >*/
+  struct flickcurl_arena_s* arena;
 } flickcurl_photos_list;
 
 
@@ -1147,6 +1170,27 @@ typedef struct {
 } flickcurl_photos_list_params;
 
 
+/**
+ * flickcurl_photos_cursor:
+ *
+ * Flickcurl photos list cursor created by flickcurl_new_photos_cursor()
+ * and destroyed by flickcurl_free_photos_cursor()
+ */
+typedef struct flickcurl_photos_cursor_s flickcurl_photos_cursor;
+
+/**
+ * flickcurl_photos_list_getter:
+ * @user_data: user data pointer
+ * @fc: flickcurl session to make the request in
+ * @list_params: photos list parameters with the page to get
+ *
+ * Flickcurl photos cursor callback to get one page of a photos list.
+ *
+ * Return value: photos list or NULL on failure
+ */
+typedef flickcurl_photos_list* (*flickcurl_photos_list_getter)(void *user_data, flickcurl* fc, flickcurl_photos_list_params* list_params);
+
+
 /**
  * flickcurl_upload_params:
  * @photo_file: photo filename
@@ -1174,6 +1218,19 @@ typedef struct {
 } flickcurl_upload_params;
 
 
+/**
+ * flickcurl_upload_read_callback:
+ * @user_data: user data pointer
+ * @buffer: buffer to fill
+ * @size: size of @buffer
+ *
+ * Flickcurl callback to read the next part of a photo being uploaded
+ *
+ * Return value: bytes read into @buffer, 0 at the end or <0 to abort the upload
+ */
+typedef int (*flickcurl_upload_read_callback)(void *user_data, char* buffer, size_t size);
+
+
 /**
  * flickcurl_upload_status:
  * @photoid: photo ID that was uploaded/replaced (upload only)
@@ -1283,6 +1340,33 @@ typedef struct {
 } flickcurl_size;
 
 
+/**
+ * flickcurl_photos_batch_result:
+ * @photo_id: photo ID the call was made for
+ * @failed: non-0 if the call failed
+ * @error_code: Flickr API error code or 0
+ * @status_code: HTTP status code or 0 if no response was received
+ * @error_msg: error message or NULL
+ * @photo: photo from flickcurl_photos_getInfo_batch() or NULL
+ * @sizes: sizes from flickcurl_photos_getSizes_batch() or NULL
+ * @exifs: EXIF tags from flickcurl_photos_getExif_batch() or NULL
+ * @contexts: contexts from flickcurl_photos_getAllContexts_batch() or NULL
+ *
+ * Result of one call in a batch of per-photo calls.
+ */
+typedef struct {
+  char* photo_id;
+  int failed;
+  int error_code;
+  int status_code;
+  char* error_msg;
+  flickcurl_photo* photo;
+  flickcurl_size** sizes;
+  flickcurl_exif** exifs;
+  flickcurl_context** contexts;
+} flickcurl_photos_batch_result;
+
+
 /**
  * flickcurl_ticket:
  * @id: ticket ID
@@ -1390,6 +1474,8 @@ FLICKCURL_API
 void flickcurl_free_serializer(flickcurl_serializer* serializer);
 FLICKCURL_API
 int flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo);
+FLICKCURL_API
+int flickcurl_serialize_photo_with_sizes(flickcurl_serializer* fcs, flickcurl_photo* photo, flickcurl_size** photo_sizes);
 
 
 /**
@@ -1432,6 +1518,210 @@ typedef void (*flickcurl_message_handler)(void *user_data, const char *message);
 typedef void (*flickcurl_tag_handler)(void *user_data, flickcurl_tag* tag);
 
 
+/**
+ * flickcurl_share:
+ *
+ * Flickcurl shared resource object created by flickcurl_new_share()
+ * and destroyed by flickcurl_free_share()
+ */
+typedef struct flickcurl_share_s flickcurl_share;
+
+
+/**
+ * flickcurl_cache:
+ *
+ * Flickcurl response cache object created by flickcurl_new_cache()
+ * and destroyed by flickcurl_free_cache()
+ */
+typedef struct flickcurl_cache_s flickcurl_cache;
+
+
+/**
+ * flickcurl_dedupe_index:
+ *
+ * Flickcurl upload deduplication index object created by
+ * flickcurl_new_dedupe_index() and destroyed by
+ * flickcurl_free_dedupe_index()
+ */
+typedef struct flickcurl_dedupe_index_s flickcurl_dedupe_index;
+
+
+/**
+ * flickcurl_rate_limiter:
+ *
+ * Flickcurl request rate limiter object created by
+ * flickcurl_new_rate_limiter() and destroyed by
+ * flickcurl_free_rate_limiter()
+ */
+typedef struct flickcurl_rate_limiter_s flickcurl_rate_limiter;
+
+
+/**
+ * flickcurl_retry_params:
+ * @version: structure version (currently 1)
+ * @max_attempts: most attempts to make for a request including the first (1 never retries)
+ * @base_delay: longest wait before the first retry in msecs; doubled for each further retry
+ * @max_delay: longest wait before any retry in msecs
+ * @retry_transport_errors: non-0 to retry requests that fail without an HTTP response
+ * @http_statuses: 0-terminated list of HTTP statuses to retry
+ * @error_codes: 0-terminated list of Flickr API error codes to retry
+ *
+ * Automatic retry policy parameters for flickcurl_set_retry_params()
+ *
+ * Use flickcurl_retry_params_init() to set the defaults.
+ */
+typedef struct {
+  /* NOTE: Bump @version and update
+   * flickcurl_retry_params_init() when adding fields
+   */
+  int version;
+  int max_attempts;
+  int base_delay;
+  int max_delay;
+  int retry_transport_errors;
+  const int* http_statuses;
+  const int* error_codes;
+} flickcurl_retry_params;
+
+
+/**
+ * flickcurl_transfer_stats:
+ * @uploaded: bytes sent so far
+ * @upload_total: bytes to send or 0 if not known
+ * @downloaded: bytes received so far
+ * @download_total: bytes to receive or 0 if not known
+ * @upload_rate: current upload rate in bytes/second
+ * @download_rate: current download rate in bytes/second
+ * @upload_average: average upload rate in bytes/second
+ * @download_average: average download rate in bytes/second
+ * @elapsed: seconds since the transfer started
+ *
+ * Progress and throughput of one HTTP transfer
+ *
+ * The current rates are over the last quarter second or more.  Sizes
+ * are doubles, as in libcurl, so they do not overflow a long.
+ */
+typedef struct {
+  double uploaded;
+  double upload_total;
+  double downloaded;
+  double download_total;
+  double upload_rate;
+  double download_rate;
+  double upload_average;
+  double download_average;
+  double elapsed;
+} flickcurl_transfer_stats;
+
+
+/**
+ * flickcurl_progress_handler
+ * @user_data: user data pointer
+ * @stats: progress of the transfer
+ *
+ * Flickcurl transfer progress handler callback.
+ *
+ * Return value: non-0 to abort the transfer
+ */
+typedef int (*flickcurl_progress_handler)(void *user_data, flickcurl_transfer_stats* stats);
+
+
+/**
+ * flickcurl_multi:
+ *
+ * Flickcurl concurrent request object created by flickcurl_new_multi()
+ * and destroyed by flickcurl_free_multi()
+ */
+typedef struct flickcurl_multi_s flickcurl_multi;
+
+/**
+ * flickcurl_multi_handler:
+ * @user_data: user data pointer
+ * @fc: flickcurl session the request was made in
+ * @failed: non-0 if the request failed
+ * @doc: XML DOM of the response or NULL
+ * @content: raw response content or NULL
+ * @content_length: length of @content
+ *
+ * Flickcurl concurrent request completion handler callback.
+ *
+ * Called once per request added to a #flickcurl_multi with either
+ * @doc or @content set depending on how the request was added.  Both
+ * are freed after the handler returns.
+ */
+typedef void (*flickcurl_multi_handler)(void *user_data, flickcurl* fc, int failed, xmlDocPtr doc, const char* content, size_t content_length);
+
+/**
+ * flickcurl_multi_poll:
+ * @FLICKCURL_MULTI_POLL_IN: socket readable
+ * @FLICKCURL_MULTI_POLL_OUT: socket writable
+ * @FLICKCURL_MULTI_POLL_REMOVE: stop watching socket (#flickcurl_multi_socket_handler only)
+ * @FLICKCURL_MULTI_POLL_ERROR: socket error (flickcurl_multi_socket_action() only)
+ *
+ * Socket event flags for event loop integration
+ */
+typedef enum {
+  FLICKCURL_MULTI_POLL_IN     = 1,
+  FLICKCURL_MULTI_POLL_OUT    = 2,
+  FLICKCURL_MULTI_POLL_REMOVE = 4,
+  FLICKCURL_MULTI_POLL_ERROR  = 8
+} flickcurl_multi_poll;
+
+/**
+ * FLICKCURL_MULTI_SOCKET_TIMEOUT:
+ *
+ * Socket argument to flickcurl_multi_socket_action() when the timer expired
+ */
+#define FLICKCURL_MULTI_SOCKET_TIMEOUT (-1)
+
+/**
+ * flickcurl_multi_socket_handler:
+ * @user_data: user data pointer
+ * @fd: socket
+ * @events: #flickcurl_multi_poll flags of events to watch for
+ *
+ * Flickcurl event loop socket handler callback.
+ *
+ * Called to start, change or (with %FLICKCURL_MULTI_POLL_REMOVE) stop
+ * watching socket @fd.
+ */
+typedef void (*flickcurl_multi_socket_handler)(void *user_data, int fd, int events);
+
+/**
+ * flickcurl_multi_timer_handler:
+ * @user_data: user data pointer
+ * @timeout_msec: timeout in milliseconds or <0 to cancel the timer
+ *
+ * Flickcurl event loop timer handler callback.
+ *
+ * Called to set a single timer after which
+ * flickcurl_multi_socket_action() should be called with
+ * %FLICKCURL_MULTI_SOCKET_TIMEOUT.
+ */
+typedef void (*flickcurl_multi_timer_handler)(void *user_data, long timeout_msec);
+
+
+/**
+ * flickcurl_upload_queue:
+ *
+ * Queue of photo uploads run concurrently
+ */
+typedef struct flickcurl_upload_queue_s flickcurl_upload_queue;
+
+/**
+ * flickcurl_upload_queue_handler:
+ * @user_data: user data pointer
+ * @job: job number from flickcurl_upload_queue_add()
+ * @params: upload parameters of the job
+ * @status: upload status or NULL if the upload failed
+ *
+ * Called once per upload added to a #flickcurl_upload_queue when it
+ * completes, which for an asynchronous upload is when its ticket
+ * completes.  @params and @status are freed after the handler returns.
+ */
+typedef void (*flickcurl_upload_queue_handler)(void *user_data, int job, flickcurl_upload_params* params, flickcurl_upload_status* status);
+
+
 /* library constants */
 FLICKCURL_API
 extern const char* const flickcurl_short_copyright_string;
@@ -1480,18 +1770,40 @@ void flickcurl_set_api_key(flickcurl* fc, const char *api_key);
 FLICKCURL_API
 void flickcurl_set_auth_token(flickcurl *fc, const char* auth_token);
 FLICKCURL_API
+void flickcurl_set_bandwidth_limit(flickcurl* fc, long max_upload_rate, long max_download_rate);
+FLICKCURL_API
+void flickcurl_set_cache(flickcurl* fc, flickcurl_cache* cache);
+FLICKCURL_API
+void flickcurl_set_compression(flickcurl* fc, int enabled);
+FLICKCURL_API
 void flickcurl_set_data(flickcurl *fc, void* data, size_t data_length);
 FLICKCURL_API
+void flickcurl_set_dedupe_index(flickcurl* fc, flickcurl_dedupe_index* index);
+FLICKCURL_API
 void flickcurl_set_error_handler(flickcurl* fc, flickcurl_message_handler error_handler,  void *error_data);
 FLICKCURL_API
 void flickcurl_set_http_accept(flickcurl* fc, const char *value);
 FLICKCURL_API
+void flickcurl_set_lazy_photo_fields(flickcurl* fc, int enabled);
+FLICKCURL_API
+void flickcurl_set_photos_list_arena(flickcurl* fc, int enabled);
+FLICKCURL_API
+void flickcurl_set_photos_list_intern(flickcurl* fc, int enabled);
+FLICKCURL_API
+void flickcurl_set_progress_handler(flickcurl* fc, flickcurl_progress_handler progress_handler, void *progress_data);
+FLICKCURL_API
 void flickcurl_set_proxy(flickcurl* fc, const char *proxy);
 FLICKCURL_API
+void flickcurl_set_rate_limiter(flickcurl* fc, flickcurl_rate_limiter* limiter);
+FLICKCURL_API
 void flickcurl_set_request_delay(flickcurl *fc, long delay_msec);
 FLICKCURL_API
+int flickcurl_set_retry_params(flickcurl* fc, flickcurl_retry_params* params);
+FLICKCURL_API
 void flickcurl_set_shared_secret(flickcurl* fc, const char *secret);
 FLICKCURL_API
+void flickcurl_set_share(flickcurl* fc, flickcurl_share* share);
+FLICKCURL_API
 void flickcurl_set_sign(flickcurl *fc);
 FLICKCURL_API
 void flickcurl_set_tag_handler(flickcurl* fc,  flickcurl_tag_handler tag_handler, void *tag_data);
@@ -1503,6 +1815,8 @@ FLICKCURL_API
 void flickcurl_set_xml_data(flickcurl *fc, xmlDocPtr doc);
 FLICKCURL_API
 int flickcurl_get_current_request_wait(flickcurl *fc);
+FLICKCURL_API
+void flickcurl_get_transfer_stats(flickcurl* fc, flickcurl_transfer_stats* stats);
 
 /* flickcurl* object set methods */
 FLICKCURL_API
@@ -1512,6 +1826,110 @@ const char* flickcurl_get_shared_secret(flickcurl *fc);
 FLICKCURL_API
 const char* flickcurl_get_auth_token(flickcurl *fc);
 
+/* shared connection, DNS and TLS session caches */
+FLICKCURL_API
+flickcurl_share* flickcurl_new_share(void);
+FLICKCURL_API
+void flickcurl_free_share(flickcurl_share* share);
+
+/* response cache */
+FLICKCURL_API
+flickcurl_cache* flickcurl_new_cache(int max_entries, size_t max_bytes);
+FLICKCURL_API
+void flickcurl_free_cache(flickcurl_cache* cache);
+FLICKCURL_API
+int flickcurl_cache_set_method_ttl(flickcurl_cache* cache, const char* method, int ttl);
+FLICKCURL_API
+int flickcurl_cache_set_persistent(flickcurl_cache* cache, const char* path, size_t max_bytes);
+
+/* request rate limiter */
+FLICKCURL_API
+flickcurl_rate_limiter* flickcurl_new_rate_limiter(const char* name, int requests_per_hour, int burst);
+FLICKCURL_API
+void flickcurl_free_rate_limiter(flickcurl_rate_limiter* limiter);
+FLICKCURL_API
+long flickcurl_rate_limiter_take(flickcurl_rate_limiter* limiter);
+
+/* automatic retry */
+FLICKCURL_API
+int flickcurl_retry_params_init(flickcurl_retry_params* params);
+
+/* upload dedupe index */
+FLICKCURL_API
+flickcurl_dedupe_index* flickcurl_new_dedupe_index(const char* path);
+FLICKCURL_API
+void flickcurl_free_dedupe_index(flickcurl_dedupe_index* index);
+FLICKCURL_API
+void flickcurl_dedupe_index_set_machine_tag(flickcurl_dedupe_index* index, int enabled);
+FLICKCURL_API
+char* flickcurl_dedupe_index_get(flickcurl_dedupe_index* index, const char* hash);
+FLICKCURL_API
+int flickcurl_dedupe_index_add(flickcurl_dedupe_index* index, const char* hash, const char* photo_id);
+FLICKCURL_API
+int flickcurl_dedupe_index_remove(flickcurl_dedupe_index* index, const char* hash);
+FLICKCURL_API
+int flickcurl_dedupe_hash_file(const char* filename, char hash[33]);
+
+/* concurrent requests */
+FLICKCURL_API
+flickcurl_multi* flickcurl_new_multi(void);
+FLICKCURL_API
+void flickcurl_free_multi(flickcurl_multi* multi);
+FLICKCURL_API
+void flickcurl_multi_set_max_transfers(flickcurl_multi* multi, int max_transfers);
+FLICKCURL_API
+int flickcurl_multi_add_method(flickcurl_multi* multi, flickcurl* fc, const char* method, const char* parameters[][2], int count, int want_content, flickcurl_multi_handler handler, void* user_data);
+FLICKCURL_API
+int flickcurl_multi_perform(flickcurl_multi* multi, int* running_p);
+FLICKCURL_API
+int flickcurl_multi_wait(flickcurl_multi* multi, long timeout_msec);
+FLICKCURL_API
+int flickcurl_multi_run(flickcurl_multi* multi);
+FLICKCURL_API
+void flickcurl_multi_set_socket_handler(flickcurl_multi* multi, flickcurl_multi_socket_handler socket_handler, void* socket_data);
+FLICKCURL_API
+void flickcurl_multi_set_timer_handler(flickcurl_multi* multi, flickcurl_multi_timer_handler timer_handler, void* timer_data);
+FLICKCURL_API
+int flickcurl_multi_socket_action(flickcurl_multi* multi, int fd, int events, int* running_p);
+FLICKCURL_API
+long flickcurl_multi_timeout(flickcurl_multi* multi);
+
+/* upload queue */
+FLICKCURL_API
+flickcurl_upload_queue* flickcurl_new_upload_queue(flickcurl* fc, flickcurl_upload_queue_handler handler, void* user_data);
+FLICKCURL_API
+void flickcurl_free_upload_queue(flickcurl_upload_queue* queue);
+FLICKCURL_API
+void flickcurl_upload_queue_set_concurrency(flickcurl_upload_queue* queue, int min_concurrency, int max_concurrency);
+FLICKCURL_API
+void flickcurl_upload_queue_set_async(flickcurl_upload_queue* queue, int async);
+FLICKCURL_API
+void flickcurl_upload_queue_set_poll_interval(flickcurl_upload_queue* queue, long min_msec, long max_msec);
+FLICKCURL_API
+int flickcurl_upload_queue_get_concurrency(flickcurl_upload_queue* queue);
+FLICKCURL_API
+int flickcurl_upload_queue_add(flickcurl_upload_queue* queue, flickcurl_upload_params* params);
+FLICKCURL_API
+int flickcurl_upload_queue_run(flickcurl_upload_queue* queue);
+
+/* photos list cursor */
+FLICKCURL_API
+flickcurl_photos_cursor* flickcurl_new_photos_cursor(flickcurl* fc, flickcurl_photos_list_getter getter, void* user_data, flickcurl_photos_list_params* list_params);
+FLICKCURL_API
+void flickcurl_free_photos_cursor(flickcurl_photos_cursor* cursor);
+FLICKCURL_API
+int flickcurl_photos_cursor_set_prefetch(flickcurl_photos_cursor* cursor, flickcurl* prefetch_fc);
+FLICKCURL_API
+flickcurl_photo* flickcurl_photos_cursor_next(flickcurl_photos_cursor* cursor);
+FLICKCURL_API
+int flickcurl_photos_cursor_is_failed(flickcurl_photos_cursor* cursor);
+FLICKCURL_API
+int flickcurl_photos_cursor_get_page(flickcurl_photos_cursor* cursor);
+FLICKCURL_API
+int flickcurl_photos_cursor_get_pages(flickcurl_photos_cursor* cursor);
+FLICKCURL_API
+int flickcurl_photos_cursor_get_total(flickcurl_photos_cursor* cursor);
+
 /* other flickcurl class destructors */
 FLICKCURL_API
 void flickcurl_free_collection(flickcurl_collection *collection);
@@ -1583,6 +2001,12 @@ void flickcurl_free_tag_predicate_values(flickcurl_tag_predicate_value **tag_pvs
 /* get an image URL for a photo in some size */
 FLICKCURL_API
 char* flickcurl_photo_as_source_uri(flickcurl_photo *photo, const char c);
+FLICKCURL_API
+const char* flickcurl_photo_get_field_string(flickcurl_photo* photo, flickcurl_photo_field_type field);
+FLICKCURL_API
+int flickcurl_photo_get_field_integer(flickcurl_photo* photo, flickcurl_photo_field_type field);
+FLICKCURL_API
+flickcurl_field_value_type flickcurl_photo_get_field_type(flickcurl_photo* photo, flickcurl_photo_field_type field);
 /* get a photo ID from an image URL */
 FLICKCURL_API
 char* flickcurl_source_uri_as_photo_id(const char *uri);
@@ -1823,6 +2247,18 @@ FLICKCURL_API
 flickcurl_photos_list* flickcurl_photos_getRecent_params(flickcurl* fc, flickcurl_photos_list_params* list_params);
 FLICKCURL_API
 flickcurl_size** flickcurl_photos_getSizes(flickcurl* fc, const char* photo_id);
+
+/* flickr.photos calls for many photos at once */
+FLICKCURL_API
+flickcurl_photos_batch_result** flickcurl_photos_getInfo_batch(flickcurl* fc, const char** photo_ids, int photo_ids_count, int concurrency);
+FLICKCURL_API
+flickcurl_photos_batch_result** flickcurl_photos_getSizes_batch(flickcurl* fc, const char** photo_ids, int photo_ids_count, int concurrency);
+FLICKCURL_API
+flickcurl_photos_batch_result** flickcurl_photos_getExif_batch(flickcurl* fc, const char** photo_ids, const char** secrets, int photo_ids_count, int concurrency);
+FLICKCURL_API
+flickcurl_photos_batch_result** flickcurl_photos_getAllContexts_batch(flickcurl* fc, const char** photo_ids, int photo_ids_count, int concurrency);
+FLICKCURL_API
+void flickcurl_free_photos_batch_results(flickcurl_photos_batch_result** results);
 FLICKCURL_API
 flickcurl_photo** flickcurl_photos_getUntagged(flickcurl* fc, int min_upload_date, int max_upload_date, const char* min_taken_date, const char* max_taken_date, int privacy_filter, const char* extras, int per_page, int page);
 FLICKCURL_API
@@ -2080,6 +2516,18 @@ flickcurl_upload_status* flickcurl_photos_upload_params(flickcurl* fc, flickcurl
 FLICKCURL_API
 flickcurl_upload_status* flickcurl_photos_replace(flickcurl* fc, const char* photo_file, const char *photo_id, int async);
 FLICKCURL_API
+flickcurl_upload_status* flickcurl_photos_upload_buffer(flickcurl* fc, flickcurl_upload_params* params, const void* buffer, size_t length);
+FLICKCURL_API
+flickcurl_upload_status* flickcurl_photos_upload_fd(flickcurl* fc, flickcurl_upload_params* params, int fd);
+FLICKCURL_API
+flickcurl_upload_status* flickcurl_photos_upload_callback(flickcurl* fc, flickcurl_upload_params* params, flickcurl_upload_read_callback callback, void* user_data, long length);
+FLICKCURL_API
+flickcurl_upload_status* flickcurl_photos_replace_buffer(flickcurl* fc, const void* buffer, size_t length, const char *photo_id, int async);
+FLICKCURL_API
+flickcurl_upload_status* flickcurl_photos_replace_fd(flickcurl* fc, int fd, const char *photo_id, int async);
+FLICKCURL_API
+flickcurl_upload_status* flickcurl_photos_replace_callback(flickcurl* fc, flickcurl_upload_read_callback callback, void* user_data, long length, const char *photo_id, int async);
+FLICKCURL_API
 void flickcurl_free_upload_status(flickcurl_upload_status* status);
 FLICKCURL_API
 FLICKCURL_DEPRECATED void flickcurl_upload_status_free(flickcurl_upload_status* status);
@@ -2124,6 +2572,42 @@ void flickcurl_array_free(char *array[]);
  * flickcurl_s
  */
 
+/**
+ * flickcurl_multi_s:
+ *
+ * flickcurl_multi_s
+ */
+
+/**
+ * flickcurl_photos_cursor_s:
+ *
+ * flickcurl_photos_cursor_s
+ */
+
+/**
+ * flickcurl_cache_s:
+ *
+ * flickcurl_cache_s
+ */
+
+/**
+ * flickcurl_dedupe_index_s:
+ *
+ * flickcurl_dedupe_index_s
+ */
+
+/**
+ * flickcurl_rate_limiter_s:
+ *
+ * flickcurl_rate_limiter_s
+ */
+
+/**
+ * flickcurl_share_s:
+ *
+ * flickcurl_share_s
+ */
+
 /**
  * flickcurl_serializer_s:
  *
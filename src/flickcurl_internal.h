@@ -104,6 +104,23 @@
 #endif
 
 
+/*
+ * flickcurl_sax_handler:
+ *
+ * Callbacks for an XML response streamed by flickcurl_invoke_sax().
+ * @depth is 0 for the root element and @attributes are SAX2
+ * localname/prefix/URI/value/end tuples with values not NUL-terminated.
+ * @reset is called before a failed request is retried.
+ */
+typedef struct {
+  void (*start)(void* user_data, int depth, const xmlChar* name, int nb_attributes, const xmlChar** attributes);
+  void (*end)(void* user_data, int depth, const xmlChar* name);
+  void (*text)(void* user_data, const xmlChar* text, int len);
+  void (*reset)(void* user_data);
+} flickcurl_sax_handler;
+
+typedef struct flickcurl_arena_s flickcurl_arena;
+
 /* flickcurl.c */
 /* Prepare Flickr API request - GET or POST with URI parameters with auth */
 int flickcurl_prepare(flickcurl *fc, const char* method, const char* parameters[][2], int count);
@@ -116,6 +133,17 @@ int flickcurl_prepare_upload(flickcurl *fc, const char* url, const char* upload_
 xmlDocPtr flickcurl_invoke(flickcurl *fc);
 /* Invoke Flickr API at URi prepared above and get back raw content */
 char* flickcurl_invoke_get_content(flickcurl *fc, size_t* size_p);
+/* Invoke Flickr API at URi prepared above and stream the XML to callbacks */
+int flickcurl_invoke_sax(flickcurl *fc, flickcurl_sax_handler* sax, void* sax_data);
+
+/* arena.c */
+flickcurl_arena* flickcurl_new_arena(size_t block_size);
+void flickcurl_free_arena(flickcurl_arena* arena);
+void* flickcurl_arena_alloc(flickcurl_arena* arena, size_t size);
+void* flickcurl_arena_calloc(flickcurl_arena* arena, size_t nmemb, size_t size);
+char* flickcurl_arena_strndup(flickcurl_arena* arena, const char* string, size_t len);
+int flickcurl_arena_set_intern(flickcurl_arena* arena);
+char* flickcurl_arena_intern(flickcurl_arena* arena, const char* string, size_t len);
 
 /* args.c */
 void flickcurl_free_arg(flickcurl_arg *arg);
@@ -134,7 +162,11 @@ flickcurl_collection* flickcurl_build_collection(flickcurl* fc, xmlXPathContextP
 /* invoke an error */
 void flickcurl_error(flickcurl* fc, const char *message, ...);
 
+/* length of an ISO 8601 UTC date such as 2008-01-10T13:14:15Z */
+#define FLICKCURL_ISO_DATE_LEN 20
+
 /* Convert a unix timestamp into an ISO dateTime string */
+int flickcurl_unixtime_format_isotime(time_t unix_time, char* buffer);
 char* flickcurl_unixtime_to_isotime(time_t unix_time);
 
 /* Convert a unix timestamp into an SQL timestamp string */
@@ -149,7 +181,7 @@ char* flickcurl_xpath_eval_to_tree_string(flickcurl* fc, xmlXPathContextPtr xpat
 
 char* flickcurl_call_get_one_string_field(flickcurl* fc, const char* key, const char* value, const char* method, const xmlChar* xpathExpr);
 
-int flickcurl_append_photos_list_params(flickcurl_photos_list_params* list_params, const char* parameters[][2], int* count_p, const char** format_p);
+int flickcurl_append_photos_list_params(flickcurl* fc, flickcurl_photos_list_params* list_params, const char* parameters[][2], int* count_p, const char** format_p);
 
 /* activity.c */
 flickcurl_activity** flickcurl_build_activities(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* activity_count_p);
@@ -189,6 +221,25 @@ flickcurl_user_upload_status* flickcurl_build_user_upload_status(flickcurl* fc,
 
 /* md5.c - MD5 as hex string */
 extern char* MD5_string(char *string);
+/* md5.c - MD5 as 16 bytes */
+extern void MD5_digest(const void *data, size_t len, unsigned char digest[16]);
+/* md5.c - MD5 of data given in pieces */
+#if SIZEOF_UNSIGNED_INT == 4
+typedef unsigned int flickcurl_md5_u32;
+#elif SIZEOF_UNSIGNED_LONG == 4
+typedef unsigned long flickcurl_md5_u32;
+#else
+#error MD5 32 bit type not defined
+#endif
+struct MD5Context {
+  flickcurl_md5_u32 buf[4];
+  flickcurl_md5_u32 bits[2];
+  unsigned char in[64];
+  unsigned char digest[16];
+};
+extern void MD5_init(struct MD5Context *context);
+extern void MD5_update(struct MD5Context *context, const void *data, size_t len);
+extern void MD5_final_hex(struct MD5Context *context, char hex[33]);
 
 /* members.c */
 flickcurl_member** flickcurl_build_members(flickcurl* fc,  xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* member_count_p);
@@ -226,7 +277,7 @@ flickcurl_size** flickcurl_build_sizes(flickcurl* fc, xmlXPathContextPtr xpathCt
 
 /* tags.c  */
 flickcurl_tag** flickcurl_build_tags(flickcurl* fc, flickcurl_photo* photo, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr, int* tag_count_p);
-flickcurl_tag** flickcurl_build_tags_from_string(flickcurl* fc, flickcurl_photo* photo, const char *string, int *tag_count_p);
+flickcurl_tag** flickcurl_build_tags_from_string(flickcurl* fc, flickcurl_photo* photo, const char *string, int *tag_count_p, flickcurl_arena* arena);
 flickcurl_tag_clusters* flickcurl_build_tag_clusters(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr);
 
 /* ticket.c */
@@ -238,13 +289,169 @@ extern char* my_vsnprintf(const char *message, va_list arguments);
 /* video.c */
 flickcurl_video* flickcurl_build_video(flickcurl* fc, xmlXPathContextPtr xpathCtx, const xmlChar* xpathExpr);
 
-struct flickcurl_chunk_s {
+
+/*
+ * State of one HTTP request/response.
+ *
+ * A transfer takes its own copy of the request prepared in the
+ * session by flickcurl_prepare() and friends so that several of them
+ * can be in progress at once on separate curl easy handles (see multi.c).
+ */
+typedef struct flickcurl_transfer_s flickcurl_transfer;
+
+/*
+ * Source of an upload body other than a file.  The body is read in
+ * pieces as libcurl sends it so nothing is copied or spooled to disk.
+ */
+typedef enum {
+  FLICKCURL_UPLOAD_STREAM_NONE,
+  FLICKCURL_UPLOAD_STREAM_BUFFER,
+  FLICKCURL_UPLOAD_STREAM_FD,
+  FLICKCURL_UPLOAD_STREAM_CALLBACK
+} flickcurl_upload_stream_type;
+
+typedef struct {
+  flickcurl_upload_stream_type type;
+  /* shared - not freed */
+  const char* buffer;
+  int fd;
+  flickcurl_upload_read_callback read_callback;
+  void* read_callback_data;
+  /* bytes to send or -1 if not known */
+  long length;
+  /* bytes sent so far */
+  long offset;
+} flickcurl_upload_stream;
+
+struct flickcurl_transfer_s {
+  /* session the request was prepared in */
+  flickcurl* fc;
+
+  /* curl easy handle the transfer is running on or NULL */
+  CURL* curl_handle;
+  char error_buffer[CURL_ERROR_SIZE];
+
+  /* copies of the prepared request */
+  char* uri;
+  char* method;
+  char* data;
+  size_t data_length;
+  int is_write;
+
+  /* request headers and upload form */
+  struct curl_slist* slist;
+  struct curl_httppost* post;
+  /* upload body when not sent from a file */
+  flickcurl_upload_stream upload_stream;
+
+  /* if non-0 then run content through an XML parser and make a DOM in @xc */
+  int xml_parse_content;
+  /* XML parser */
+  xmlParserCtxtPtr xc;
+  /* if set, stream the XML to these callbacks instead of making a DOM */
+  flickcurl_sax_handler* sax;
+  void* sax_data;
+  int sax_depth;
+  /* non-0 if the streamed response rsp/@stat was not ok or the raw
+   * content is a stat fail response */
+  int rsp_failed;
+  
+  /* if non-0 then save content */
+  int save_content;
+  /* saved content: @content_length bytes used of @content_size */
   char* content;
-  size_t size;
-  struct flickcurl_chunk_s *prev;
+  size_t content_length;
+  size_t content_size;
+
+  int total_bytes;
+
+  /* result */
+  int failed;
+  int error_code;
+  char* error_msg;
+  int status_code;
+
+  /* Retry-After header value in seconds or < 0 if absent */
+  long retry_after;
+  /* retries made so far and time the next may start (or 0) */
+  int attempts;
+  struct timeval retry_time;
+
+  /* response cache and key if the response is cacheable */
+  flickcurl_cache* cache;
+  char* cache_key;
+  int cache_ttl;
+
+  /* completion handler for transfers run by a flickcurl_multi */
+  flickcurl_multi_handler handler;
+  void* handler_data;
+  flickcurl_transfer* next;
+
+  /* progress: time started, last rate sample and stats so far */
+  struct timeval start_time;
+  struct timeval rate_time;
+  double rate_uploaded;
+  double rate_downloaded;
+  flickcurl_transfer_stats stats;
+  /* non-0 if the progress handler aborted it */
+  int aborted;
+
+  /* list of the session's transfers sharing its bandwidth limits */
+  int active;
+  flickcurl_transfer* active_prev;
+  flickcurl_transfer* active_next;
 };
 
-typedef struct flickcurl_chunk_s flickcurl_chunk;
+/* common.c */
+void flickcurl_msleep(long msec);
+int flickcurl_transfer_init(flickcurl* fc, flickcurl_transfer* t, int save_content);
+void flickcurl_transfer_setup(flickcurl_transfer* t, CURL* curl_handle);
+void flickcurl_transfer_complete(flickcurl_transfer* t, CURLcode code);
+int flickcurl_transfer_finish(flickcurl_transfer* t, xmlDocPtr* docptr_p);
+void flickcurl_transfer_report(flickcurl_transfer* t);
+void flickcurl_transfer_reset(flickcurl_transfer* t);
+void flickcurl_transfer_clear(flickcurl_transfer* t);
+
+/* cache.c */
+char* flickcurl_cache_make_key(flickcurl* fc, int* ttl_p);
+int flickcurl_cache_get(flickcurl_cache* cache, const char* key, xmlDocPtr* doc_p, char** content_p, size_t* size_p);
+void flickcurl_cache_put(flickcurl_cache* cache, const char* key, int ttl, const char* content, size_t content_length);
+
+/* dedupe.c */
+int flickcurl_dedupe_hash_upload(flickcurl_upload_params* params, flickcurl_upload_stream* stream, char hash[33]);
+flickcurl_upload_status* flickcurl_dedupe_find_upload(flickcurl_dedupe_index* index, const char* hash);
+char* flickcurl_dedupe_make_tags(flickcurl_dedupe_index* index, const char* tags, const char* hash);
+
+/* fieldmap.c */
+typedef struct flickcurl_field_map_s flickcurl_field_map;
+flickcurl_field_map* flickcurl_get_field_map(const void* table, size_t entry_size);
+void flickcurl_field_maps_terminate(void);
+int flickcurl_field_map_get_count(flickcurl_field_map* map);
+int flickcurl_field_map_lookup(flickcurl_field_map* map, const xmlChar* element, const xmlChar* attribute);
+int flickcurl_field_map_next(flickcurl_field_map* map, int expri);
+void flickcurl_field_map_scan(flickcurl_field_map* map, xmlNodePtr node, const xmlChar** values);
+char* flickcurl_field_map_eval(flickcurl* fc, flickcurl_field_map* map, const xmlChar** values, int expri, xmlXPathContextPtr xpathNodeCtx, const xmlChar* xpathExpr);
+
+/* ratelimit.c */
+long flickcurl_rate_limiter_get_wait(flickcurl_rate_limiter* limiter);
+
+/* retry.c */
+void flickcurl_free_retry_params(flickcurl_retry_params* params);
+long flickcurl_transfer_get_retry_delay(flickcurl_transfer* t);
+
+/* share.c */
+CURLSH* flickcurl_share_get_curl_share(flickcurl_share* share);
+
+/* upload-api.c */
+int flickcurl_prepare_photos_upload(flickcurl* fc, flickcurl_upload_params* params, flickcurl_upload_stream* stream, int async);
+flickcurl_upload_status* flickcurl_build_upload_status(flickcurl* fc, xmlDocPtr doc);
+
+/* xpath.c */
+xmlXPathObjectPtr flickcurl_xpath_eval_expression(const xmlChar* xpathExpr, xmlXPathContextPtr xpathCtx);
+void flickcurl_xpath_cache_terminate(void);
+
+/* multi.c */
+int flickcurl_multi_add_prepared(flickcurl_multi* multi, flickcurl* fc, int want_content, flickcurl_multi_handler handler, void* user_data);
 
 
 struct flickcurl_s {
@@ -261,19 +468,41 @@ struct flickcurl_s {
   
   int status_code;
 
+  /* parameters of the prepared request pointing into @param_storage;
+   * all are reused by the next request */
   char** param_fields;
   char** param_values;
   int parameter_count;
+  int param_capacity;
+  char* param_storage;
+  size_t param_storage_len;
+  /* request signature state */
+  struct MD5Context md5_context;
+  /* signature state after hashing @secret */
+  struct MD5Context secret_md5_context;
   char* upload_field;
   char* upload_value;
+  /* upload body source or NULL to send the file @upload_value */
+  flickcurl_upload_stream* upload_stream;
   
   /* uri buffer for internal use of size @uri_len */
   char* uri;
 
   CURL* curl_handle;
-  char error_buffer[CURL_ERROR_SIZE];
   int curl_init_here;
 
+  /* shared caches or NULL - flickcurl_set_share() */
+  flickcurl_share* share;
+
+  /* response cache or NULL - flickcurl_set_cache() */
+  flickcurl_cache* cache;
+
+  /* DOM of the last response served from @cache */
+  xmlDocPtr cached_doc;
+
+  /* upload dedupe index or NULL - flickcurl_set_dedupe_index() */
+  flickcurl_dedupe_index* dedupe_index;
+
   char* user_agent;
 
   /* proxy URL string or NULL for none */
@@ -321,6 +550,49 @@ struct flickcurl_s {
   /* Delay between HTTP requests in microseconds - default is none (0) */
   long request_delay;
 
+  /* non-0 to send Accept-Encoding for compressed responses */
+  int compression;
+
+  /* non-0 to build photos lists in an arena owned by the list */
+  int photos_list_arena;
+  /* non-0 to share copies of equal strings in photos lists */
+  int photos_list_intern;
+  /* non-0 to convert photo date fields on first access */
+  int lazy_photo_fields;
+
+  /* photos list per_page and page parameter values for the next request */
+  char list_per_page_string[4];
+  char list_page_string[12];
+
+  /* SAX callbacks for the next request - set by flickcurl_invoke_sax */
+  flickcurl_sax_handler* sax;
+  void* sax_data;
+
+  /* spare content buffer kept for the next transfer to save content */
+  char* content_buffer;
+  size_t content_buffer_size;
+
+  /* token bucket used instead of @request_delay when set */
+  flickcurl_rate_limiter* rate_limiter;
+
+  /* automatic retry policy or NULL and backoff jitter state */
+  flickcurl_retry_params* retry_params;
+  unsigned int retry_seed;
+
+  /* transfer progress handler or NULL - flickcurl_set_progress_handler() */
+  flickcurl_progress_handler progress_handler;
+  void* progress_data;
+
+  /* bandwidth limits in bytes/second or 0 - flickcurl_set_bandwidth_limit() */
+  long max_upload_rate;
+  long max_download_rate;
+  /* transfers in progress sharing the limits */
+  flickcurl_transfer* active_transfers;
+  int active_transfers_count;
+
+  /* stats of the last transfer - flickcurl_get_transfer_stats() */
+  flickcurl_transfer_stats transfer_stats;
+
   /* write = POST, else read = GET */
   int is_write;
   
@@ -333,18 +605,6 @@ struct flickcurl_s {
   FILE* fh;
 #endif
 
-  /* if non-0 then run content through an XML parser and make a DOM in @xc */
-  int xml_parse_content;
-  
-  /* if non-0 then save content */
-  int save_content;
-
-  /* saved content */
-  /* reverse-ordered list of chunks of data read */
-  flickcurl_chunk* chunks;
-  /* count of chunks */
-  int chunks_count;
-
   /* Web Service URI that is called */
   char *service_uri;
 
@@ -249,7 +249,7 @@ flickcurl_groups_pools_getPhotos_params(flickcurl* fc, const char* group_id,
   }
 
   /* Photos List parameters */
-  flickcurl_append_photos_list_params(list_params, parameters, &count, &format);
+  flickcurl_append_photos_list_params(fc, list_params, parameters, &count, &format);
   
   parameters[count][0]  = NULL;
 
@@ -174,7 +174,7 @@ flickcurl_build_institutions(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlNodeSetPtr nodes;
   int i;
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -55,28 +55,20 @@
 #undef HAVE_STDLIB_H
 #endif
 
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
 
 #if u32 == MISSING
   #undef u32
-  #if SIZEOF_UNSIGNED_INT == 4
-    typedef unsigned int u32;
-  #elif SIZEOF_UNSIGNED_LONG == 4
-    typedef unsigned long u32;
-  #else
-    #error u32 type not defined
-  #endif
+  typedef flickcurl_md5_u32 u32;
 #endif
 
 
 
 /* original code from header - function names have changed */
 
-struct MD5Context {
-  u32 buf[4];
-  u32 bits[2];
-  unsigned char in[64];
-  unsigned char digest[16];
-};
+/* struct MD5Context is in flickcurl_internal.h */
 
 static void MD5Init(struct MD5Context *context);
 static void MD5Update(struct MD5Context *context, 
@@ -328,29 +320,64 @@ static void MD5Transform(u32 buf[4], u32 const in[16])
 
 /* my code from here */
 
-char* MD5_string(char *string);
-
-
 char*
 MD5_string(char *string)
 {
   struct MD5Context md5;
-  size_t len=strlen(string);
-  char* b=NULL;
-  int i;
+  char* b;
 
-  MD5Init(&md5);
-  MD5Update(&md5, (const unsigned char*)string, len);
-  MD5Final(&md5);
-  
 #define MD5_LEN 16
   b=(char*)malloc(1+(MD5_LEN<<1));
   if(!b)
     return NULL;
-  
-  for(i=0; i < MD5_LEN; i++)
-    sprintf(b+(i<<1), "%02x", (unsigned int)md5.digest[i]);
-  b[i<<1]='\0';
-  
+
+  MD5Init(&md5);
+  MD5Update(&md5, (const unsigned char*)string, strlen(string));
+  MD5_final_hex(&md5, b);
+
   return b;
 }
+
+
+void
+MD5_init(struct MD5Context *context)
+{
+  MD5Init(context);
+}
+
+
+void
+MD5_update(struct MD5Context *context, const void *data, size_t len)
+{
+  MD5Update(context, (const unsigned char*)data, (unsigned)len);
+}
+
+
+/* write the 32 hex digits and a NUL to @hex */
+void
+MD5_final_hex(struct MD5Context *context, char hex[33])
+{
+  static const char digits[]="0123456789abcdef";
+  int i;
+
+  MD5Final(context);
+
+  for(i=0; i < MD5_LEN; i++) {
+    hex[i<<1]=digits[context->digest[i] >> 4];
+    hex[(i<<1) + 1]=digits[context->digest[i] & 0xf];
+  }
+  hex[i<<1]='\0';
+}
+
+
+void
+MD5_digest(const void *data, size_t len, unsigned char digest[16])
+{
+  struct MD5Context md5;
+
+  MD5Init(&md5);
+  MD5Update(&md5, (const unsigned char*)data, len);
+  MD5Final(&md5);
+
+  memcpy(digest, md5.digest, 16);
+}
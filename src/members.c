@@ -87,7 +87,7 @@ flickcurl_build_members(flickcurl* fc,
   xmlNodeSetPtr nodes;
   
   /* Now do members */
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
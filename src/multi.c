@@ -0,0 +1,965 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * multi.c - Flickcurl concurrent web service requests
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#if TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# if HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+/* default maximum number of requests running at once */
+#define FLICKCURL_MULTI_DEFAULT_MAX_TRANSFERS 4
+
+/* longest time in msec to wait when libcurl has no sockets to wait on */
+#define FLICKCURL_MULTI_IDLE_WAIT 100
+
+
+struct flickcurl_multi_s {
+  CURLM* multi_handle;
+
+  /* maximum number of transfers running at once */
+  int max_transfers;
+
+  /* FIFO of transfers added but not yet started */
+  flickcurl_transfer* pending;
+  flickcurl_transfer* pending_tail;
+  int pending_count;
+
+  /* transfers running in @multi_handle */
+  flickcurl_transfer* active;
+  int active_count;
+
+  /* curl easy handles that have finished a transfer and can be reused */
+  CURL** idle_handles;
+  int idle_count;
+  int idle_size;
+
+  /* event loop integration - flickcurl_multi_set_socket_handler() */
+  flickcurl_multi_socket_handler socket_handler;
+  void* socket_data;
+
+  /* event loop integration - flickcurl_multi_set_timer_handler() */
+  flickcurl_multi_timer_handler timer_handler;
+  void* timer_data;
+
+  /* libcurl timer as last set by the CURLMOPT_TIMERFUNCTION callback */
+  int curl_timer_set;
+  struct timeval curl_timer_deadline;
+};
+
+
+static void flickcurl_multi_update_timer(flickcurl_multi* multi);
+
+
+/**
+ * flickcurl_new_multi:
+ *
+ * Create a Flickcurl concurrent request object
+ *
+ * A #flickcurl_multi runs web service requests from one or more
+ * #flickcurl sessions at the same time, over a single libcurl multi
+ * handle, calling a #flickcurl_multi_handler as each one completes.
+ *
+ * The per-session request delay set by flickcurl_set_request_delay()
+ * still applies: a request is not started until the delay since the
+ * previous request in the same session has passed.  Lower the delay
+ * (or use several sessions) to have more than one request in progress.
+ *
+ * Return value: new object or NULL on failure
+ */
+flickcurl_multi*
+flickcurl_new_multi(void)
+{
+  flickcurl_multi* multi;
+
+  multi=(flickcurl_multi*)calloc(1, sizeof(flickcurl_multi));
+  if(!multi)
+    return NULL;
+
+  multi->multi_handle=curl_multi_init();
+  if(!multi->multi_handle) {
+    free(multi);
+    return NULL;
+  }
+
+  multi->max_transfers=FLICKCURL_MULTI_DEFAULT_MAX_TRANSFERS;
+
+  return multi;
+}
+
+
+/**
+ * flickcurl_free_multi:
+ * @multi: flickcurl multi object
+ *
+ * Destructor for Flickcurl concurrent request object
+ *
+ * Any requests still pending or in progress are abandoned without
+ * calling their handlers.
+ */
+void
+flickcurl_free_multi(flickcurl_multi* multi)
+{
+  flickcurl_transfer* t;
+  int i;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(multi, flickcurl_multi);
+
+  while(multi->active) {
+    CURL* curl_handle;
+
+    t=multi->active;
+    multi->active=t->next;
+
+    curl_handle=t->curl_handle;
+    curl_multi_remove_handle(multi->multi_handle, curl_handle);
+    flickcurl_transfer_clear(t);
+    curl_easy_cleanup(curl_handle);
+    free(t);
+  }
+
+  while(multi->pending) {
+    t=multi->pending;
+    multi->pending=t->next;
+
+    flickcurl_transfer_clear(t);
+    free(t);
+  }
+
+  for(i=0; i < multi->idle_count; i++)
+    curl_easy_cleanup(multi->idle_handles[i]);
+  if(multi->idle_handles)
+    free(multi->idle_handles);
+
+  curl_multi_cleanup(multi->multi_handle);
+
+  free(multi);
+}
+
+
+/**
+ * flickcurl_multi_set_max_transfers:
+ * @multi: flickcurl multi object
+ * @max_transfers: maximum number of requests (>0)
+ *
+ * Set the maximum number of requests to run at once
+ *
+ * The default is 4.
+ */
+void
+flickcurl_multi_set_max_transfers(flickcurl_multi* multi, int max_transfers)
+{
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(multi, flickcurl_multi);
+
+  if(max_transfers < 1)
+    max_transfers=1;
+  multi->max_transfers=max_transfers;
+}
+
+
+int
+flickcurl_multi_add_prepared(flickcurl_multi* multi, flickcurl* fc,
+                             int want_content,
+                             flickcurl_multi_handler handler, void* user_data)
+{
+  flickcurl_transfer* t;
+  int rc=1;
+
+  t=(flickcurl_transfer*)malloc(sizeof(flickcurl_transfer));
+  if(!t) {
+    flickcurl_error(fc, "Out of memory");
+    goto tidy;
+  }
+
+  if(flickcurl_transfer_init(fc, t, want_content)) {
+    free(t);
+    goto tidy;
+  }
+
+  t->handler=handler;
+  t->handler_data=user_data;
+
+  if(multi->pending_tail)
+    multi->pending_tail->next=t;
+  else
+    multi->pending=t;
+  multi->pending_tail=t;
+  multi->pending_count++;
+  rc=0;
+
+  flickcurl_multi_update_timer(multi);
+
+  tidy:
+  /* reset special flags as flickcurl_invoke() would */
+  fc->sign=0;
+
+  return rc;
+}
+
+
+/**
+ * flickcurl_multi_add_method:
+ * @multi: flickcurl multi object
+ * @fc: flickcurl session
+ * @method: Flickr API method name such as "flickr.photos.getInfo"
+ * @parameters: array of @count (name, value) parameter pairs
+ * @count: number of parameters
+ * @want_content: non-0 to get the raw response content instead of a DOM
+ * @handler: completion handler or NULL
+ * @user_data: user data for @handler
+ *
+ * Add a Flickr API call to run concurrently
+ *
+ * The call is prepared and signed in session @fc immediately and
+ * queued to be run by flickcurl_multi_perform().  The parameters are
+ * copied and need not live beyond this call.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_multi_add_method(flickcurl_multi* multi, flickcurl* fc,
+                           const char* method,
+                           const char* parameters[][2], int count,
+                           int want_content,
+                           flickcurl_multi_handler handler, void* user_data)
+{
+  const char* (*params)[2];
+  int rc;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(multi, flickcurl_multi, 1);
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(fc, flickcurl, 1);
+
+  /* room for method, api_key, auth_token, api_sig and a NULL */
+  params=(const char* (*)[2])calloc(count+5, sizeof(*params));
+  if(!params) {
+    flickcurl_error(fc, "Out of memory");
+    return 1;
+  }
+  if(count > 0)
+    memcpy(params, parameters, count * sizeof(*params));
+  params[count][0]=NULL;
+
+  rc=flickcurl_prepare(fc, method, params, count);
+  if(!rc)
+    rc=flickcurl_multi_add_prepared(multi, fc, want_content, handler, user_data);
+
+  free(params);
+
+  return rc;
+}
+
+
+/* Get the wait in usecs until a transfer's retry time or 0 */
+static long
+flickcurl_multi_get_retry_wait(flickcurl_transfer* t)
+{
+  struct timeval now;
+  long wait;
+
+  if(!t->retry_time.tv_sec)
+    return 0;
+
+  gettimeofday(&now, NULL);
+  wait=(t->retry_time.tv_sec - now.tv_sec) * 1000000L +
+       (t->retry_time.tv_usec - now.tv_usec);
+  if(wait <= 0) {
+    t->retry_time.tv_sec=0;
+    return 0;
+  }
+
+  return wait;
+}
+
+
+/* Get the wait in usecs before any pending transfer may start or -1 */
+static long
+flickcurl_multi_get_rate_wait(flickcurl_multi* multi)
+{
+  flickcurl_transfer* t;
+  long min_wait= -1;
+
+  if(multi->active_count >= multi->max_transfers)
+    return -1;
+
+  for(t=multi->pending; t; t=t->next) {
+    long wait=flickcurl_get_current_request_wait(t->fc);
+    long retry_wait=flickcurl_multi_get_retry_wait(t);
+    if(wait < 0)
+      wait=247 * 1000000L;
+    if(retry_wait > wait)
+      wait=retry_wait;
+    if(min_wait < 0 || wait < min_wait)
+      min_wait=wait;
+    if(!min_wait)
+      break;
+  }
+
+  return min_wait;
+}
+
+
+static void
+flickcurl_multi_dispatch(flickcurl_multi* multi, flickcurl_transfer* t)
+{
+  xmlDocPtr doc=NULL;
+  const char* content=NULL;
+  size_t content_length=0;
+  int failed;
+
+  failed=flickcurl_transfer_finish(t, &doc);
+  if(!failed) {
+    content=t->content;
+    content_length=t->content_length;
+  }
+
+  if(failed) {
+    long delay=flickcurl_transfer_get_retry_delay(t);
+    if(delay >= 0) {
+      /* run again after the backoff delay */
+      flickcurl_transfer_reset(t);
+
+      gettimeofday(&t->retry_time, NULL);
+      t->retry_time.tv_sec+= delay / 1000;
+      t->retry_time.tv_usec+= 1000 * (delay % 1000);
+      if(t->retry_time.tv_usec >= 1000000) {
+        t->retry_time.tv_sec++;
+        t->retry_time.tv_usec-= 1000000;
+      }
+
+      t->next=NULL;
+      if(multi->pending_tail)
+        multi->pending_tail->next=t;
+      else
+        multi->pending=t;
+      multi->pending_tail=t;
+      multi->pending_count++;
+      return;
+    }
+  }
+
+  flickcurl_transfer_report(t);
+
+  if(!failed && content && t->cache_key && !t->rsp_failed)
+    flickcurl_cache_put(t->cache, t->cache_key, t->cache_ttl,
+                        content, content_length);
+
+  if(t->handler)
+    t->handler(t->handler_data, t->fc, failed, doc,
+               (t->xml_parse_content ? NULL : content), content_length);
+
+  /* also frees the DOM and content */
+  flickcurl_transfer_clear(t);
+  free(t);
+}
+
+
+static void
+flickcurl_multi_release_handle(flickcurl_multi* multi, CURL* curl_handle)
+{
+  if(multi->idle_count >= multi->max_transfers) {
+    curl_easy_cleanup(curl_handle);
+    return;
+  }
+
+  if(multi->idle_count == multi->idle_size) {
+    int size=multi->idle_size ? multi->idle_size * 2 : 4;
+    CURL** handles=(CURL**)realloc(multi->idle_handles, size * sizeof(CURL*));
+    if(!handles) {
+      curl_easy_cleanup(curl_handle);
+      return;
+    }
+    multi->idle_handles=handles;
+    multi->idle_size=size;
+  }
+
+  multi->idle_handles[multi->idle_count++]=curl_handle;
+}
+
+
+/* Start as many pending transfers as allowed.  Returns number started */
+static int
+flickcurl_multi_start_pending(flickcurl_multi* multi)
+{
+  flickcurl_transfer* prev=NULL;
+  flickcurl_transfer* t=multi->pending;
+  int started=0;
+
+  while(t && multi->active_count < multi->max_transfers) {
+    flickcurl_transfer* next=t->next;
+    CURL* curl_handle;
+    xmlDocPtr doc=NULL;
+    char* content=NULL;
+    size_t content_length=0;
+    int cached=0;
+
+    /* waiting to retry - try later */
+    if(flickcurl_multi_get_retry_wait(t)) {
+      prev=t;
+      t=next;
+      continue;
+    }
+
+    if(t->cache_key)
+      cached=!flickcurl_cache_get(t->cache, t->cache_key,
+                                  (t->xml_parse_content ? &doc : NULL),
+                                  (t->xml_parse_content ? NULL : &content),
+                                  &content_length);
+
+    /* session rate limit - try later */
+    if(!cached &&
+       (t->fc->rate_limiter ? flickcurl_rate_limiter_take(t->fc->rate_limiter)
+                            : flickcurl_get_current_request_wait(t->fc))) {
+      prev=t;
+      t=next;
+      continue;
+    }
+
+    /* remove from pending */
+    if(prev)
+      prev->next=next;
+    else
+      multi->pending=next;
+    if(multi->pending_tail == t)
+      multi->pending_tail=prev;
+    multi->pending_count--;
+    t->next=NULL;
+
+    if(cached) {
+      /* answered from the cache without a request */
+      flickcurl_transfer_report(t);
+      if(t->handler)
+        t->handler(t->handler_data, t->fc, 0, doc, content, content_length);
+      if(doc)
+        xmlFreeDoc(doc);
+      if(content)
+        free(content);
+      flickcurl_transfer_clear(t);
+      free(t);
+      t=next;
+      continue;
+    }
+
+    if(multi->idle_count) {
+      curl_handle=multi->idle_handles[--multi->idle_count];
+      curl_easy_reset(curl_handle);
+    } else
+      curl_handle=curl_easy_init();
+
+    if(!curl_handle) {
+      flickcurl_error(t->fc, "Failed to create curl handle");
+      t->failed=1;
+      flickcurl_multi_dispatch(multi, t);
+      t=next;
+      continue;
+    }
+
+    flickcurl_transfer_setup(t, curl_handle);
+
+    if(curl_multi_add_handle(multi->multi_handle, curl_handle) != CURLM_OK) {
+      flickcurl_error(t->fc, "Failed to start request for URI '%s'", t->uri);
+      t->failed=1;
+      flickcurl_multi_dispatch(multi, t);
+      flickcurl_multi_release_handle(multi, curl_handle);
+      t=next;
+      continue;
+    }
+
+    gettimeofday(&t->fc->last_request_time, NULL);
+
+    t->next=multi->active;
+    multi->active=t;
+    multi->active_count++;
+    started++;
+
+    t=next;
+  }
+
+  return started;
+}
+
+
+/* Handle all transfers libcurl reports as done.  Returns number done */
+static int
+flickcurl_multi_read_info(flickcurl_multi* multi)
+{
+  CURLMsg* msg;
+  int msgs_left;
+  int done=0;
+
+  while((msg=curl_multi_info_read(multi->multi_handle, &msgs_left))) {
+    CURL* curl_handle;
+    flickcurl_transfer* t=NULL;
+    flickcurl_transfer* prev;
+    flickcurl_transfer* cur;
+
+    if(msg->msg != CURLMSG_DONE)
+      continue;
+
+    curl_handle=msg->easy_handle;
+    curl_easy_getinfo(curl_handle, CURLINFO_PRIVATE, (char**)&t);
+
+    /* msg is invalid after removing the handle */
+    flickcurl_transfer_complete(t, msg->data.result);
+    curl_multi_remove_handle(multi->multi_handle, curl_handle);
+
+    for(prev=NULL, cur=multi->active; cur; prev=cur, cur=cur->next) {
+      if(cur == t) {
+        if(prev)
+          prev->next=t->next;
+        else
+          multi->active=t->next;
+        break;
+      }
+    }
+    multi->active_count--;
+    t->next=NULL;
+
+    flickcurl_multi_dispatch(multi, t);
+    flickcurl_multi_release_handle(multi, curl_handle);
+    done++;
+  }
+
+  return done;
+}
+
+
+/**
+ * flickcurl_multi_perform:
+ * @multi: flickcurl multi object
+ * @running_p: pointer to store number of requests not yet completed (or NULL)
+ *
+ * Run concurrent requests without blocking
+ *
+ * Starts pending requests as limits allow, transfers whatever data
+ * is ready and calls the handlers of completed requests.  Handlers
+ * may add further requests.  Call flickcurl_multi_wait() to wait
+ * for more work between calls.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_multi_perform(flickcurl_multi* multi, int* running_p)
+{
+  int rc=0;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(multi, flickcurl_multi, 1);
+
+  while(1) {
+    int still_running=0;
+    int started;
+    int done;
+
+    started=flickcurl_multi_start_pending(multi);
+
+    if(curl_multi_perform(multi->multi_handle, &still_running) != CURLM_OK) {
+      rc=1;
+      break;
+    }
+
+    done=flickcurl_multi_read_info(multi);
+
+    /* go round again while completions freed slots for pending requests */
+    if(!started && !done)
+      break;
+    if(!multi->pending)
+      break;
+  }
+
+  if(running_p)
+    *running_p=multi->active_count + multi->pending_count;
+
+  return rc;
+}
+
+
+/**
+ * flickcurl_multi_wait:
+ * @multi: flickcurl multi object
+ * @timeout_msec: maximum time to wait in milliseconds or <0 for no limit
+ *
+ * Wait until there is work for flickcurl_multi_perform()
+ *
+ * Waits for network activity on running requests, a libcurl timeout
+ * or for the request delay of a pending request to pass.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_multi_wait(flickcurl_multi* multi, long timeout_msec)
+{
+  long wait_msec;
+  fd_set fdread;
+  fd_set fdwrite;
+  fd_set fdexcep;
+  int maxfd= -1;
+  struct timeval tv;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(multi, flickcurl_multi, 1);
+
+  if(!multi->active && !multi->pending)
+    return 0;
+
+  wait_msec=flickcurl_multi_timeout(multi);
+  if(timeout_msec >= 0 && (wait_msec < 0 || timeout_msec < wait_msec))
+    wait_msec=timeout_msec;
+
+  if(!wait_msec)
+    return 0;
+
+#if LIBCURL_VERSION_NUM >= 0x071c00
+  /* curl_multi_fdset() leaves out sockets at or above FD_SETSIZE */
+  if(multi->active) {
+    CURLMcode mc;
+    int numfds=0;
+
+    if(wait_msec < 0)
+      wait_msec=1000;
+
+#if LIBCURL_VERSION_NUM >= 0x074200
+    /* waits for the timeout even when there are no sockets yet */
+    mc=curl_multi_poll(multi->multi_handle, NULL, 0, (int)wait_msec, &numfds);
+#else
+    mc=curl_multi_wait(multi->multi_handle, NULL, 0, (int)wait_msec, &numfds);
+#endif
+    return (mc != CURLM_OK);
+  }
+#endif
+
+  FD_ZERO(&fdread);
+  FD_ZERO(&fdwrite);
+  FD_ZERO(&fdexcep);
+
+  if(multi->active &&
+     curl_multi_fdset(multi->multi_handle, &fdread, &fdwrite, &fdexcep,
+                      &maxfd) != CURLM_OK)
+    return 1;
+
+  /* nothing to wait on (yet) - for example during name resolving */
+  if(maxfd < 0 && multi->active &&
+     (wait_msec < 0 || wait_msec > FLICKCURL_MULTI_IDLE_WAIT))
+    wait_msec=FLICKCURL_MULTI_IDLE_WAIT;
+
+  if(wait_msec < 0)
+    wait_msec=1000;
+
+  tv.tv_sec=wait_msec / 1000;
+  tv.tv_usec=(wait_msec % 1000) * 1000;
+
+#ifdef WIN32
+  /* winsock select() fails with no sockets */
+  if(maxfd < 0) {
+    Sleep(wait_msec);
+    return 0;
+  }
+#endif
+
+  if(select(maxfd+1, &fdread, &fdwrite, &fdexcep, &tv) < 0) {
+#ifdef HAVE_ERRNO_H
+    if(errno == EINTR)
+      return 0;
+#endif
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * flickcurl_multi_run:
+ * @multi: flickcurl multi object
+ *
+ * Run all concurrent requests to completion
+ *
+ * Blocks until every request added, including any added by handlers
+ * while running, has completed.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_multi_run(flickcurl_multi* multi)
+{
+  int running=0;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(multi, flickcurl_multi, 1);
+
+  do {
+    if(flickcurl_multi_perform(multi, &running))
+      return 1;
+    if(running && flickcurl_multi_wait(multi, -1))
+      return 1;
+  } while(running);
+
+  return 0;
+}
+
+
+/**
+ * flickcurl_multi_timeout:
+ * @multi: flickcurl multi object
+ *
+ * Get the time until flickcurl_multi_socket_action() (or
+ * flickcurl_multi_perform()) should next be called if no socket is ready
+ *
+ * This combines the libcurl timeouts of running requests with the
+ * time until the request delay of a pending request passes.
+ *
+ * Return value: timeout in milliseconds, 0 to call now or <0 for no timeout
+ */
+long
+flickcurl_multi_timeout(flickcurl_multi* multi)
+{
+  long timeout= -1;
+  long rate_wait;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(multi, flickcurl_multi, -1);
+
+  if(multi->timer_handler) {
+    if(multi->curl_timer_set) {
+      struct timeval now;
+
+      gettimeofday(&now, NULL);
+      timeout=(multi->curl_timer_deadline.tv_sec - now.tv_sec) * 1000 +
+              (multi->curl_timer_deadline.tv_usec - now.tv_usec) / 1000;
+      if(timeout < 0)
+        timeout=0;
+    }
+  } else if(multi->active)
+    curl_multi_timeout(multi->multi_handle, &timeout);
+
+  rate_wait=flickcurl_multi_get_rate_wait(multi);
+  if(rate_wait >= 0) {
+    /* round up to whole msecs */
+    rate_wait=(rate_wait + 999) / 1000;
+    if(timeout < 0 || rate_wait < timeout)
+      timeout=rate_wait;
+  }
+
+  return timeout;
+}
+
+
+static void
+flickcurl_multi_update_timer(flickcurl_multi* multi)
+{
+  if(multi->timer_handler)
+    multi->timer_handler(multi->timer_data, flickcurl_multi_timeout(multi));
+}
+
+
+static int
+flickcurl_multi_curl_socket_callback(CURL* easy, curl_socket_t s, int what,
+                                     void* userp, void* socketp)
+{
+  flickcurl_multi* multi=(flickcurl_multi*)userp;
+  int events=0;
+
+  if(what == CURL_POLL_REMOVE)
+    events=FLICKCURL_MULTI_POLL_REMOVE;
+  else {
+    if(what & CURL_POLL_IN)
+      events |= FLICKCURL_MULTI_POLL_IN;
+    if(what & CURL_POLL_OUT)
+      events |= FLICKCURL_MULTI_POLL_OUT;
+  }
+
+  if(multi->socket_handler)
+    multi->socket_handler(multi->socket_data, (int)s, events);
+
+  return 0;
+}
+
+
+static int
+flickcurl_multi_curl_timer_callback(CURLM* multi_handle, long timeout_ms,
+                                    void* userp)
+{
+  flickcurl_multi* multi=(flickcurl_multi*)userp;
+
+  if(timeout_ms < 0)
+    multi->curl_timer_set=0;
+  else {
+    gettimeofday(&multi->curl_timer_deadline, NULL);
+    multi->curl_timer_deadline.tv_sec += timeout_ms / 1000;
+    multi->curl_timer_deadline.tv_usec += (timeout_ms % 1000) * 1000;
+    if(multi->curl_timer_deadline.tv_usec >= 1000000) {
+      multi->curl_timer_deadline.tv_sec++;
+      multi->curl_timer_deadline.tv_usec -= 1000000;
+    }
+    multi->curl_timer_set=1;
+  }
+
+  flickcurl_multi_update_timer(multi);
+
+  return 0;
+}
+
+
+/**
+ * flickcurl_multi_set_socket_handler:
+ * @multi: flickcurl multi object
+ * @socket_handler: socket handler or NULL
+ * @socket_data: user data for @socket_handler
+ *
+ * Set the handler told which sockets to watch in an external event loop
+ *
+ * Use with flickcurl_multi_set_timer_handler() and
+ * flickcurl_multi_socket_action() instead of flickcurl_multi_perform()
+ * and flickcurl_multi_wait() to run requests from an event loop such
+ * as one based on epoll() or libuv.
+ */
+void
+flickcurl_multi_set_socket_handler(flickcurl_multi* multi,
+                                   flickcurl_multi_socket_handler socket_handler,
+                                   void* socket_data)
+{
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(multi, flickcurl_multi);
+
+  multi->socket_handler=socket_handler;
+  multi->socket_data=socket_data;
+
+  curl_multi_setopt(multi->multi_handle, CURLMOPT_SOCKETFUNCTION,
+                    socket_handler ? flickcurl_multi_curl_socket_callback : NULL);
+  curl_multi_setopt(multi->multi_handle, CURLMOPT_SOCKETDATA, multi);
+}
+
+
+/**
+ * flickcurl_multi_set_timer_handler:
+ * @multi: flickcurl multi object
+ * @timer_handler: timer handler or NULL
+ * @timer_data: user data for @timer_handler
+ *
+ * Set the handler told when to call flickcurl_multi_socket_action()
+ * with no socket from an external event loop
+ *
+ * The handler is called whenever the timeout returned by
+ * flickcurl_multi_timeout() may have changed.
+ */
+void
+flickcurl_multi_set_timer_handler(flickcurl_multi* multi,
+                                  flickcurl_multi_timer_handler timer_handler,
+                                  void* timer_data)
+{
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(multi, flickcurl_multi);
+
+  multi->timer_handler=timer_handler;
+  multi->timer_data=timer_data;
+  multi->curl_timer_set=0;
+
+  curl_multi_setopt(multi->multi_handle, CURLMOPT_TIMERFUNCTION,
+                    timer_handler ? flickcurl_multi_curl_timer_callback : NULL);
+  curl_multi_setopt(multi->multi_handle, CURLMOPT_TIMERDATA, multi);
+
+  flickcurl_multi_update_timer(multi);
+}
+
+
+/**
+ * flickcurl_multi_socket_action:
+ * @multi: flickcurl multi object
+ * @fd: ready socket or %FLICKCURL_MULTI_SOCKET_TIMEOUT when the timer expired
+ * @events: #flickcurl_multi_poll flags of the readiness of @fd
+ * @running_p: pointer to store number of requests not yet completed (or NULL)
+ *
+ * Run concurrent requests from an external event loop
+ *
+ * Call when a socket passed to the #flickcurl_multi_socket_handler is
+ * ready or when the timer set by the #flickcurl_multi_timer_handler
+ * expires.  Handlers of completed requests are called from here.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_multi_socket_action(flickcurl_multi* multi, int fd, int events,
+                              int* running_p)
+{
+  int still_running=0;
+  int rc=0;
+  CURLMcode mc;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN_VALUE(multi, flickcurl_multi, 1);
+
+  /* starting requests makes libcurl set a timer to get them going */
+  flickcurl_multi_start_pending(multi);
+
+  if(fd < 0) {
+    mc=curl_multi_socket_action(multi->multi_handle, CURL_SOCKET_TIMEOUT, 0,
+                                &still_running);
+  } else {
+    int ev_bitmask=0;
+
+    if(events & FLICKCURL_MULTI_POLL_IN)
+      ev_bitmask |= CURL_CSELECT_IN;
+    if(events & FLICKCURL_MULTI_POLL_OUT)
+      ev_bitmask |= CURL_CSELECT_OUT;
+    if(events & FLICKCURL_MULTI_POLL_ERROR)
+      ev_bitmask |= CURL_CSELECT_ERR;
+    mc=curl_multi_socket_action(multi->multi_handle, (curl_socket_t)fd,
+                                ev_bitmask, &still_running);
+  }
+  if(mc != CURLM_OK)
+    rc=1;
+
+  if(flickcurl_multi_read_info(multi))
+    flickcurl_multi_start_pending(multi);
+
+  /* report any new request delay wait */
+  flickcurl_multi_update_timer(multi);
+
+  if(running_p)
+    *running_p=multi->active_count + multi->pending_count;
+
+  return rc;
+}
@@ -242,11 +242,23 @@ flickcurl_build_persons(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlChar full_xpath[512];
   size_t xpathExpr_len;
   int i;
+  flickcurl_field_map* field_map;
+  const xmlChar** field_values=NULL;
   
   xpathExpr_len=strlen((const char*)xpathExpr);
   strncpy((char*)full_xpath, (const char*)xpathExpr, xpathExpr_len+1);
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  field_map=flickcurl_get_field_map(person_fields_table,
+                                    sizeof(person_fields_table[0]));
+  if(field_map)
+    field_values=(const xmlChar**)calloc(flickcurl_field_map_get_count(field_map),
+                                         sizeof(const xmlChar*));
+  if(!field_values) {
+    fc->failed=1;
+    goto tidy;
+  }
+
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -285,6 +297,8 @@ flickcurl_build_persons(flickcurl* fc, xmlXPathContextPtr xpathCtx,
       person->fields[expri].type   = VALUE_TYPE_NONE;
     }
 
+    flickcurl_field_map_scan(field_map, node, field_values);
+
     for(expri=0; person_fields_table[expri].xpath; expri++) {
       flickcurl_person_field_type field=person_fields_table[expri].field;
       flickcurl_field_value_type datatype=person_fields_table[expri].type;
@@ -292,8 +306,9 @@ flickcurl_build_persons(flickcurl* fc, xmlXPathContextPtr xpathCtx,
       int int_value= -1;
       time_t unix_time;
       
-      string_value=flickcurl_xpath_eval(fc, xpathNodeCtx,
-                                        person_fields_table[expri].xpath);
+      string_value=flickcurl_field_map_eval(fc, field_map, field_values,
+                                            expri, xpathNodeCtx,
+                                            person_fields_table[expri].xpath);
       if(!string_value) {
         person->fields[field].string = NULL;
         person->fields[field].integer= (flickcurl_person_field_type)-1;
@@ -374,6 +389,8 @@ flickcurl_build_persons(flickcurl* fc, xmlXPathContextPtr xpathCtx,
  tidy:
   if(xpathObj)
     xmlXPathFreeObject(xpathObj);
+  if(field_values)
+    free(field_values);
   
   if(fc->failed)
     persons=NULL;
@@ -925,6 +925,277 @@ static struct {
 };
 
 
+/*
+ * flickcurl_photo_set_field_value:
+ * @fc: flickcurl object
+ * @photo: photo
+ * @expri: index into photo_fields_table
+ * @string_value: value found for the entry (ownership taken)
+ *
+ * INTERNAL - Convert a value for a photo_fields_table entry and set it
+ */
+static void
+flickcurl_photo_set_field_value(flickcurl* fc, flickcurl_photo* photo,
+                                int expri, char* string_value,
+                                flickcurl_arena* arena)
+{
+  flickcurl_field_value_type datatype=photo_fields_table[expri].type;
+  int int_value= -1;
+  flickcurl_photo_field_type field=photo_fields_table[expri].field;
+  time_t unix_time;
+  int special = 0;
+  int pending = 0;
+
+#if FLICKCURL_DEBUG > 1
+  fprintf(stderr, "  type %d  string value '%s'\n", datatype,
+          string_value);
+#endif
+
+  switch(datatype) {
+    case VALUE_TYPE_PHOTO_ID:
+      if(photo->id && !arena)
+        free(photo->id);
+      photo->id=string_value;
+      string_value=NULL;
+      datatype=VALUE_TYPE_NONE;
+      break;
+
+    case VALUE_TYPE_PHOTO_URI:
+      if(photo->uri && !arena)
+        free(photo->uri);
+      photo->uri=string_value;
+      string_value=NULL;
+      datatype=VALUE_TYPE_NONE;
+      break;
+
+    case VALUE_TYPE_MEDIA_TYPE:
+      if(photo->media_type && !arena)
+        free(photo->media_type);
+      photo->media_type=string_value;
+      string_value=NULL;
+      datatype=VALUE_TYPE_NONE;
+      break;
+
+    case VALUE_TYPE_UNIXTIME:
+    case VALUE_TYPE_DATETIME:
+
+      if(fc->lazy_photo_fields) {
+        /* keep the raw value in a buffer that the ISO date can
+         * overwrite when flickcurl_photo_decode_field() converts it */
+        size_t len=strlen(string_value);
+        if(len < FLICKCURL_ISO_DATE_LEN) {
+          char* new_value;
+          if(arena) {
+            new_value=(char*)flickcurl_arena_alloc(arena,
+                                                   FLICKCURL_ISO_DATE_LEN + 1);
+            if(new_value)
+              memcpy(new_value, string_value, len + 1);
+          } else {
+            new_value=(char*)realloc(string_value, FLICKCURL_ISO_DATE_LEN + 1);
+            if(!new_value)
+              free(string_value);
+          }
+          string_value=new_value;
+        }
+        if(string_value)
+          pending=1;
+        else
+          datatype=VALUE_TYPE_NONE;
+        break;
+      }
+
+      if(datatype == VALUE_TYPE_UNIXTIME)
+        unix_time=atoi(string_value);
+      else
+        unix_time=curl_getdate((const char*)string_value, NULL);
+
+      if(unix_time >= 0) {
+        char* new_value=flickcurl_unixtime_to_isotime(unix_time);
+#if FLICKCURL_DEBUG > 1
+        fprintf(stderr, "  date from: '%s' unix time %ld to '%s'\n",
+                string_value, (long)unix_time, new_value);
+#endif
+        if(arena) {
+          string_value=NULL;
+          if(new_value) {
+            string_value=flickcurl_arena_strndup(arena, new_value,
+                                                 strlen(new_value));
+            free(new_value);
+          }
+        } else {
+          free(string_value);
+          string_value= new_value;
+        }
+        int_value= (int)unix_time;
+        datatype=VALUE_TYPE_DATETIME;
+      } else
+        /* failed to convert, make it a string */
+        datatype=VALUE_TYPE_STRING;
+      break;
+
+    case VALUE_TYPE_INTEGER:
+    case VALUE_TYPE_BOOLEAN:
+      int_value=atoi(string_value);
+      break;
+
+    case VALUE_TYPE_TAG_STRING:
+      /* A space-separated list of tags */
+      photo->tags = flickcurl_build_tags_from_string(fc, photo,
+                                                     (const char*)string_value,
+                                                     &photo->tags_count,
+                                                     arena);
+      special = 1;
+      break;
+
+
+    case VALUE_TYPE_NONE:
+    case VALUE_TYPE_STRING:
+    case VALUE_TYPE_FLOAT:
+    case VALUE_TYPE_URI:
+      break;
+
+    case VALUE_TYPE_PERSON_ID:
+    case VALUE_TYPE_COLLECTION_ID:
+    case VALUE_TYPE_ICON_PHOTOS:
+      abort();
+  }
+
+  if(special) {
+    if(!arena)
+      free(string_value);
+    return;
+  }
+
+  /* a later table entry for the same field replaces an earlier one */
+  if(photo->fields[field].string && !arena)
+    free(photo->fields[field].string);
+
+  photo->fields[field].string = string_value;
+  photo->fields[field].integer= (flickcurl_photo_field_type)int_value;
+  photo->fields[field].type   = datatype;
+
+  if(pending)
+    photo->fields_pending[field / 32] |= (1U << (field % 32));
+  else
+    photo->fields_pending[field / 32] &= ~(1U << (field % 32));
+
+#if FLICKCURL_DEBUG > 1
+  fprintf(stderr, "field %d with %s value: '%s' / %d\n",
+          field, flickcurl_get_field_value_type_label(datatype), 
+          string_value, int_value);
+#endif
+}
+
+
+/*
+ * flickcurl_photo_decode_field:
+ * @photo: photo
+ * @field: field
+ *
+ * INTERNAL - Convert a field value kept raw by lazy field decoding
+ *
+ * Does the date conversion that flickcurl_photo_set_field_value()
+ * would have done, in place in the raw value buffer.
+ */
+static void
+flickcurl_photo_decode_field(flickcurl_photo* photo,
+                             flickcurl_photo_field_type field)
+{
+  flickcurl_photo_field* f=&photo->fields[field];
+  time_t unix_time;
+
+  if(!(photo->fields_pending[field / 32] & (1U << (field % 32))))
+    return;
+  photo->fields_pending[field / 32] &= ~(1U << (field % 32));
+
+  if(f->type == VALUE_TYPE_UNIXTIME)
+    unix_time=atoi(f->string);
+  else
+    unix_time=curl_getdate((const char*)f->string, NULL);
+
+  if(unix_time >= 0 &&
+     !flickcurl_unixtime_format_isotime(unix_time, f->string)) {
+    f->integer=(flickcurl_photo_field_type)(int)unix_time;
+    f->type=VALUE_TYPE_DATETIME;
+  } else
+    /* failed to convert, make it a string */
+    f->type=VALUE_TYPE_STRING;
+}
+
+
+/**
+ * flickcurl_photo_get_field_string:
+ * @photo: photo
+ * @field: field
+ *
+ * Get the string value of a photo field
+ *
+ * Use this rather than reading @fields directly when the photo was
+ * made with flickcurl_set_lazy_photo_fields() enabled.  The first
+ * call for a field may convert the stored value so calls for the
+ * same photo must not be made from several threads at once.
+ *
+ * Return value: shared string value or NULL if the field is not set
+ */
+const char*
+flickcurl_photo_get_field_string(flickcurl_photo* photo,
+                                 flickcurl_photo_field_type field)
+{
+  if(field < 0 || field > PHOTO_FIELD_LAST)
+    return NULL;
+  flickcurl_photo_decode_field(photo, field);
+  return photo->fields[field].string;
+}
+
+
+/**
+ * flickcurl_photo_get_field_integer:
+ * @photo: photo
+ * @field: field
+ *
+ * Get the integer value of a photo field
+ *
+ * See flickcurl_photo_get_field_string() for when to use this.
+ *
+ * Return value: integer value or -1 if the field has none
+ */
+int
+flickcurl_photo_get_field_integer(flickcurl_photo* photo,
+                                  flickcurl_photo_field_type field)
+{
+  if(field < 0 || field > PHOTO_FIELD_LAST)
+    return -1;
+  flickcurl_photo_decode_field(photo, field);
+  if(!photo->fields[field].string)
+    return -1;
+  return (int)photo->fields[field].integer;
+}
+
+
+/**
+ * flickcurl_photo_get_field_type:
+ * @photo: photo
+ * @field: field
+ *
+ * Get the value type of a photo field
+ *
+ * See flickcurl_photo_get_field_string() for when to use this.
+ *
+ * Return value: value type or VALUE_TYPE_NONE if the field is not set
+ */
+flickcurl_field_value_type
+flickcurl_photo_get_field_type(flickcurl_photo* photo,
+                               flickcurl_photo_field_type field)
+{
+  if(field < 0 || field > PHOTO_FIELD_LAST)
+    return VALUE_TYPE_NONE;
+  flickcurl_photo_decode_field(photo, field);
+  if(!photo->fields[field].string)
+    return VALUE_TYPE_NONE;
+  return photo->fields[field].type;
+}
+
+
 flickcurl_photo**
 flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx,
                        const xmlChar* xpathExpr, int* photo_count_p)
@@ -937,11 +1208,23 @@ flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlChar full_xpath[512];
   size_t xpathExpr_len;
   int i;
+  flickcurl_field_map* field_map;
+  const xmlChar** field_values=NULL;
   
   xpathExpr_len=strlen((const char*)xpathExpr);
   strncpy((char*)full_xpath, (const char*)xpathExpr, xpathExpr_len+1);
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  field_map=flickcurl_get_field_map(photo_fields_table,
+                                    sizeof(photo_fields_table[0]));
+  if(field_map)
+    field_values=(const xmlChar**)calloc(flickcurl_field_map_get_count(field_map),
+                                         sizeof(const xmlChar*));
+  if(!field_values) {
+    fc->failed=1;
+    goto tidy;
+  }
+
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -980,103 +1263,19 @@ flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx,
       photo->fields[expri].type   = VALUE_TYPE_NONE;
     }
 
+    /* one pass over the attributes and children for most fields */
+    flickcurl_field_map_scan(field_map, node, field_values);
+
     for(expri=0; photo_fields_table[expri].xpath; expri++) {
       char *string_value;
-      flickcurl_field_value_type datatype=photo_fields_table[expri].type;
-      int int_value= -1;
-      flickcurl_photo_field_type field=photo_fields_table[expri].field;
-      time_t unix_time;
-      int special = 0;
       
-      string_value=flickcurl_xpath_eval(fc, xpathNodeCtx,
-                                        photo_fields_table[expri].xpath);
+      string_value=flickcurl_field_map_eval(fc, field_map, field_values,
+                                            expri, xpathNodeCtx,
+                                            photo_fields_table[expri].xpath);
       if(!string_value)
         continue;
 
-#if FLICKCURL_DEBUG > 1
-        fprintf(stderr, "  type %d  string value '%s'\n", datatype,
-                string_value);
-#endif
-      switch(datatype) {
-        case VALUE_TYPE_PHOTO_ID:
-          photo->id=string_value;
-          string_value=NULL;
-          datatype=VALUE_TYPE_NONE;
-          break;
-
-        case VALUE_TYPE_PHOTO_URI:
-          photo->uri=string_value;
-          string_value=NULL;
-          datatype=VALUE_TYPE_NONE;
-          break;
-
-        case VALUE_TYPE_MEDIA_TYPE:
-          photo->media_type=string_value;
-          string_value=NULL;
-          datatype=VALUE_TYPE_NONE;
-          break;
-
-        case VALUE_TYPE_UNIXTIME:
-        case VALUE_TYPE_DATETIME:
-
-          if(datatype == VALUE_TYPE_UNIXTIME)
-            unix_time=atoi(string_value);
-          else
-            unix_time=curl_getdate((const char*)string_value, NULL);
-
-          if(unix_time >= 0) {
-            char* new_value=flickcurl_unixtime_to_isotime(unix_time);
-#if FLICKCURL_DEBUG > 1
-            fprintf(stderr, "  date from: '%s' unix time %ld to '%s'\n",
-                    string_value, (long)unix_time, new_value);
-#endif
-            free(string_value);
-            string_value= new_value;
-            int_value= (int)unix_time;
-            datatype=VALUE_TYPE_DATETIME;
-          } else
-            /* failed to convert, make it a string */
-            datatype=VALUE_TYPE_STRING;
-          break;
-
-        case VALUE_TYPE_INTEGER:
-        case VALUE_TYPE_BOOLEAN:
-          int_value=atoi(string_value);
-          break;
-
-        case VALUE_TYPE_TAG_STRING:
-          /* A space-separated list of tags */
-          photo->tags = flickcurl_build_tags_from_string(fc, photo,
-                                                         (const char*)string_value,
-                                                         &photo->tags_count);
-          special = 1;
-          break;
-
-
-        case VALUE_TYPE_NONE:
-        case VALUE_TYPE_STRING:
-        case VALUE_TYPE_FLOAT:
-        case VALUE_TYPE_URI:
-          break;
-
-        case VALUE_TYPE_PERSON_ID:
-        case VALUE_TYPE_COLLECTION_ID:
-        case VALUE_TYPE_ICON_PHOTOS:
-          abort();
-      }
-
-      if(special)
-        continue;
-
-      photo->fields[field].string = string_value;
-      photo->fields[field].integer= (flickcurl_photo_field_type)int_value;
-      photo->fields[field].type   = datatype;
-
-  #if FLICKCURL_DEBUG > 1
-      fprintf(stderr, "field %d with %s value: '%s' / %d\n",
-              field, flickcurl_get_field_value_type_label(datatype), 
-              string_value, int_value);
-  #endif
+      flickcurl_photo_set_field_value(fc, photo, expri, string_value, NULL);
 
       if(fc->failed)
         goto tidy;
@@ -1111,6 +1310,8 @@ flickcurl_build_photos(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   tidy:
   if(xpathObj)
     xmlXPathFreeObject(xpathObj);
+  if(field_values)
+    free(field_values);
   if(fc->failed)
     photos=NULL;
 
@@ -1135,6 +1336,863 @@ flickcurl_build_photo(flickcurl* fc, xmlXPathContextPtr xpathCtx)
 }
 
 
+/* Most elements in the path from the root to a photo element */
+#define PHOTOS_SAX_MAX_PATH 8
+
+/* Longest element path below a photo element */
+#define PHOTOS_SAX_MAX_REL_PATH 128
+
+/* A photo_fields_table XPath split up for matching SAX events */
+typedef struct {
+  /* element path below the photo such as "location/region" or "" */
+  char path[48];
+  /* attribute name or "" for the element text */
+  char attr[24];
+  /* optional [@pred_attr="pred_value"] on the last element */
+  char pred_attr[16];
+  char pred_value[16];
+} flickcurl_photos_sax_field;
+
+typedef struct {
+  flickcurl* fc;
+  /* allocate photos, tags and strings from here if not NULL */
+  flickcurl_arena* arena;
+
+  /* element names from the root to the photo elements */
+  char* path[PHOTOS_SAX_MAX_PATH];
+  int path_count;
+  /* number of leading @path elements currently open */
+  int matched;
+
+  flickcurl_photos_sax_field* fields;
+  flickcurl_field_map* field_map;
+
+  flickcurl_photo** photos;
+  int photos_count;
+  int photos_size;
+
+  /* page attributes of the element containing the photos or -1 */
+  int page;
+  int per_page;
+  int pages;
+  int total;
+
+  /* photo being built, its depth and which table entry set each field */
+  flickcurl_photo* photo;
+  int photo_depth;
+  int field_source[PHOTO_FIELD_LAST + 1];
+  /* table entries already seen for this photo - XPath takes the first */
+  char* entry_seen;
+
+  /* element path below the photo */
+  char rel_path[PHOTOS_SAX_MAX_REL_PATH];
+  size_t rel_path_len[PHOTOS_SAX_MAX_PATH * 2];
+  int rel_depth;
+  /* depth below the photo beyond @rel_path that is not tracked */
+  int rel_overflow;
+
+  /* text of an open element wanted by a table entry or tag */
+  int text_depth;
+  int text_expri;
+  int text_child_seen;
+  char* text;
+  size_t text_len;
+  size_t text_size;
+
+  /* tags from tags/tag elements */
+  flickcurl_tag** tags;
+  int tags_count;
+  int tags_size;
+  flickcurl_tag* tag;
+  int tag_saw_clean;
+  int tag_text_kind; /* 1: cooked 2: raw */
+} flickcurl_photos_sax;
+
+
+/* Split an XPath from photo_fields_table; returns non-0 if unsupported */
+static int
+flickcurl_photos_sax_compile_field(const char* xpath,
+                                   flickcurl_photos_sax_field* field)
+{
+  const char* p=xpath;
+  const char* last;
+  const char* pred;
+  size_t len;
+
+  memset(field, '\0', sizeof(*field));
+
+  if(strncmp(p, "./", 2))
+    return 1;
+  p+=2;
+
+  last=strrchr(p, '/');
+  last=last ? last + 1 : p;
+
+  if(*last == '@') {
+    len=strlen(last + 1);
+    if(len >= sizeof(field->attr))
+      return 1;
+    memcpy(field->attr, last + 1, len + 1);
+    len=(last == p) ? 0 : (size_t)(last - p - 1);
+  } else
+    len=strlen(p);
+
+  pred=(const char*)memchr(p, '[', len);
+  if(pred) {
+    /* [@name="value"] */
+    const char* eq=strchr(pred, '=');
+    const char* q;
+    if(pred[1] != '@' || !eq || eq[1] != '"')
+      return 1;
+    q=strchr(eq + 2, '"');
+    if(!q || (size_t)(eq - pred - 2) >= sizeof(field->pred_attr) ||
+       (size_t)(q - eq - 2) >= sizeof(field->pred_value))
+      return 1;
+    memcpy(field->pred_attr, pred + 2, eq - pred - 2);
+    memcpy(field->pred_value, eq + 2, q - eq - 2);
+    len=pred - p;
+  }
+
+  if(len >= sizeof(field->path))
+    return 1;
+  memcpy(field->path, p, len);
+  field->path[len]='\0';
+
+  return 0;
+}
+
+
+static char*
+flickcurl_photos_sax_strndup(flickcurl_photos_sax* ps, const xmlChar* value,
+                             const xmlChar* end)
+{
+  size_t len=end - value;
+  char* s;
+
+  if(ps->arena)
+    return flickcurl_arena_strndup(ps->arena, (const char*)value, len);
+
+  s=(char*)malloc(len + 1);
+  if(s) {
+    memcpy(s, value, len);
+    s[len]='\0';
+  }
+  return s;
+}
+
+
+/* copy a value that is likely to repeat; shared if the arena interns */
+static char*
+flickcurl_photos_sax_intern(flickcurl_photos_sax* ps, const xmlChar* value,
+                            const xmlChar* end)
+{
+  if(ps->arena)
+    return flickcurl_arena_intern(ps->arena, (const char*)value, end - value);
+
+  return flickcurl_photos_sax_strndup(ps, value, end);
+}
+
+
+/* photo fields whose values are copied rather than interned */
+static const flickcurl_photo_field_type flickcurl_photos_sax_unshared_fields[]={
+  PHOTO_FIELD_dateuploaded,
+  PHOTO_FIELD_dates_lastupdate,
+  PHOTO_FIELD_dates_posted,
+  PHOTO_FIELD_dates_taken,
+  PHOTO_FIELD_description,
+  PHOTO_FIELD_location_latitude,
+  PHOTO_FIELD_location_longitude,
+  PHOTO_FIELD_originalsecret,
+  PHOTO_FIELD_secret,
+  PHOTO_FIELD_title,
+  PHOTO_FIELD_views,
+  PHOTO_FIELD_none
+};
+
+
+/* copy a value for a photo_fields_table entry, sharing repeated ones */
+static char*
+flickcurl_photos_sax_field_strndup(flickcurl_photos_sax* ps, int expri,
+                                   const xmlChar* value, const xmlChar* end)
+{
+  flickcurl_field_value_type datatype=photo_fields_table[expri].type;
+  flickcurl_photo_field_type field=photo_fields_table[expri].field;
+  int i;
+
+  if(datatype == VALUE_TYPE_PHOTO_ID || datatype == VALUE_TYPE_PHOTO_URI)
+    return flickcurl_photos_sax_strndup(ps, value, end);
+
+  /* fields that are rarely the same for two photos are not worth it */
+  for(i=0; flickcurl_photos_sax_unshared_fields[i] != PHOTO_FIELD_none; i++) {
+    if(flickcurl_photos_sax_unshared_fields[i] == field)
+      return flickcurl_photos_sax_strndup(ps, value, end);
+  }
+
+  return flickcurl_photos_sax_intern(ps, value, end);
+}
+
+
+/* find attribute @name in SAX2 attributes; returns value and sets @end_p */
+static const xmlChar*
+flickcurl_photos_sax_get_attribute(int nb_attributes,
+                                   const xmlChar** attributes,
+                                   const char* name, const xmlChar** end_p)
+{
+  int i;
+
+  for(i=0; i < nb_attributes; i++) {
+    const xmlChar** attr=&attributes[i * 5];
+    if(!strcmp((const char*)attr[0], name)) {
+      *end_p=attr[4];
+      return attr[3];
+    }
+  }
+  return NULL;
+}
+
+
+static void
+flickcurl_photos_sax_set_field(flickcurl_photos_sax* ps, int expri,
+                               char* value)
+{
+  flickcurl_photo_field_type field=photo_fields_table[expri].field;
+
+  ps->entry_seen[expri]=1;
+
+  /* the DOM builder applies table entries in order so a later entry wins */
+  if(field != PHOTO_FIELD_none && ps->field_source[field] > expri) {
+    if(!ps->arena)
+      free(value);
+    return;
+  }
+  if(field != PHOTO_FIELD_none)
+    ps->field_source[field]=expri;
+
+  flickcurl_photo_set_field_value(ps->fc, ps->photo, expri, value, ps->arena);
+}
+
+
+static void
+flickcurl_photos_sax_text_reset(flickcurl_photos_sax* ps)
+{
+  ps->text_depth= -1;
+  ps->text_expri= -1;
+  ps->text_child_seen=0;
+  ps->text_len=0;
+}
+
+
+static void
+flickcurl_photos_sax_start_photo(flickcurl_photos_sax* ps, int depth,
+                                 int nb_attributes,
+                                 const xmlChar** attributes)
+{
+  int i;
+
+  if(ps->arena)
+    ps->photo=(flickcurl_photo*)flickcurl_arena_calloc(ps->arena, 1,
+                                                       sizeof(flickcurl_photo));
+  else
+    ps->photo=(flickcurl_photo*)calloc(sizeof(flickcurl_photo), 1);
+  if(!ps->photo) {
+    ps->fc->failed=1;
+    return;
+  }
+
+  for(i=0; i <= PHOTO_FIELD_LAST; i++) {
+    ps->photo->fields[i].integer= (flickcurl_photo_field_type)-1;
+    ps->photo->fields[i].type   = VALUE_TYPE_NONE;
+    ps->field_source[i]= -1;
+  }
+  for(i=0; photo_fields_table[i].xpath; i++)
+    ps->entry_seen[i]=0;
+
+  ps->photo_depth=depth;
+  ps->rel_depth=0;
+  ps->rel_overflow=0;
+  ps->rel_path[0]='\0';
+  ps->tags_count=0;
+}
+
+
+static void
+flickcurl_photos_sax_end_photo(flickcurl_photos_sax* ps)
+{
+  flickcurl* fc=ps->fc;
+  flickcurl_photo* photo=ps->photo;
+  int i;
+
+  ps->photo=NULL;
+
+  if(!photo->tags) {
+    /* tags/tag elements, as the DOM builder does with no tags attribute */
+    if(ps->arena)
+      photo->tags=(flickcurl_tag**)flickcurl_arena_calloc(ps->arena,
+                                                          ps->tags_count + 1,
+                                                          sizeof(flickcurl_tag*));
+    else
+      photo->tags=(flickcurl_tag**)calloc(sizeof(flickcurl_tag*),
+                                          ps->tags_count + 1);
+    if(photo->tags) {
+      for(i=0; i < ps->tags_count; i++) {
+        photo->tags[i]=ps->tags[i];
+        if(fc->tag_handler)
+          fc->tag_handler(fc->tag_data, ps->tags[i]);
+      }
+      photo->tags_count=ps->tags_count;
+      ps->tags_count=0;
+    }
+  }
+  if(!ps->arena) {
+    for(i=0; i < ps->tags_count; i++)
+      flickcurl_free_tag(ps->tags[i]);
+  }
+  ps->tags_count=0;
+
+  if(!photo->media_type) {
+    photo->media_type=flickcurl_photos_sax_intern(ps,
+                                                  (const xmlChar*)"photo",
+                                                  (const xmlChar*)"photo" + 5);
+  }
+
+  if(ps->photos_count + 1 >= ps->photos_size) {
+    int size=ps->photos_size ? ps->photos_size * 2 : 16;
+    flickcurl_photo** photos;
+    photos=(flickcurl_photo**)realloc(ps->photos,
+                                      sizeof(flickcurl_photo*) * size);
+    if(!photos) {
+      if(!ps->arena)
+        flickcurl_free_photo(photo);
+      fc->failed=1;
+      return;
+    }
+    ps->photos=photos;
+    ps->photos_size=size;
+  }
+  ps->photos[ps->photos_count++]=photo;
+  ps->photos[ps->photos_count]=NULL;
+}
+
+
+/* set fields from the photo element attributes with one lookup each */
+static void
+flickcurl_photos_sax_photo_attributes(flickcurl_photos_sax* ps,
+                                      int nb_attributes,
+                                      const xmlChar** attributes)
+{
+  int i;
+
+  for(i=0; i < nb_attributes; i++) {
+    const xmlChar** attr=&attributes[i * 5];
+    int expri;
+
+    for(expri=flickcurl_field_map_lookup(ps->field_map, NULL, attr[0]);
+        expri >= 0;
+        expri=flickcurl_field_map_next(ps->field_map, expri)) {
+      char* s;
+
+      if(ps->entry_seen[expri])
+        continue;
+
+      s=flickcurl_photos_sax_field_strndup(ps, expri, attr[3], attr[4]);
+      if(!s) {
+        ps->fc->failed=1;
+        return;
+      }
+      flickcurl_photos_sax_set_field(ps, expri, s);
+    }
+  }
+}
+
+
+/* element below the photo element (or the photo element itself) */
+static void
+flickcurl_photos_sax_photo_element(flickcurl_photos_sax* ps,
+                                   const char* name, int nb_attributes,
+                                   const xmlChar** attributes)
+{
+  const char* rel_path=ps->rel_path;
+  int expri;
+
+  if(!rel_path[0]) {
+    /* fields of the photo element itself are all attributes */
+    flickcurl_photos_sax_photo_attributes(ps, nb_attributes, attributes);
+  } else {
+    for(expri=0; photo_fields_table[expri].xpath; expri++) {
+      flickcurl_photos_sax_field* f=&ps->fields[expri];
+      const xmlChar* value;
+      const xmlChar* end;
+
+      if(ps->entry_seen[expri] || strcmp(f->path, rel_path))
+        continue;
+
+      if(f->pred_attr[0]) {
+        value=flickcurl_photos_sax_get_attribute(nb_attributes, attributes,
+                                                 f->pred_attr, &end);
+        if(!value || strlen(f->pred_value) != (size_t)(end - value) ||
+           strncmp((const char*)value, f->pred_value, end - value))
+          continue;
+      }
+
+      if(f->attr[0]) {
+        value=flickcurl_photos_sax_get_attribute(nb_attributes, attributes,
+                                                 f->attr, &end);
+        if(value) {
+          char* s=flickcurl_photos_sax_field_strndup(ps, expri, value, end);
+          if(!s) {
+            ps->fc->failed=1;
+            return;
+          }
+          flickcurl_photos_sax_set_field(ps, expri, s);
+        }
+      } else if(ps->text_expri < 0) {
+        /* collect element text; the first matching entry takes it */
+        ps->text_expri=expri;
+        ps->text_depth=ps->rel_depth;
+      }
+    }
+  }
+
+  if(!strcmp(rel_path, "tags/tag")) {
+    flickcurl_tag* t;
+    int i;
+
+    if(ps->arena)
+      t=(flickcurl_tag*)flickcurl_arena_calloc(ps->arena, 1,
+                                               sizeof(flickcurl_tag));
+    else
+      t=(flickcurl_tag*)calloc(sizeof(flickcurl_tag), 1);
+    if(!t) {
+      ps->fc->failed=1;
+      return;
+    }
+    t->photo=ps->photo;
+    ps->tag_saw_clean=0;
+
+    for(i=0; i < nb_attributes; i++) {
+      const xmlChar** attr=&attributes[i * 5];
+      const char* attr_name=(const char*)attr[0];
+      char* attr_value=flickcurl_photos_sax_intern(ps, attr[3], attr[4]);
+
+      if(!attr_value)
+        continue;
+      if(!strcmp(attr_name, "id"))
+        t->id=attr_value;
+      else if(!strcmp(attr_name, "author"))
+        t->author=attr_value;
+      else if(!strcmp(attr_name, "authorname"))
+        t->authorname=attr_value;
+      else if(!strcmp(attr_name, "raw"))
+        t->raw=attr_value;
+      else if(!strcmp(attr_name, "clean")) {
+        t->cooked=attr_value;
+        ps->tag_saw_clean=1;
+      } else {
+        if(!strcmp(attr_name, "machine_tag"))
+          t->machine_tag=atoi(attr_value);
+        else if(!strcmp(attr_name, "count") || !strcmp(attr_name, "score"))
+          t->count=atoi(attr_value);
+        if(!ps->arena)
+          free(attr_value);
+      }
+    }
+
+    ps->tag=t;
+    if(!ps->tag_saw_clean && ps->text_expri < 0) {
+      ps->text_depth=ps->rel_depth;
+      ps->tag_text_kind=1;
+    }
+  } else if(ps->tag && ps->tag_saw_clean && !strcmp(rel_path, "tags/tag/raw")) {
+    if(ps->text_expri < 0) {
+      ps->text_depth=ps->rel_depth;
+      ps->tag_text_kind=2;
+    }
+  } else if(!strcmp(rel_path, "video")) {
+    flickcurl_photo* photo=ps->photo;
+    int i;
+
+    if(!photo->video) {
+      if(ps->arena)
+        photo->video=(flickcurl_video*)flickcurl_arena_calloc(ps->arena, 1,
+                                                              sizeof(flickcurl_video));
+      else
+        photo->video=(flickcurl_video*)calloc(1, sizeof(flickcurl_video));
+      if(!photo->video) {
+        ps->fc->failed=1;
+        return;
+      }
+    }
+
+    for(i=0; i < nb_attributes; i++) {
+      const xmlChar** attr=&attributes[i * 5];
+      const char* attr_name=(const char*)attr[0];
+      int attr_value=atoi((const char*)attr[3]);
+      if(!strcmp(attr_name, "ready"))
+        photo->video->ready=attr_value;
+      else if(!strcmp(attr_name, "failed"))
+        photo->video->failed=attr_value;
+      else if(!strcmp(attr_name, "pending"))
+        photo->video->pending=attr_value;
+      else if(!strcmp(attr_name, "duration"))
+        photo->video->duration=attr_value;
+      else if(!strcmp(attr_name, "width"))
+        photo->video->width=attr_value;
+      else if(!strcmp(attr_name, "height"))
+        photo->video->height=attr_value;
+    }
+  }
+}
+
+
+/* page, perpage, pages and total of the element containing the photos */
+static void
+flickcurl_photos_sax_page_attributes(flickcurl_photos_sax* ps,
+                                     int nb_attributes,
+                                     const xmlChar** attributes)
+{
+  int i;
+
+  for(i=0; i < nb_attributes; i++) {
+    const char* attr=(const char*)attributes[i * 5];
+    const char* value=(const char*)attributes[i * 5 + 3];
+    int* int_p=NULL;
+
+    if(!strcmp(attr, "page"))
+      int_p=&ps->page;
+    else if(!strcmp(attr, "perpage") || !strcmp(attr, "per_page"))
+      int_p=&ps->per_page;
+    else if(!strcmp(attr, "pages"))
+      int_p=&ps->pages;
+    else if(!strcmp(attr, "total"))
+      int_p=&ps->total;
+
+    /* values are not NUL terminated */
+    if(int_p) {
+      int n=0;
+
+      for(; value < (const char*)attributes[i * 5 + 4] &&
+            *value >= '0' && *value <= '9'; value++)
+        n=n * 10 + (*value - '0');
+      *int_p=n;
+    }
+  }
+}
+
+
+static void
+flickcurl_photos_sax_start(void* user_data, int depth, const xmlChar* name,
+                           int nb_attributes, const xmlChar** attributes)
+{
+  flickcurl_photos_sax* ps=(flickcurl_photos_sax*)user_data;
+
+  if(ps->fc->failed)
+    return;
+
+  if(!ps->photo) {
+    if(depth == ps->matched && depth < ps->path_count &&
+       !strcmp((const char*)name, ps->path[depth])) {
+      ps->matched++;
+      if(ps->matched == ps->path_count - 1)
+        flickcurl_photos_sax_page_attributes(ps, nb_attributes, attributes);
+      else if(ps->matched == ps->path_count) {
+        flickcurl_photos_sax_start_photo(ps, depth, nb_attributes, attributes);
+        if(ps->photo)
+          flickcurl_photos_sax_photo_element(ps, (const char*)name,
+                                             nb_attributes, attributes);
+      }
+    }
+    return;
+  }
+
+  /* below the photo element: track the relative element path */
+  if(ps->text_depth >= 0)
+    ps->text_child_seen=1;
+
+  if(ps->rel_overflow ||
+     ps->rel_depth + 1 >= (int)(sizeof(ps->rel_path_len) / sizeof(size_t))) {
+    ps->rel_overflow++;
+    return;
+  } else {
+    size_t len=strlen(ps->rel_path);
+    size_t name_len=strlen((const char*)name);
+
+    if(len + name_len + 2 > sizeof(ps->rel_path)) {
+      ps->rel_overflow++;
+      return;
+    }
+    ps->rel_path_len[ps->rel_depth++]=len;
+    if(len)
+      ps->rel_path[len++]='/';
+    memcpy(ps->rel_path + len, name, name_len + 1);
+  }
+
+  flickcurl_photos_sax_photo_element(ps, (const char*)name, nb_attributes,
+                                     attributes);
+}
+
+
+static void
+flickcurl_photos_sax_end(void* user_data, int depth, const xmlChar* name)
+{
+  flickcurl_photos_sax* ps=(flickcurl_photos_sax*)user_data;
+
+  if(ps->fc->failed)
+    return;
+
+  if(!ps->photo) {
+    if(depth < ps->matched)
+      ps->matched=depth;
+    return;
+  }
+
+  if(ps->rel_overflow) {
+    ps->rel_overflow--;
+    return;
+  }
+
+  if(ps->text_depth == ps->rel_depth) {
+    /* XPath string of the first text child, if any */
+    if(ps->text_len) {
+      const xmlChar* text=(const xmlChar*)ps->text;
+      char* s;
+
+      if(ps->text_expri >= 0)
+        s=flickcurl_photos_sax_field_strndup(ps, ps->text_expri, text,
+                                             text + ps->text_len);
+      else
+        s=flickcurl_photos_sax_intern(ps, text, text + ps->text_len);
+      if(!s)
+        ps->fc->failed=1;
+      else if(ps->text_expri >= 0)
+        flickcurl_photos_sax_set_field(ps, ps->text_expri, s);
+      else if(ps->tag_text_kind == 1)
+        ps->tag->cooked=s;
+      else if(ps->tag_text_kind == 2) {
+        if(ps->tag->raw && !ps->arena)
+          free(ps->tag->raw);
+        ps->tag->raw=s;
+      }
+      else if(!ps->arena)
+        free(s);
+    }
+    flickcurl_photos_sax_text_reset(ps);
+    ps->tag_text_kind=0;
+  }
+
+  if(ps->tag && !strcmp(ps->rel_path, "tags/tag")) {
+    if(ps->tags_count == ps->tags_size) {
+      int size=ps->tags_size ? ps->tags_size * 2 : 8;
+      flickcurl_tag** tags;
+      tags=(flickcurl_tag**)realloc(ps->tags, sizeof(flickcurl_tag*) * size);
+      if(!tags) {
+        if(!ps->arena)
+          flickcurl_free_tag(ps->tag);
+        ps->tag=NULL;
+        ps->fc->failed=1;
+        return;
+      }
+      ps->tags=tags;
+      ps->tags_size=size;
+    }
+    ps->tags[ps->tags_count++]=ps->tag;
+    ps->tag=NULL;
+  }
+
+  if(!ps->rel_depth) {
+    /* end of the photo element */
+    flickcurl_photos_sax_end_photo(ps);
+    if(depth < ps->matched)
+      ps->matched=depth;
+    return;
+  }
+
+  ps->rel_path[ps->rel_path_len[--ps->rel_depth]]='\0';
+}
+
+
+static void
+flickcurl_photos_sax_text(void* user_data, const xmlChar* text, int len)
+{
+  flickcurl_photos_sax* ps=(flickcurl_photos_sax*)user_data;
+
+  /* only the text before any child element, like the DOM first child */
+  if(ps->text_depth < 0 || ps->text_child_seen || ps->rel_overflow)
+    return;
+
+  if(ps->text_len + len + 1 > ps->text_size) {
+    size_t size=ps->text_size ? ps->text_size * 2 : 256;
+    char* text_buf;
+    while(size < ps->text_len + len + 1)
+      size*=2;
+    text_buf=(char*)realloc(ps->text, size);
+    if(!text_buf) {
+      ps->fc->failed=1;
+      return;
+    }
+    ps->text=text_buf;
+    ps->text_size=size;
+  }
+  memcpy(ps->text + ps->text_len, text, len);
+  ps->text_len+=len;
+}
+
+
+static void
+flickcurl_photos_sax_clear(flickcurl_photos_sax* ps)
+{
+  int i;
+
+  /* arena objects are released with the arena */
+  if(!ps->arena) {
+    if(ps->photo)
+      flickcurl_free_photo(ps->photo);
+    if(ps->tag)
+      flickcurl_free_tag(ps->tag);
+    for(i=0; i < ps->tags_count; i++)
+      flickcurl_free_tag(ps->tags[i]);
+    if(ps->photos) {
+      for(i=0; i < ps->photos_count; i++)
+        flickcurl_free_photo(ps->photos[i]);
+    }
+  }
+  ps->photo=NULL;
+  ps->tag=NULL;
+  ps->tags_count=0;
+
+  if(ps->photos)
+    ps->photos[0]=NULL;
+  ps->photos_count=0;
+
+  ps->matched=0;
+  flickcurl_photos_sax_text_reset(ps);
+  ps->tag_text_kind=0;
+}
+
+
+static void
+flickcurl_photos_sax_reset(void* user_data)
+{
+  flickcurl_photos_sax_clear((flickcurl_photos_sax*)user_data);
+}
+
+
+static flickcurl_sax_handler flickcurl_photos_sax_handler={
+  flickcurl_photos_sax_start,
+  flickcurl_photos_sax_end,
+  flickcurl_photos_sax_text,
+  flickcurl_photos_sax_reset
+};
+
+
+/*
+ * flickcurl_invoke_photos:
+ * @fc: flickcurl object
+ * @xpathExpr: path to photo elements
+ * @photos_list: photos list to set the photos and page fields of
+ *
+ * INTERNAL - Invoke the prepared request and build photos as the XML streams in
+ *
+ * Builds the same photos as flickcurl_build_photos() for photo list
+ * responses but from SAX events, without a DOM or any XPath
+ * evaluation.  @xpathExpr must be a plain element path such as
+ * /rsp/photos/photo.  Place objects are not built from &lt;location&gt;
+ * child elements; list responses give locations as photo attributes.
+ *
+ * If @photos_list has an arena, the photos are allocated from it and
+ * only the photos array itself is allocated with malloc().
+ *
+ * Return value: non-0 on failure
+ */
+static int
+flickcurl_invoke_photos(flickcurl* fc, const xmlChar* xpathExpr,
+                        flickcurl_photos_list* photos_list)
+{
+  flickcurl_photos_sax ps;
+  char* path_copy=NULL;
+  char* p;
+  int count;
+  int i;
+
+  memset(&ps, '\0', sizeof(ps));
+  ps.fc=fc;
+  ps.arena=photos_list->arena;
+  ps.page= -1;
+  ps.per_page= -1;
+  ps.pages= -1;
+  ps.total= -1;
+  flickcurl_photos_sax_text_reset(&ps);
+
+  for(count=0; photo_fields_table[count].xpath; count++)
+    ;
+  ps.fields=(flickcurl_photos_sax_field*)calloc(count,
+                                                sizeof(flickcurl_photos_sax_field));
+  ps.entry_seen=(char*)calloc(count, 1);
+  ps.field_map=flickcurl_get_field_map(photo_fields_table,
+                                       sizeof(photo_fields_table[0]));
+  path_copy=strdup((const char*)xpathExpr);
+  if(!ps.fields || !ps.entry_seen || !ps.field_map || !path_copy) {
+    fc->failed=1;
+    goto tidy;
+  }
+
+  for(i=0; i < count; i++) {
+    if(flickcurl_photos_sax_compile_field((const char*)photo_fields_table[i].xpath,
+                                          &ps.fields[i])) {
+      flickcurl_error(fc, "Cannot stream photo field XPath \"%s\"",
+                      photo_fields_table[i].xpath);
+      fc->failed=1;
+      goto tidy;
+    }
+  }
+
+  /* "/rsp/photos/photo" to rsp, photos, photo */
+  for(p=path_copy; *p == '/' && ps.path_count < PHOTOS_SAX_MAX_PATH; ) {
+    *p++='\0';
+    ps.path[ps.path_count++]=p;
+    while(*p && *p != '/')
+      p++;
+  }
+
+  if(flickcurl_invoke_sax(fc, &flickcurl_photos_sax_handler, &ps) ||
+     fc->failed)
+    goto tidy;
+
+  if(!ps.photos) {
+    ps.photos=(flickcurl_photo**)calloc(1, sizeof(flickcurl_photo*));
+    if(!ps.photos) {
+      fc->failed=1;
+      goto tidy;
+    }
+  }
+
+  photos_list->photos=ps.photos;
+  photos_list->photos_count=ps.photos_count;
+  photos_list->page=ps.page;
+  photos_list->per_page=ps.per_page;
+  photos_list->pages=ps.pages;
+  photos_list->total=ps.total;
+  ps.photos=NULL;
+  ps.photos_count=0;
+
+  tidy:
+  flickcurl_photos_sax_clear(&ps);
+  if(ps.photos)
+    free(ps.photos);
+  if(ps.tags)
+    free(ps.tags);
+  if(ps.text)
+    free(ps.text);
+  if(ps.fields)
+    free(ps.fields);
+  if(ps.entry_seen)
+    free(ps.entry_seen);
+  if(path_copy)
+    free(path_copy);
+
+  return !photos_list->photos;
+}
+
+
 /**
  * flickcurl_free_photos:
  * @photos: photo object array
@@ -1154,6 +2212,48 @@ flickcurl_free_photos(flickcurl_photo** photos)
 }
 
 
+/* page fields from the attributes of the parent of @xpathExpr */
+static void
+flickcurl_build_photos_list_page(flickcurl* fc, xmlXPathContextPtr xpathCtx,
+                                 const xmlChar* xpathExpr,
+                                 flickcurl_photos_list* photos_list)
+{
+  static const char* const attrs[4]={ "page", "perpage", "pages", "total" };
+  int* values[4];
+  const char* slash;
+  size_t parent_len;
+  int i;
+
+  values[0]=&photos_list->page;
+  values[1]=&photos_list->per_page;
+  values[2]=&photos_list->pages;
+  values[3]=&photos_list->total;
+
+  slash=strrchr((const char*)xpathExpr, '/');
+  if(!slash || slash == (const char*)xpathExpr)
+    return;
+  parent_len=slash - (const char*)xpathExpr;
+
+  for(i=0; i < 4; i++) {
+    xmlChar expr[512];
+    char* value;
+
+    if(parent_len + strlen(attrs[i]) + 3 > sizeof(expr))
+      return;
+    memcpy(expr, xpathExpr, parent_len);
+    expr[parent_len]='/';
+    expr[parent_len + 1]='@';
+    strcpy((char*)expr + parent_len + 2, attrs[i]);
+
+    value=flickcurl_xpath_eval(fc, xpathCtx, expr);
+    if(value) {
+      *values[i]=atoi(value);
+      free(value);
+    }
+  }
+}
+
+
 flickcurl_photos_list*
 flickcurl_invoke_photos_list(flickcurl* fc, const xmlChar* xpathExpr,
                              const char* format)
@@ -1168,6 +2268,10 @@ flickcurl_invoke_photos_list(flickcurl* fc, const xmlChar* xpathExpr,
     fc->failed=1;
     goto tidy;
   }
+  photos_list->page= -1;
+  photos_list->per_page= -1;
+  photos_list->pages= -1;
+  photos_list->total= -1;
 
   if(format) {
     nformat=format;
@@ -1180,6 +2284,26 @@ flickcurl_invoke_photos_list(flickcurl* fc, const xmlChar* xpathExpr,
       goto tidy;
     }
 
+  } else if(!strpbrk((const char*)xpathExpr, "[@*():")) {
+    nformat="xml";
+    format_len=3;
+
+    if(fc->photos_list_arena || fc->photos_list_intern) {
+      photos_list->arena=flickcurl_new_arena(0);
+      if(!photos_list->arena ||
+         (fc->photos_list_intern &&
+          flickcurl_arena_set_intern(photos_list->arena))) {
+        fc->failed=1;
+        goto tidy;
+      }
+    }
+
+    /* plain element path: build the photos as the response streams in */
+    if(flickcurl_invoke_photos(fc, xpathExpr, photos_list)) {
+      fc->failed=1;
+      goto tidy;
+    }
+
   } else {
     xmlDocPtr doc=NULL;
 
@@ -1204,6 +2328,7 @@ flickcurl_invoke_photos_list(flickcurl* fc, const xmlChar* xpathExpr,
       goto tidy;
     }
 
+    flickcurl_build_photos_list_page(fc, xpathCtx, xpathExpr, photos_list);
   }
 
 
@@ -1241,7 +2366,12 @@ flickcurl_free_photos_list(flickcurl_photos_list* photos_list)
 
   if(photos_list->format)
     free(photos_list->format);
-  if(photos_list->photos)
+  if(photos_list->arena) {
+    /* the photos are all in the arena */
+    if(photos_list->photos)
+      free(photos_list->photos);
+    flickcurl_free_arena(photos_list->arena);
+  } else if(photos_list->photos)
     flickcurl_free_photos(photos_list->photos);
   if(photos_list->content)
     free(photos_list->content);
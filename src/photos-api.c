@@ -231,7 +231,7 @@ flickcurl_photos_getContactsPhotos_params(flickcurl* fc,
   }
 
   /* Photos List parameters */
-  flickcurl_append_photos_list_params(list_params, parameters, &count, &format);
+  flickcurl_append_photos_list_params(fc, list_params, parameters, &count, &format);
 
   parameters[count][0]  = NULL;
 
@@ -364,7 +364,7 @@ flickcurl_photos_getContactsPublicPhotos_params(flickcurl* fc,
   }
 
   /* Photos List parameters */
-  flickcurl_append_photos_list_params(list_params, parameters, &count, &format);
+  flickcurl_append_photos_list_params(fc, list_params, parameters, &count, &format);
   
   parameters[count][0]  = NULL;
 
@@ -496,7 +496,7 @@ flickcurl_build_photocounts(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlNodeSetPtr nodes;
   const int row_size=3;
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -877,7 +877,7 @@ flickcurl_get_photoslist_params(flickcurl* fc,
   }
 
   /* Photos List parameters */
-  flickcurl_append_photos_list_params(list_params, parameters, &count, &format);
+  flickcurl_append_photos_list_params(fc, list_params, parameters, &count, &format);
 
   parameters[count][0]  = NULL;
 
@@ -1073,7 +1073,7 @@ flickcurl_photos_getRecent_params(flickcurl* fc,
   /* No API parameters */
 
   /* Photos List parameters */
-  flickcurl_append_photos_list_params(list_params, parameters, &count, &format);
+  flickcurl_append_photos_list_params(fc, list_params, parameters, &count, &format);
 
   parameters[count][0]  = NULL;
 
@@ -1520,7 +1520,7 @@ flickcurl_photos_recentlyUpdated_params(flickcurl* fc, int min_date,
   }
   
   /* Photos List parameters */
-  flickcurl_append_photos_list_params(list_params, parameters, &count, &format);
+  flickcurl_append_photos_list_params(fc, list_params, parameters, &count, &format);
 
   parameters[count][0]  = NULL;
 
@@ -1831,7 +1831,7 @@ flickcurl_photos_search_params(flickcurl* fc,
   }
 
   /* Photos List parameters */
-  flickcurl_append_photos_list_params(list_params, parameters, &count, &format);
+  flickcurl_append_photos_list_params(fc, list_params, parameters, &count, &format);
 
   parameters[count][0]  = NULL;
 
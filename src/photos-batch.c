@@ -0,0 +1,405 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * photos-batch.c - Flickr flickr.photos.* calls for many photos at once
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+typedef enum {
+  PHOTOS_BATCH_GET_INFO,
+  PHOTOS_BATCH_GET_SIZES,
+  PHOTOS_BATCH_GET_EXIF,
+  PHOTOS_BATCH_GET_ALL_CONTEXTS
+} flickcurl_photos_batch_call;
+
+struct flickcurl_photos_batch_s;
+
+/* handler data for one call */
+typedef struct {
+  struct flickcurl_photos_batch_s* batch;
+  int index;
+} flickcurl_photos_batch_item;
+
+typedef struct flickcurl_photos_batch_s {
+  flickcurl* fc;
+  flickcurl_multi* multi;
+  flickcurl_photos_batch_call call;
+  const char* method;
+
+  const char** photo_ids;
+  const char** secrets;
+  int count;
+  /* index of the next call to add to @multi */
+  int next;
+
+  flickcurl_photos_batch_item* items;
+  flickcurl_photos_batch_result** results;
+} flickcurl_photos_batch;
+
+
+/**
+ * flickcurl_free_photos_batch_results:
+ * @results: batch results array
+ *
+ * Destructor for the results of a batch of per-photo calls
+ */
+void
+flickcurl_free_photos_batch_results(flickcurl_photos_batch_result** results)
+{
+  int i;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(results, flickcurl_photos_batch_result_array);
+
+  for(i=0; results[i]; i++) {
+    flickcurl_photos_batch_result* result=results[i];
+
+    if(result->photo_id)
+      free(result->photo_id);
+    if(result->error_msg)
+      free(result->error_msg);
+    if(result->photo)
+      flickcurl_free_photo(result->photo);
+    if(result->sizes)
+      flickcurl_free_sizes(result->sizes);
+    if(result->exifs)
+      flickcurl_free_exifs(result->exifs);
+    if(result->contexts)
+      flickcurl_free_contexts(result->contexts);
+    free(result);
+  }
+  free(results);
+}
+
+
+/* build the result of a call from the response */
+static int
+flickcurl_photos_batch_build(flickcurl_photos_batch* batch, flickcurl* fc,
+                             xmlDocPtr doc,
+                             flickcurl_photos_batch_result* result)
+{
+  xmlXPathContextPtr xpathCtx;
+
+  if(batch->call == PHOTOS_BATCH_GET_ALL_CONTEXTS) {
+    result->contexts=flickcurl_build_contexts(fc, doc);
+    return (fc->failed || !result->contexts);
+  }
+
+  xpathCtx=xmlXPathNewContext(doc);
+  if(!xpathCtx) {
+    flickcurl_error(fc, "Failed to create XPath context for document");
+    return 1;
+  }
+
+  switch(batch->call) {
+    case PHOTOS_BATCH_GET_INFO:
+      result->photo=flickcurl_build_photo(fc, xpathCtx);
+      break;
+
+    case PHOTOS_BATCH_GET_SIZES:
+      result->sizes=flickcurl_build_sizes(fc, xpathCtx,
+                                          (const xmlChar*)"/rsp/sizes/size",
+                                          NULL);
+      break;
+
+    case PHOTOS_BATCH_GET_EXIF:
+      result->exifs=flickcurl_build_exifs(fc, xpathCtx,
+                                          (const xmlChar*)"/rsp/photo/exif",
+                                          NULL);
+      break;
+
+    case PHOTOS_BATCH_GET_ALL_CONTEXTS:
+      break;
+  }
+
+  xmlXPathFreeContext(xpathCtx);
+
+  return (fc->failed ||
+          !(result->photo || result->sizes || result->exifs));
+}
+
+
+static void flickcurl_photos_batch_handler(void *user_data, flickcurl* fc, int failed, xmlDocPtr doc, const char* content, size_t content_length);
+
+
+/* add the next call of the batch to run, returns non-0 if none left */
+static int
+flickcurl_photos_batch_add_next(flickcurl_photos_batch* batch)
+{
+  while(batch->next < batch->count) {
+    int i=batch->next++;
+    flickcurl_photos_batch_result* result=batch->results[i];
+    const char* parameters[3][2];
+    int count=0;
+
+    parameters[count][0]  = "photo_id";
+    parameters[count++][1]= batch->photo_ids[i];
+    if(batch->secrets && batch->secrets[i]) {
+      parameters[count][0]  = "secret";
+      parameters[count++][1]= batch->secrets[i];
+    }
+    parameters[count][0]  = NULL;
+
+    if(!flickcurl_multi_add_method(batch->multi, batch->fc, batch->method,
+                                   parameters, count, 0,
+                                   flickcurl_photos_batch_handler,
+                                   &batch->items[i]))
+      return 0;
+
+    /* could not even be prepared */
+    result->error_code=batch->fc->error_code;
+    if(batch->fc->error_msg)
+      result->error_msg=strdup(batch->fc->error_msg);
+  }
+
+  return 1;
+}
+
+
+static void
+flickcurl_photos_batch_handler(void *user_data, flickcurl* fc, int failed,
+                               xmlDocPtr doc, const char* content,
+                               size_t content_length)
+{
+  flickcurl_photos_batch_item* item=(flickcurl_photos_batch_item*)user_data;
+  flickcurl_photos_batch* batch=item->batch;
+  flickcurl_photos_batch_result* result=batch->results[item->index];
+
+  if(!failed) {
+    fc->failed=0;
+    if(!doc || flickcurl_photos_batch_build(batch, fc, doc, result))
+      failed=1;
+  }
+
+  result->failed=failed;
+  result->error_code=fc->error_code;
+  result->status_code=fc->status_code;
+  if(failed && fc->error_msg)
+    result->error_msg=strdup(fc->error_msg);
+
+  /* keep @concurrency calls queued */
+  flickcurl_photos_batch_add_next(batch);
+}
+
+
+static flickcurl_photos_batch_result**
+flickcurl_photos_batch_run(flickcurl* fc, flickcurl_photos_batch_call call,
+                           const char* method,
+                           const char** photo_ids, const char** secrets,
+                           int photo_ids_count, int concurrency)
+{
+  flickcurl_photos_batch batch;
+  flickcurl_photos_batch_result** results=NULL;
+  int i;
+
+  if(!photo_ids || photo_ids_count < 0)
+    return NULL;
+
+  if(concurrency < 1)
+    concurrency=1;
+
+  memset(&batch, '\0', sizeof(batch));
+  batch.fc=fc;
+  batch.call=call;
+  batch.method=method;
+  batch.photo_ids=photo_ids;
+  batch.secrets=secrets;
+  batch.count=photo_ids_count;
+
+  batch.results=(flickcurl_photos_batch_result**)calloc(photo_ids_count + 1,
+                                                        sizeof(flickcurl_photos_batch_result*));
+  batch.items=(flickcurl_photos_batch_item*)calloc(photo_ids_count + 1,
+                                                   sizeof(flickcurl_photos_batch_item));
+  if(!batch.results || !batch.items)
+    goto oom;
+
+  for(i=0; i < photo_ids_count; i++) {
+    flickcurl_photos_batch_result* result;
+
+    result=(flickcurl_photos_batch_result*)calloc(1, sizeof(*result));
+    if(!result)
+      goto oom;
+    batch.results[i]=result;
+
+    result->photo_id=strdup(photo_ids[i] ? photo_ids[i] : "");
+    if(!result->photo_id)
+      goto oom;
+    /* until the call completes */
+    result->failed=1;
+
+    batch.items[i].batch=&batch;
+    batch.items[i].index=i;
+  }
+
+  batch.multi=flickcurl_new_multi();
+  if(!batch.multi)
+    goto oom;
+  flickcurl_multi_set_max_transfers(batch.multi, concurrency);
+
+  for(i=0; i < concurrency; i++) {
+    if(flickcurl_photos_batch_add_next(&batch))
+      break;
+  }
+
+  if(flickcurl_multi_run(batch.multi))
+    flickcurl_error(fc, "Failed to run batch of %s calls", method);
+
+  flickcurl_free_multi(batch.multi);
+  batch.multi=NULL;
+
+  fc->failed=0;
+  results=batch.results;
+  batch.results=NULL;
+
+  oom:
+  if(!results)
+    flickcurl_error(fc, "Out of memory");
+  if(batch.results)
+    flickcurl_free_photos_batch_results(batch.results);
+  if(batch.items)
+    free(batch.items);
+
+  return results;
+}
+
+
+/**
+ * flickcurl_photos_getInfo_batch:
+ * @fc: flickcurl context
+ * @photo_ids: array of photo IDs
+ * @photo_ids_count: number of IDs in @photo_ids
+ * @concurrency: maximum number of calls to run at once
+ *
+ * Get information about many photos or videos with concurrent calls
+ *
+ * Makes flickr.photos.getInfo calls for all the photos in @photo_ids,
+ * running up to @concurrency at once, and waits for them all to
+ * complete.  Calls are still started no faster than the request delay
+ * or rate limiter of @fc allow and failed calls are retried by any
+ * retry policy set with flickcurl_set_retry_params().
+ *
+ * The result of each call is returned in the same order as
+ * @photo_ids, with @photo set or the error of that call.
+ *
+ * Return value: NULL terminated array of results or NULL on failure
+ */
+flickcurl_photos_batch_result**
+flickcurl_photos_getInfo_batch(flickcurl* fc, const char** photo_ids,
+                               int photo_ids_count, int concurrency)
+{
+  return flickcurl_photos_batch_run(fc, PHOTOS_BATCH_GET_INFO,
+                                    "flickr.photos.getInfo",
+                                    photo_ids, NULL, photo_ids_count,
+                                    concurrency);
+}
+
+
+/**
+ * flickcurl_photos_getSizes_batch:
+ * @fc: flickcurl context
+ * @photo_ids: array of photo IDs
+ * @photo_ids_count: number of IDs in @photo_ids
+ * @concurrency: maximum number of calls to run at once
+ *
+ * Get the available sizes of many photos with concurrent calls
+ *
+ * Makes flickr.photos.getSizes calls setting @sizes in each result.
+ * See flickcurl_photos_getInfo_batch() for how the calls are run.
+ *
+ * Return value: NULL terminated array of results or NULL on failure
+ */
+flickcurl_photos_batch_result**
+flickcurl_photos_getSizes_batch(flickcurl* fc, const char** photo_ids,
+                                int photo_ids_count, int concurrency)
+{
+  return flickcurl_photos_batch_run(fc, PHOTOS_BATCH_GET_SIZES,
+                                    "flickr.photos.getSizes",
+                                    photo_ids, NULL, photo_ids_count,
+                                    concurrency);
+}
+
+
+/**
+ * flickcurl_photos_getExif_batch:
+ * @fc: flickcurl context
+ * @photo_ids: array of photo IDs
+ * @secrets: array of photo secrets the same size as @photo_ids or NULL; entries may be NULL
+ * @photo_ids_count: number of IDs in @photo_ids
+ * @concurrency: maximum number of calls to run at once
+ *
+ * Get the EXIF/TIFF/GPS tags of many photos with concurrent calls
+ *
+ * Makes flickr.photos.getExif calls setting @exifs in each result.
+ * See flickcurl_photos_getInfo_batch() for how the calls are run.
+ *
+ * Return value: NULL terminated array of results or NULL on failure
+ */
+flickcurl_photos_batch_result**
+flickcurl_photos_getExif_batch(flickcurl* fc, const char** photo_ids,
+                               const char** secrets,
+                               int photo_ids_count, int concurrency)
+{
+  return flickcurl_photos_batch_run(fc, PHOTOS_BATCH_GET_EXIF,
+                                    "flickr.photos.getExif",
+                                    photo_ids, secrets, photo_ids_count,
+                                    concurrency);
+}
+
+
+/**
+ * flickcurl_photos_getAllContexts_batch:
+ * @fc: flickcurl context
+ * @photo_ids: array of photo IDs
+ * @photo_ids_count: number of IDs in @photo_ids
+ * @concurrency: maximum number of calls to run at once
+ *
+ * Get the sets and pools of many photos with concurrent calls
+ *
+ * Makes flickr.photos.getAllContexts calls setting @contexts in each
+ * result.  See flickcurl_photos_getInfo_batch() for how the calls
+ * are run.
+ *
+ * Return value: NULL terminated array of results or NULL on failure
+ */
+flickcurl_photos_batch_result**
+flickcurl_photos_getAllContexts_batch(flickcurl* fc, const char** photo_ids,
+                                      int photo_ids_count, int concurrency)
+{
+  return flickcurl_photos_batch_run(fc, PHOTOS_BATCH_GET_ALL_CONTEXTS,
+                                    "flickr.photos.getAllContexts",
+                                    photo_ids, NULL, photo_ids_count,
+                                    concurrency);
+}
@@ -87,7 +87,7 @@ flickcurl_read_licenses(flickcurl *fc)
   }
 
   xpathExpr=(const xmlChar*)"/rsp/licenses/license";
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
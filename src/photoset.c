@@ -95,7 +95,7 @@ flickcurl_build_photosets(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlXPathObjectPtr xpathObj=NULL;
   xmlNodeSetPtr nodes;
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -413,8 +413,20 @@ flickcurl_build_places(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlXPathObjectPtr xpathObj=NULL;
   xmlNodeSetPtr nodes;
   int i;
+  flickcurl_field_map* field_map;
+  const xmlChar** field_values=NULL;
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  field_map=flickcurl_get_field_map(place_fields_table,
+                                    sizeof(place_fields_table[0]));
+  if(field_map)
+    field_values=(const xmlChar**)calloc(flickcurl_field_map_get_count(field_map),
+                                         sizeof(const xmlChar*));
+  if(!field_values) {
+    fc->failed=1;
+    goto tidy;
+  }
+
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -461,6 +473,8 @@ flickcurl_build_places(flickcurl* fc, xmlXPathContextPtr xpathCtx,
       }
     }
 
+    flickcurl_field_map_scan(field_map, node, field_values);
+
     for(expri=0; place_fields_table[expri].xpath; expri++) {
       flickcurl_place_type place_type=place_fields_table[expri].place_type;
       place_field_type place_field=place_fields_table[expri].place_field;
@@ -479,7 +493,8 @@ flickcurl_build_places(flickcurl* fc, xmlXPathContextPtr xpathCtx,
         continue;
       }
       
-      value = flickcurl_xpath_eval(fc, xpathNodeCtx, place_xpathExpr);
+      value = flickcurl_field_map_eval(fc, field_map, field_values, expri,
+                                       xpathNodeCtx, place_xpathExpr);
       if(!value)
         continue;
 
@@ -558,6 +573,8 @@ flickcurl_build_places(flickcurl* fc, xmlXPathContextPtr xpathCtx,
  tidy:
   if(xpathObj)
     xmlXPathFreeObject(xpathObj);
+  if(field_values)
+    free(field_values);
   
   if(fc->failed)
     places=NULL;
@@ -656,7 +673,7 @@ flickcurl_build_place_types(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   xmlNodeSetPtr nodes;
   
   /* Now do place_types */
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -0,0 +1,411 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * ratelimit.c - Flickcurl token bucket request rate limiter
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#if TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# if HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+#if defined(HAVE_SHM_OPEN) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_MUTEXATTR_SETPSHARED)
+#define FLICKCURL_RATE_LIMITER_SHARED 1
+#endif
+
+/* "FRLB" - marks an initialised shared bucket */
+#define FLICKCURL_RATE_LIMITER_MAGIC 0x46524c42
+
+/* Flickr allows 3600 requests per hour per API key */
+#define FLICKCURL_RATE_LIMITER_DEFAULT_RATE 3600
+
+
+/* Bucket state - lives in shared memory for a named limiter */
+typedef struct {
+  unsigned int magic;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t lock;
+#endif
+
+  /* tokens available now and most that can be saved up */
+  double tokens;
+  double capacity;
+
+  /* tokens added per usec */
+  double rate;
+
+  /* time @tokens was last updated in usecs */
+  double updated;
+} flickcurl_rate_limiter_state;
+
+
+struct flickcurl_rate_limiter_s {
+  flickcurl_rate_limiter_state* state;
+
+  /* non-0 if @state is a mapped shared memory segment */
+  int shared;
+};
+
+
+/* Current time in usecs; monotonic where possible so all processes
+ * on the host agree and clock changes do not refill the bucket.
+ */
+static double
+flickcurl_rate_limiter_now(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if(!clock_gettime(CLOCK_MONOTONIC, &ts))
+    return (double)ts.tv_sec * 1000000.0 + (double)(ts.tv_nsec / 1000);
+#endif
+  {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (double)tv.tv_sec * 1000000.0 + (double)tv.tv_usec;
+  }
+}
+
+
+static int
+flickcurl_rate_limiter_init_state(flickcurl_rate_limiter_state* state,
+                                  int requests_per_hour, int burst,
+                                  int shared)
+{
+#ifdef HAVE_PTHREAD_H
+  pthread_mutexattr_t attr;
+
+  pthread_mutexattr_init(&attr);
+#ifdef FLICKCURL_RATE_LIMITER_SHARED
+  if(shared) {
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+    /* do not deadlock if a process dies holding the lock */
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+  }
+#endif
+  if(pthread_mutex_init(&state->lock, &attr)) {
+    pthread_mutexattr_destroy(&attr);
+    return 1;
+  }
+  pthread_mutexattr_destroy(&attr);
+#endif
+
+  state->capacity=(double)burst;
+  state->tokens=state->capacity;
+  state->rate=(double)requests_per_hour / 3600000000.0;
+  state->updated=flickcurl_rate_limiter_now();
+
+  return 0;
+}
+
+
+#ifdef FLICKCURL_RATE_LIMITER_SHARED
+/* Open or create the shared bucket for @name.  The first process to
+ * open it sets the rate; the segment outlives the processes using it
+ * so the budget spent is remembered between runs.
+ */
+static flickcurl_rate_limiter_state*
+flickcurl_rate_limiter_open_shared(const char* name,
+                                   int requests_per_hour, int burst)
+{
+  flickcurl_rate_limiter_state* state=NULL;
+  char* shm_name;
+  size_t len=strlen(name);
+  size_t i;
+  int fd;
+  struct flock fl;
+  void* p;
+
+  /* "/flickcurl-" + name with only safe characters */
+  shm_name=(char*)malloc(len + 12);
+  if(!shm_name)
+    return NULL;
+  strcpy(shm_name, "/flickcurl-");
+  for(i=0; i < len; i++) {
+    char c=name[i];
+    if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '-' || c == '.'))
+      c='_';
+    shm_name[11 + i]=c;
+  }
+  shm_name[11 + len]='\0';
+
+  fd=shm_open(shm_name, O_RDWR | O_CREAT, 0600);
+  free(shm_name);
+  if(fd < 0)
+    return NULL;
+
+  /* serialise first time set up between processes */
+  memset(&fl, '\0', sizeof(fl));
+  fl.l_type=F_WRLCK;
+  fl.l_whence=SEEK_SET;
+  while(fcntl(fd, F_SETLKW, &fl) < 0) {
+    if(errno != EINTR)
+      goto tidy;
+  }
+
+  if(ftruncate(fd, sizeof(flickcurl_rate_limiter_state)) < 0)
+    goto unlock;
+
+  p=mmap(NULL, sizeof(flickcurl_rate_limiter_state), PROT_READ | PROT_WRITE,
+         MAP_SHARED, fd, 0);
+  if(p == MAP_FAILED)
+    goto unlock;
+  state=(flickcurl_rate_limiter_state*)p;
+
+  if(state->magic != FLICKCURL_RATE_LIMITER_MAGIC) {
+    if(flickcurl_rate_limiter_init_state(state, requests_per_hour, burst, 1)) {
+      munmap(p, sizeof(flickcurl_rate_limiter_state));
+      state=NULL;
+      goto unlock;
+    }
+    state->magic=FLICKCURL_RATE_LIMITER_MAGIC;
+  }
+
+  unlock:
+  fl.l_type=F_UNLCK;
+  fcntl(fd, F_SETLK, &fl);
+
+  tidy:
+  close(fd);
+
+  return state;
+}
+#endif
+
+
+/**
+ * flickcurl_new_rate_limiter:
+ * @name: name of limiter shared between processes or NULL
+ * @requests_per_hour: sustained request rate or 0 for the Flickr default (3600)
+ * @burst: most requests that may be made at once or 0 for a default
+ *
+ * Create a Flickcurl token bucket rate limiter
+ *
+ * The limiter holds up to @burst tokens which are refilled at
+ * @requests_per_hour.  Each web service request takes one token,
+ * waiting only when the bucket is empty, so short bursts run at full
+ * speed while the hourly quota is still respected.
+ *
+ * Sessions using the limiter with flickcurl_set_rate_limiter() share
+ * one budget and may be on different threads.  If @name is given, the
+ * bucket is kept in a shared memory segment so all processes opening
+ * a limiter with the same @name (such as the API key) draw from the
+ * same budget.  The rate and burst of the first process to create the
+ * segment are used.
+ *
+ * Return value: new object or NULL on failure (or if shared memory is
+ * not supported and @name was given)
+ */
+flickcurl_rate_limiter*
+flickcurl_new_rate_limiter(const char* name, int requests_per_hour, int burst)
+{
+  flickcurl_rate_limiter* limiter;
+
+  if(requests_per_hour <= 0)
+    requests_per_hour=FLICKCURL_RATE_LIMITER_DEFAULT_RATE;
+  if(burst <= 0)
+    burst=requests_per_hour / 60;
+  if(burst < 1)
+    burst=1;
+
+  limiter=(flickcurl_rate_limiter*)calloc(1, sizeof(flickcurl_rate_limiter));
+  if(!limiter)
+    return NULL;
+
+  if(name) {
+#ifdef FLICKCURL_RATE_LIMITER_SHARED
+    limiter->state=flickcurl_rate_limiter_open_shared(name, requests_per_hour,
+                                                      burst);
+    limiter->shared=1;
+#endif
+  } else {
+    limiter->state=(flickcurl_rate_limiter_state*)calloc(1, sizeof(flickcurl_rate_limiter_state));
+    if(limiter->state &&
+       flickcurl_rate_limiter_init_state(limiter->state, requests_per_hour,
+                                         burst, 0)) {
+      free(limiter->state);
+      limiter->state=NULL;
+    }
+  }
+
+  if(!limiter->state) {
+    free(limiter);
+    return NULL;
+  }
+
+  return limiter;
+}
+
+
+/**
+ * flickcurl_free_rate_limiter:
+ * @limiter: flickcurl rate limiter object
+ *
+ * Destructor for Flickcurl rate limiter object
+ *
+ * A shared bucket is left in place for other processes.
+ */
+void
+flickcurl_free_rate_limiter(flickcurl_rate_limiter* limiter)
+{
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(limiter, flickcurl_rate_limiter);
+
+#ifdef FLICKCURL_RATE_LIMITER_SHARED
+  if(limiter->shared)
+    munmap((void*)limiter->state, sizeof(flickcurl_rate_limiter_state));
+  else
+#endif
+  {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&limiter->state->lock);
+#endif
+    free(limiter->state);
+  }
+
+  free(limiter);
+}
+
+
+/*
+ * flickcurl_rate_limiter_update:
+ * @limiter: rate limiter
+ * @take: non-0 to take a token if one is available
+ *
+ * INTERNAL - refill the bucket and optionally take a token
+ *
+ * Return value: 0 if a token is (or was) available or usecs until one is
+ */
+static long
+flickcurl_rate_limiter_update(flickcurl_rate_limiter* limiter, int take)
+{
+  flickcurl_rate_limiter_state* state=limiter->state;
+  double now;
+  long wait=0;
+
+#ifdef HAVE_PTHREAD_H
+  int rc=pthread_mutex_lock(&state->lock);
+#if defined(HAVE_PTHREAD_MUTEXATTR_SETROBUST) && defined(EOWNERDEAD)
+  /* previous owner died; the bucket values are still usable */
+  if(rc == EOWNERDEAD) {
+    pthread_mutex_consistent(&state->lock);
+    rc=0;
+  }
+#endif
+  if(rc)
+    return 0;
+#endif
+
+  now=flickcurl_rate_limiter_now();
+  if(now > state->updated) {
+    state->tokens+=(now - state->updated) * state->rate;
+    if(state->tokens > state->capacity)
+      state->tokens=state->capacity;
+  }
+  state->updated=now;
+
+  if(state->tokens >= 1.0) {
+    if(take)
+      state->tokens-=1.0;
+  } else
+    wait=1 + (long)((1.0 - state->tokens) / state->rate);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&state->lock);
+#endif
+
+  return wait;
+}
+
+
+/**
+ * flickcurl_rate_limiter_take:
+ * @limiter: flickcurl rate limiter object
+ *
+ * Take a request token from a rate limiter without waiting
+ *
+ * Return value: 0 if a token was taken and a request may be made now,
+ * otherwise the time in usecs until a token will be available
+ */
+long
+flickcurl_rate_limiter_take(flickcurl_rate_limiter* limiter)
+{
+  return flickcurl_rate_limiter_update(limiter, 1);
+}
+
+
+/*
+ * flickcurl_rate_limiter_get_wait:
+ * @limiter: rate limiter
+ *
+ * INTERNAL - get time until a token is available without taking one
+ *
+ * Return value: 0 if a token is available now or usecs to wait
+ */
+long
+flickcurl_rate_limiter_get_wait(flickcurl_rate_limiter* limiter)
+{
+  return flickcurl_rate_limiter_update(limiter, 0);
+}
@@ -83,7 +83,7 @@ flickcurl_reflection_getMethods(flickcurl* fc)
   }
 
   xpathExpr=(const xmlChar*)"/rsp/methods/method";
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -0,0 +1,266 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * retry.c - Flickcurl automatic retry of failed requests
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#if TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# if HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+/* HTTP statuses retried by default: throttled, server and gateway errors */
+static const int flickcurl_retry_default_http_statuses[]={
+  429, 500, 502, 503, 504, 0
+};
+
+/* Flickr error codes retried by default: 105 Service currently
+ * unavailable, 201 API not currently available
+ */
+static const int flickcurl_retry_default_error_codes[]={
+  105, 201, 0
+};
+
+
+/**
+ * flickcurl_retry_params_init:
+ * @params: retry params to init
+ *
+ * Initialise an existing retry parameters structure with the defaults
+ *
+ * The defaults make up to 4 attempts, backing off from 500ms up to
+ * 30 seconds, and retry transport errors, HTTP 429, 500, 502, 503
+ * and 504 and Flickr errors 105 and 201.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_retry_params_init(flickcurl_retry_params* params)
+{
+  if(!params)
+    return 1;
+
+  memset(params, '\0', sizeof(flickcurl_retry_params));
+  params->version=1;
+
+  params->max_attempts=4;
+  params->base_delay=500;
+  params->max_delay=30000;
+  params->retry_transport_errors=1;
+  params->http_statuses=flickcurl_retry_default_http_statuses;
+  params->error_codes=flickcurl_retry_default_error_codes;
+
+  return 0;
+}
+
+
+/* copy a 0-terminated list of codes */
+static int*
+flickcurl_retry_copy_codes(const int* codes)
+{
+  int* copy;
+  int count=0;
+
+  if(codes)
+    while(codes[count])
+      count++;
+
+  copy=(int*)malloc(sizeof(int) * (count + 1));
+  if(!copy)
+    return NULL;
+  if(count)
+    memcpy(copy, codes, sizeof(int) * count);
+  copy[count]=0;
+
+  return copy;
+}
+
+
+/*
+ * flickcurl_free_retry_params:
+ * @params: retry params copy
+ *
+ * INTERNAL - free a copy of retry params made by flickcurl_set_retry_params()
+ */
+void
+flickcurl_free_retry_params(flickcurl_retry_params* params)
+{
+  if(params->http_statuses)
+    free((int*)params->http_statuses);
+  if(params->error_codes)
+    free((int*)params->error_codes);
+  free(params);
+}
+
+
+/**
+ * flickcurl_set_retry_params:
+ * @fc: flickcurl object
+ * @params: retry params or NULL to never retry
+ *
+ * Set the policy for automatically retrying failed requests
+ *
+ * Only read requests, which are safe to repeat, are retried.  A
+ * request is retried if it fails with a transport error (when
+ * @retry_transport_errors is set), an HTTP status in
+ * @http_statuses or a Flickr error code in @error_codes.  Before
+ * each retry the request waits a random time between 0 and
+ * @base_delay doubled for each attempt made, up to @max_delay
+ * (full jitter).  If the response had a Retry-After header, the wait
+ * is at least that long, and no retry is made if that is longer than
+ * @max_delay.
+ *
+ * Each failed attempt is reported to the error handler.  The
+ * parameters and code lists are copied.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_set_retry_params(flickcurl* fc, flickcurl_retry_params* params)
+{
+  flickcurl_retry_params* copy=NULL;
+
+  if(params) {
+    copy=(flickcurl_retry_params*)calloc(1, sizeof(flickcurl_retry_params));
+    if(!copy)
+      return 1;
+    memcpy(copy, params, sizeof(flickcurl_retry_params));
+    copy->http_statuses=flickcurl_retry_copy_codes(params->http_statuses);
+    copy->error_codes=flickcurl_retry_copy_codes(params->error_codes);
+    if(!copy->http_statuses || !copy->error_codes) {
+      flickcurl_free_retry_params(copy);
+      return 1;
+    }
+    if(copy->base_delay < 1)
+      copy->base_delay=1;
+    if(copy->max_delay < copy->base_delay)
+      copy->max_delay=copy->base_delay;
+  }
+
+  if(fc->retry_params)
+    flickcurl_free_retry_params(fc->retry_params);
+  fc->retry_params=copy;
+
+  if(!fc->retry_seed)
+    fc->retry_seed=(unsigned int)time(NULL) ^ (unsigned int)(size_t)fc;
+  if(!fc->retry_seed)
+    fc->retry_seed=1;
+
+  return 0;
+}
+
+
+static int
+flickcurl_retry_code_in_list(const int* codes, int code)
+{
+  for(; *codes; codes++)
+    if(*codes == code)
+      return 1;
+  return 0;
+}
+
+
+/*
+ * flickcurl_transfer_get_retry_delay:
+ * @t: failed transfer
+ *
+ * INTERNAL - Decide if a failed transfer should be retried
+ *
+ * Counts the retry in the transfer when one is to be made.
+ *
+ * Return value: msecs to wait before retrying or < 0 to give up
+ */
+long
+flickcurl_transfer_get_retry_delay(flickcurl_transfer* t)
+{
+  flickcurl* fc=t->fc;
+  flickcurl_retry_params* params=fc->retry_params;
+  int retryable=0;
+  long ceiling;
+  long delay;
+  unsigned int x;
+
+  /* only requests that are safe to repeat and were not given up on */
+  if(!params || t->aborted || t->is_write || t->post || t->data)
+    return -1;
+
+  if(t->attempts + 1 >= params->max_attempts)
+    return -1;
+
+  if(!t->status_code)
+    retryable=params->retry_transport_errors;
+  else if(flickcurl_retry_code_in_list(params->http_statuses, t->status_code))
+    retryable=1;
+  if(!retryable && t->error_code &&
+     flickcurl_retry_code_in_list(params->error_codes, t->error_code))
+    retryable=1;
+
+  if(!retryable)
+    return -1;
+
+  ceiling=params->base_delay;
+  if(t->attempts < 30)
+    ceiling <<= t->attempts;
+  if(t->attempts >= 30 || ceiling > params->max_delay || ceiling <= 0)
+    ceiling=params->max_delay;
+
+  /* full jitter: xorshift32 per session */
+  x=fc->retry_seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  fc->retry_seed=x;
+  delay=(long)(x % ((unsigned long)ceiling + 1));
+
+  if(t->retry_after >= 0) {
+    long retry_after=t->retry_after * 1000;
+    if(retry_after > params->max_delay)
+      return -1;
+    if(delay < retry_after)
+      delay=retry_after;
+  }
+
+  t->attempts++;
+
+  return delay;
+}
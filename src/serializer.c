@@ -317,6 +317,128 @@ free_nspaces(flickrdf_nspace* list)
 }
     
 
+/* Photo sizes with the longest edge in pixels; 0 is the original */
+static const struct {
+  const char* label;
+  char suffix;
+  int edge;
+} photo_sizes_table[]={
+  { "Square",    's', 75 },
+  { "Thumbnail", 't', 100 },
+  { "Small",     'm', 240 },
+  { "Medium",    '-', 500 },
+  { "Large",     'b', 1024 },
+  { "Original",  'o', 0 },
+  { NULL, 0, 0 }
+};
+
+
+static char*
+flickcurl_serializer_strdup(const char* string)
+{
+  size_t len=strlen(string);
+  char* copy=(char*)malloc(len + 1);
+  if(copy)
+    memcpy(copy, string, len + 1);
+  return copy;
+}
+
+
+/*
+ * flickcurl_serializer_build_sizes:
+ * @photo: photo
+ *
+ * INTERNAL - Work out the sizes of a photo from its fields
+ *
+ * Uses the farm, server and secret fields for the source URIs as
+ * flickcurl_photo_as_source_uri() does and the original width and
+ * height (o_dims extra) to scale the dimensions in the same way as
+ * Flickr, which never scales up and only has a Large size for
+ * originals bigger than it.  The Original size needs the original
+ * secret and format.  Videos are not handled.
+ *
+ * Return value: new sizes array or NULL if the fields are missing
+ */
+static flickcurl_size**
+flickcurl_serializer_build_sizes(flickcurl_photo* photo)
+{
+  flickcurl_size** sizes;
+  int width;
+  int height;
+  int longest;
+  int have_original;
+  int count=0;
+  int i;
+
+  if(photo->media_type && strcmp(photo->media_type, "photo"))
+    return NULL;
+
+  if(!photo->id ||
+     !flickcurl_photo_get_field_string(photo, PHOTO_FIELD_farm) ||
+     !flickcurl_photo_get_field_string(photo, PHOTO_FIELD_server) ||
+     !flickcurl_photo_get_field_string(photo, PHOTO_FIELD_secret))
+    return NULL;
+
+  width=flickcurl_photo_get_field_integer(photo, PHOTO_FIELD_original_width);
+  height=flickcurl_photo_get_field_integer(photo, PHOTO_FIELD_original_height);
+  if(width <= 0 || height <= 0)
+    return NULL;
+  longest=(width > height) ? width : height;
+
+  have_original=(flickcurl_photo_get_field_string(photo, PHOTO_FIELD_originalsecret) &&
+                 flickcurl_photo_get_field_string(photo, PHOTO_FIELD_originalformat));
+
+  sizes=(flickcurl_size**)calloc(sizeof(flickcurl_size*),
+                                 sizeof(photo_sizes_table) / sizeof(photo_sizes_table[0]));
+  if(!sizes)
+    return NULL;
+
+  for(i=0; photo_sizes_table[i].label; i++) {
+    int edge=photo_sizes_table[i].edge;
+    flickcurl_size* size;
+
+    if(!edge) {
+      if(!have_original)
+        continue;
+    } else if(edge == 1024 && longest <= edge)
+      continue;
+
+    size=(flickcurl_size*)calloc(sizeof(flickcurl_size), 1);
+    if(!size)
+      goto failed;
+    sizes[count++]=size;
+
+    size->label=flickcurl_serializer_strdup(photo_sizes_table[i].label);
+    size->media=flickcurl_serializer_strdup("photo");
+    size->source=flickcurl_photo_as_source_uri(photo,
+                                               photo_sizes_table[i].suffix);
+    if(!size->label || !size->media || !size->source)
+      goto failed;
+
+    if(photo_sizes_table[i].suffix == 's') {
+      /* cropped */
+      size->width=edge;
+      size->height=edge;
+    } else if(!edge || longest <= edge) {
+      size->width=width;
+      size->height=height;
+    } else if(width >= height) {
+      size->width=edge;
+      size->height=(int)(((double)height * edge / width) + 0.5);
+    } else {
+      size->width=(int)(((double)width * edge / height) + 0.5);
+      size->height=edge;
+    }
+  }
+
+  return sizes;
+
+  failed:
+  flickcurl_free_sizes(sizes);
+  return NULL;
+}
+
+
 /**
  * flickcurl_serialize_photo:
  * @fcs: flickcurl serializer object
@@ -324,10 +446,39 @@ free_nspaces(flickrdf_nspace* list)
  *
  * Serialize photo description to RDF triples
  *
+ * The photo sizes are worked out from the photo fields when it has
+ * the farm, server, secret and original dimensions, otherwise they
+ * are got with flickcurl_photos_getSizes().  See
+ * flickcurl_serialize_photo_with_sizes() to pass them in.
+ *
  * Return value: non-0 on failure
  */
 int
 flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
+{
+  return flickcurl_serialize_photo_with_sizes(fcs, photo, NULL);
+}
+
+
+/**
+ * flickcurl_serialize_photo_with_sizes:
+ * @fcs: flickcurl serializer object
+ * @photo: photo object
+ * @photo_sizes: sizes of @photo or NULL
+ *
+ * Serialize photo description with the given sizes to RDF triples
+ *
+ * When serializing many photos, the sizes can be got ahead such as
+ * with flickcurl_photos_getSizes_batch() to avoid a call per photo.
+ * @photo_sizes is not freed.  If it is NULL, this is the same as
+ * flickcurl_serialize_photo().
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_serialize_photo_with_sizes(flickcurl_serializer* fcs,
+                                     flickcurl_photo* photo,
+                                     flickcurl_size** photo_sizes)
 {
   int i;
   int need_person=0;
@@ -354,7 +505,13 @@ flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
   if(photo->place)
     nspaces=nspace_add_if_not_declared(nspaces, "places", PLACES_NS);
 
-  sizes=flickcurl_photos_getSizes(fc, photo->id);
+  if(photo_sizes)
+    sizes=photo_sizes;
+  else {
+    sizes=flickcurl_serializer_build_sizes(photo);
+    if(!sizes)
+      sizes=flickcurl_photos_getSizes(fc, photo->id);
+  }
   if(sizes) {
     need_foaf=1;
     need_rdfs=1;
@@ -363,7 +520,7 @@ flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
   /* mark namespaces used in fields */
   for(i=PHOTO_FIELD_FIRST; i <= PHOTO_FIELD_LAST; i++) {
     flickcurl_photo_field_type field=(flickcurl_photo_field_type)i;
-    flickcurl_field_value_type datatype=photo->fields[field].type;
+    flickcurl_field_value_type datatype=flickcurl_photo_get_field_type(photo, field);
     int f;
 
     if(datatype == VALUE_TYPE_NONE)
@@ -465,7 +622,7 @@ flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
   /* generate triples from fields */
   for(i=PHOTO_FIELD_FIRST; i <= PHOTO_FIELD_LAST; i++) {
     flickcurl_photo_field_type field=(flickcurl_photo_field_type)i;
-    flickcurl_field_value_type datatype=photo->fields[field].type;
+    flickcurl_field_value_type datatype=flickcurl_photo_get_field_type(photo, field);
     int f;
 
     if(datatype == VALUE_TYPE_NONE)
@@ -740,7 +897,8 @@ flickcurl_serialize_photo(flickcurl_serializer* fcs, flickcurl_photo* photo)
                        XSD_NS "integer");
 
     }
-    flickcurl_free_sizes(sizes);
+    if(sizes != photo_sizes)
+      flickcurl_free_sizes(sizes);
   }
 
 
@@ -0,0 +1,167 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * share.c - Flickcurl shared connection, DNS and TLS session caches
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+struct flickcurl_share_s {
+  CURLSH* share_handle;
+
+#ifdef HAVE_PTHREAD_H
+  /* one lock per curl_lock_data value */
+  pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+#endif
+};
+
+
+#ifdef HAVE_PTHREAD_H
+static void
+flickcurl_share_lock(CURL* handle, curl_lock_data data,
+                     curl_lock_access access, void* userptr)
+{
+  flickcurl_share* share=(flickcurl_share*)userptr;
+
+  if((int)data >= 0 && (int)data < CURL_LOCK_DATA_LAST)
+    pthread_mutex_lock(&share->locks[data]);
+}
+
+
+static void
+flickcurl_share_unlock(CURL* handle, curl_lock_data data, void* userptr)
+{
+  flickcurl_share* share=(flickcurl_share*)userptr;
+
+  if((int)data >= 0 && (int)data < CURL_LOCK_DATA_LAST)
+    pthread_mutex_unlock(&share->locks[data]);
+}
+#endif
+
+
+/**
+ * flickcurl_new_share:
+ *
+ * Create a Flickcurl shared resource object
+ *
+ * Sessions attached to the same share with flickcurl_set_share()
+ * share a DNS cache, TLS sessions and (with libcurl 7.57.0 or newer)
+ * open connections so that a pool of sessions does not repeat name
+ * lookups and connection setup.  When built with pthreads, sessions
+ * on different threads may use the same share.
+ *
+ * The share must be freed after all sessions using it.
+ *
+ * Return value: new object or NULL on failure
+ */
+flickcurl_share*
+flickcurl_new_share(void)
+{
+  flickcurl_share* share;
+#ifdef HAVE_PTHREAD_H
+  int i;
+#endif
+
+  share=(flickcurl_share*)calloc(1, sizeof(flickcurl_share));
+  if(!share)
+    return NULL;
+
+  share->share_handle=curl_share_init();
+  if(!share->share_handle) {
+    free(share);
+    return NULL;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  for(i=0; i < CURL_LOCK_DATA_LAST; i++)
+    pthread_mutex_init(&share->locks[i], NULL);
+
+  curl_share_setopt(share->share_handle, CURLSHOPT_LOCKFUNC,
+                    flickcurl_share_lock);
+  curl_share_setopt(share->share_handle, CURLSHOPT_UNLOCKFUNC,
+                    flickcurl_share_unlock);
+  curl_share_setopt(share->share_handle, CURLSHOPT_USERDATA, share);
+#endif
+
+  curl_share_setopt(share->share_handle, CURLSHOPT_SHARE,
+                    CURL_LOCK_DATA_DNS);
+#if LIBCURL_VERSION_NUM >= 0x071700
+  curl_share_setopt(share->share_handle, CURLSHOPT_SHARE,
+                    CURL_LOCK_DATA_SSL_SESSION);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073900
+  curl_share_setopt(share->share_handle, CURLSHOPT_SHARE,
+                    CURL_LOCK_DATA_CONNECT);
+#endif
+
+  return share;
+}
+
+
+/**
+ * flickcurl_free_share:
+ * @share: flickcurl share object
+ *
+ * Destructor for Flickcurl shared resource object
+ */
+void
+flickcurl_free_share(flickcurl_share* share)
+{
+#ifdef HAVE_PTHREAD_H
+  int i;
+#endif
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(share, flickcurl_share);
+
+  curl_share_cleanup(share->share_handle);
+
+#ifdef HAVE_PTHREAD_H
+  for(i=0; i < CURL_LOCK_DATA_LAST; i++)
+    pthread_mutex_destroy(&share->locks[i]);
+#endif
+
+  free(share);
+}
+
+
+CURLSH*
+flickcurl_share_get_curl_share(flickcurl_share* share)
+{
+  return share->share_handle;
+}
@@ -72,7 +72,7 @@ flickcurl_build_tags(flickcurl* fc, flickcurl_photo* photo,
   xmlNodeSetPtr nodes;
   
   /* Now do tags */
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -175,7 +175,8 @@ flickcurl_build_tags(flickcurl* fc, flickcurl_photo* photo,
 
 flickcurl_tag**
 flickcurl_build_tags_from_string(flickcurl* fc, flickcurl_photo* photo,
-                                 const char *string, int *tag_count_p)
+                                 const char *string, int *tag_count_p,
+                                 flickcurl_arena* arena)
 {
   flickcurl_tag** tags = NULL;
   int nodes_count;
@@ -188,24 +189,36 @@ flickcurl_build_tags_from_string(flickcurl* fc, flickcurl_photo* photo,
       nodes_count++;
   }
   
-  tags = (flickcurl_tag**)calloc(sizeof(flickcurl_tag*), nodes_count+1);
+  if(arena)
+    tags = (flickcurl_tag**)flickcurl_arena_calloc(arena, nodes_count+1,
+                                                   sizeof(flickcurl_tag*));
+  else
+    tags = (flickcurl_tag**)calloc(sizeof(flickcurl_tag*), nodes_count+1);
+  if(!tags)
+    return NULL;
   
   for(i = 0, tag_count = 0; i < nodes_count; i++) {
     flickcurl_tag* t;
     const char *p = string;
     size_t len;
     
-    t = (flickcurl_tag*)calloc(sizeof(flickcurl_tag), 1);
-    t->photo = photo;
-
     while(*p && *p != ' ')
       p++;
     
     len = p-string;
 
-    t->cooked = (char*)malloc(len+1);
-    strncpy(t->cooked, string, len);
-    t->cooked[len]='\0';
+    if(arena) {
+      t = (flickcurl_tag*)flickcurl_arena_calloc(arena, 1, sizeof(flickcurl_tag));
+      if(!t)
+        break;
+      t->cooked = flickcurl_arena_intern(arena, string, len);
+    } else {
+      t = (flickcurl_tag*)calloc(sizeof(flickcurl_tag), 1);
+      t->cooked = (char*)malloc(len+1);
+      strncpy(t->cooked, string, len);
+      t->cooked[len]='\0';
+    }
+    t->photo = photo;
     
     if(fc->tag_handler)
       fc->tag_handler(fc->tag_data, t);
@@ -277,7 +290,7 @@ flickcurl_build_tag_clusters(flickcurl* fc,
   xmlXPathObjectPtr xpathObj=NULL;
   xmlNodeSetPtr nodes;
   
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
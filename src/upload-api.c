@@ -41,40 +41,104 @@
 #include <errno.h>
 #endif
 
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
 #include <flickcurl.h>
 #include <flickcurl_internal.h>
 
 
-/**
- * flickcurl_photos_upload_params:
+/* file name sent with an upload body that is not from a file */
+static const char*
+flickcurl_upload_stream_filename(const char* photo_file)
+{
+  const char* p;
+
+  if(!photo_file || !*photo_file)
+    return "photo";
+
+  p=strrchr(photo_file, '/');
+#ifdef WIN32
+  if(!p)
+    p=strrchr(photo_file, '\\');
+#endif
+  return p ? p + 1 : photo_file;
+}
+
+
+static int
+flickcurl_upload_stream_init_fd(flickcurl* fc, flickcurl_upload_stream* stream,
+                                int fd)
+{
+  memset(stream, '\0', sizeof(*stream));
+  stream->type=FLICKCURL_UPLOAD_STREAM_FD;
+  stream->fd=fd;
+  stream->length= -1;
+
+  if(fd < 0) {
+    flickcurl_error(fc, "Photo file descriptor %d is not valid", fd);
+    return 1;
+  }
+
+#ifdef HAVE_SYS_STAT_H
+  {
+    struct stat st;
+
+    if(fstat(fd, &st)) {
+      flickcurl_error(fc, "Photo file descriptor %d cannot be read: %s",
+                      fd, strerror(errno));
+      return 1;
+    }
+
+    /* send the rest of a regular file from the current offset */
+    if(S_ISREG(st.st_mode)) {
+      off_t offset=lseek(fd, 0, SEEK_CUR);
+      if(offset >= 0 && offset <= st.st_size)
+        stream->length=(long)(st.st_size - offset);
+    }
+  }
+#endif
+
+  return 0;
+}
+
+
+/*
+ * flickcurl_prepare_photos_upload:
  * @fc: flickcurl context
  * @params: upload parameters
- * 
- * Uploads a photo with safety level and content type
+ * @stream: upload body source or NULL to send @params photo_file
+ * @async: non-0 to have the upload processed asynchronously giving a ticket
  *
- * Return value: #flickcurl_upload_status or NULL on failure
- **/
-flickcurl_upload_status*
-flickcurl_photos_upload_params(flickcurl* fc, flickcurl_upload_params* params)
+ * INTERNAL - Prepare a photo upload request
+ *
+ * @stream is used by the next transfer made from the session, which
+ * must be started before @stream goes away.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_prepare_photos_upload(flickcurl* fc, flickcurl_upload_params* params,
+                                flickcurl_upload_stream* stream, int async)
 {
   const char* parameters[12][2];
   int count=0;
-  xmlDocPtr doc=NULL;
-  xmlXPathContextPtr xpathCtx=NULL; 
-  flickcurl_upload_status* status=NULL;
   char is_public_s[2];
   char is_friend_s[2];
   char is_family_s[2];
   char safety_level_s[2];
   char content_type_s[2];
   
-  if(!params->photo_file)
-    return NULL;
-
-  if(access((const char*)params->photo_file, R_OK)) {
-    flickcurl_error(fc, "Photo file %s cannot be read: %s",
-                    params->photo_file, strerror(errno));
-    return NULL;
+  if(!stream) {
+    if(!params->photo_file)
+      return 1;
+
+    if(access((const char*)params->photo_file, R_OK)) {
+      flickcurl_error(fc, "Photo file %s cannot be read: %s",
+                      params->photo_file, strerror(errno));
+      return 1;
+    }
   }
 
   is_public_s[0]=params->is_public ? '1' : '0';
@@ -122,44 +186,238 @@ flickcurl_photos_upload_params(flickcurl* fc, flickcurl_upload_params* params)
   parameters[count++][1]= is_friend_s;
   parameters[count][0]  = "is_family";
   parameters[count++][1]= is_family_s;
+  if(async) {
+    parameters[count][0]  = "async";
+    parameters[count++][1]= "1";
+  }
 
   parameters[count][0]  = NULL;
 
 
   if(flickcurl_prepare_upload(fc,
                               fc->upload_service_uri,
-                              "photo", params->photo_file,
+                              "photo",
+                              (stream ? flickcurl_upload_stream_filename(params->photo_file) : params->photo_file),
                               parameters, count))
-    goto tidy;
+    return 1;
+  fc->upload_stream=stream;
 
-  doc=flickcurl_invoke(fc);
-  if(!doc)
-    goto tidy;
+  return 0;
+}
 
 
+/*
+ * flickcurl_build_upload_status:
+ * @fc: flickcurl context
+ * @doc: upload response
+ *
+ * INTERNAL - Get the status of an upload from the response
+ *
+ * Return value: new #flickcurl_upload_status or NULL on failure
+ */
+flickcurl_upload_status*
+flickcurl_build_upload_status(flickcurl* fc, xmlDocPtr doc)
+{
+  xmlXPathContextPtr xpathCtx=NULL; 
+  flickcurl_upload_status* status=NULL;
+
   xpathCtx = xmlXPathNewContext(doc);
   if(!xpathCtx) {
     flickcurl_error(fc, "Failed to create XPath context for document");
     fc->failed=1;
-    goto tidy;
+    return NULL;
   }
 
   status=(flickcurl_upload_status*)calloc(1, sizeof(flickcurl_upload_status));
-  status->photoid=flickcurl_xpath_eval(fc, xpathCtx, (const xmlChar*)"/rsp/photoid");
-  /* when async is true */
-  status->ticketid=flickcurl_xpath_eval(fc, xpathCtx, (const xmlChar*)"/rsp/ticketid");
+  if(!status) {
+    flickcurl_error(fc, "Out of memory");
+    fc->failed=1;
+  } else {
+    status->photoid=flickcurl_xpath_eval(fc, xpathCtx, (const xmlChar*)"/rsp/photoid");
+    /* when async is true */
+    status->ticketid=flickcurl_xpath_eval(fc, xpathCtx, (const xmlChar*)"/rsp/ticketid");
+  }
 
-  tidy:
-  if(xpathCtx)
-    xmlXPathFreeContext(xpathCtx);
+  xmlXPathFreeContext(xpathCtx);
 
-  if(fc->failed)
+  return status;
+}
+
+
+static flickcurl_upload_status*
+flickcurl_photos_upload_common(flickcurl* fc, flickcurl_upload_params* params,
+                               flickcurl_upload_stream* stream)
+{
+  xmlDocPtr doc=NULL;
+  flickcurl_upload_status* status=NULL;
+  flickcurl_upload_params dedupe_params;
+  char hash[33];
+  int hashed=0;
+  char* tags=NULL;
+
+  if(fc->dedupe_index && !flickcurl_dedupe_hash_upload(params, stream, hash)) {
+    status=flickcurl_dedupe_find_upload(fc->dedupe_index, hash);
+    if(status)
+      return status;
+    hashed=1;
+
+    tags=flickcurl_dedupe_make_tags(fc->dedupe_index, params->tags, hash);
+    if(tags) {
+      memcpy(&dedupe_params, params, sizeof(dedupe_params));
+      dedupe_params.tags=tags;
+      params=&dedupe_params;
+    }
+  }
+
+  if(flickcurl_prepare_photos_upload(fc, params, stream, 0))
+    goto tidy;
+
+  doc=flickcurl_invoke(fc);
+  fc->upload_stream=NULL;
+  if(!doc)
+    goto tidy;
+
+  status=flickcurl_build_upload_status(fc, doc);
+
+  if(fc->failed && status) {
+    flickcurl_free_upload_status(status);
     status=NULL;
+  }
+
+  if(hashed && status && status->photoid)
+    flickcurl_dedupe_index_add(fc->dedupe_index, hash, status->photoid);
+
+  tidy:
+  if(tags)
+    free(tags);
 
   return status;
 }
 
 
+/**
+ * flickcurl_photos_upload_params:
+ * @fc: flickcurl context
+ * @params: upload parameters
+ * 
+ * Uploads a photo with safety level and content type
+ *
+ * If a dedupe index is set with flickcurl_set_dedupe_index() and the
+ * content of the file was uploaded before, nothing is sent and the
+ * status returned has only the photo ID set.
+ *
+ * Return value: #flickcurl_upload_status or NULL on failure
+ **/
+flickcurl_upload_status*
+flickcurl_photos_upload_params(flickcurl* fc, flickcurl_upload_params* params)
+{
+  return flickcurl_photos_upload_common(fc, params, NULL);
+}
+
+
+/**
+ * flickcurl_photos_upload_buffer:
+ * @fc: flickcurl context
+ * @params: upload parameters
+ * @buffer: photo content
+ * @length: length of @buffer
+ * 
+ * Uploads a photo from memory with safety level and content type
+ *
+ * The photo is sent directly from @buffer, which is not copied and
+ * must stay unchanged until this returns.  @params photo_file is not
+ * read and only gives the file name sent, if it is set.  A dedupe
+ * index is used as for flickcurl_photos_upload_params().  Needs
+ * libcurl 7.18.2 or newer.
+ *
+ * Return value: #flickcurl_upload_status or NULL on failure
+ **/
+flickcurl_upload_status*
+flickcurl_photos_upload_buffer(flickcurl* fc, flickcurl_upload_params* params,
+                               const void* buffer, size_t length)
+{
+  flickcurl_upload_stream stream;
+
+  if(!buffer)
+    return NULL;
+
+  memset(&stream, '\0', sizeof(stream));
+  stream.type=FLICKCURL_UPLOAD_STREAM_BUFFER;
+  stream.buffer=(const char*)buffer;
+  stream.length=(long)length;
+
+  return flickcurl_photos_upload_common(fc, params, &stream);
+}
+
+
+/**
+ * flickcurl_photos_upload_fd:
+ * @fc: flickcurl context
+ * @params: upload parameters
+ * @fd: open file descriptor to read the photo from
+ * 
+ * Uploads a photo read from a file descriptor with safety level and content type
+ *
+ * The photo is read from the current offset of @fd to the end as it
+ * is sent.  When @fd is a regular file its size is sent ahead,
+ * otherwise such as for a pipe or socket the body is sent with chunked
+ * transfer encoding.  @fd is not closed.  @params photo_file is not
+ * read and only gives the file name sent, if it is set.  Needs
+ * libcurl 7.18.2 or newer.
+ *
+ * Return value: #flickcurl_upload_status or NULL on failure
+ **/
+flickcurl_upload_status*
+flickcurl_photos_upload_fd(flickcurl* fc, flickcurl_upload_params* params,
+                           int fd)
+{
+  flickcurl_upload_stream stream;
+
+  if(flickcurl_upload_stream_init_fd(fc, &stream, fd))
+    return NULL;
+
+  return flickcurl_photos_upload_common(fc, params, &stream);
+}
+
+
+/**
+ * flickcurl_photos_upload_callback:
+ * @fc: flickcurl context
+ * @params: upload parameters
+ * @callback: function to read the photo
+ * @user_data: user data for @callback
+ * @length: length of the photo or -1 if not known
+ * 
+ * Uploads a photo read by a callback with safety level and content type
+ *
+ * @callback is called as the photo is sent until it returns 0 at the
+ * end.  When @length is not known the body is sent with chunked
+ * transfer encoding.  @params photo_file is not read and only gives
+ * the file name sent, if it is set.  Needs libcurl 7.18.2 or newer.
+ *
+ * Return value: #flickcurl_upload_status or NULL on failure
+ **/
+flickcurl_upload_status*
+flickcurl_photos_upload_callback(flickcurl* fc,
+                                 flickcurl_upload_params* params,
+                                 flickcurl_upload_read_callback callback,
+                                 void* user_data, long length)
+{
+  flickcurl_upload_stream stream;
+
+  if(!callback)
+    return NULL;
+
+  memset(&stream, '\0', sizeof(stream));
+  stream.type=FLICKCURL_UPLOAD_STREAM_CALLBACK;
+  stream.read_callback=callback;
+  stream.read_callback_data=user_data;
+  stream.length=(length < 0) ? -1 : length;
+
+  return flickcurl_photos_upload_common(fc, params, &stream);
+}
+
+
 /**
  * flickcurl_photos_upload:
  * @fc: flickcurl context
@@ -205,23 +463,10 @@ flickcurl_photos_upload(flickcurl* fc, const char* photo_file,
 }
 
 
-/**
- * flickcurl_photos_replace:
- * @fc: flickcurl context
- * @photo_file: photo filename
- * @photo_id: photo ID to replace
- * @async: upload asynchronously boolean (non-0 true)
- * 
- * Replace a photo with a new file.
- *
- * Implements Replacing Photos (0.10)
- * Implements Asynchronous Uploading (0.10)
- * 
- * Return value: #flickcurl_upload_status or NULL on failure
- **/
-flickcurl_upload_status*
-flickcurl_photos_replace(flickcurl* fc, const char* photo_file,
-                         const char *photo_id, int async)
+static flickcurl_upload_status*
+flickcurl_photos_replace_common(flickcurl* fc, const char* photo_file,
+                                flickcurl_upload_stream* stream,
+                                const char *photo_id, int async)
 {
   const char* parameters[7][2];
   int count=0;
@@ -230,13 +475,18 @@ flickcurl_photos_replace(flickcurl* fc, const char* photo_file,
   flickcurl_upload_status* status=NULL;
   char async_s[2];
   
-  if(!photo_file || !photo_id)
+  if(!photo_id)
     return NULL;
 
-  if(access((const char*)photo_file, R_OK)) {
-    flickcurl_error(fc, "Photo file %s cannot be read: %s",
-                    photo_file, strerror(errno));
-    return NULL;
+  if(!stream) {
+    if(!photo_file)
+      return NULL;
+
+    if(access((const char*)photo_file, R_OK)) {
+      flickcurl_error(fc, "Photo file %s cannot be read: %s",
+                      photo_file, strerror(errno));
+      return NULL;
+    }
   }
 
   async_s[0]=async ? '1' : '0';
@@ -251,11 +501,14 @@ flickcurl_photos_replace(flickcurl* fc, const char* photo_file,
 
   if(flickcurl_prepare_upload(fc,
                               fc->replace_service_uri,
-                              "photo", photo_file,
+                              "photo",
+                              (stream ? flickcurl_upload_stream_filename(photo_file) : photo_file),
                               parameters, count))
     goto tidy;
+  fc->upload_stream=stream;
 
   doc=flickcurl_invoke(fc);
+  fc->upload_stream=NULL;
   if(!doc)
     goto tidy;
 
@@ -283,6 +536,124 @@ flickcurl_photos_replace(flickcurl* fc, const char* photo_file,
 }
 
 
+/**
+ * flickcurl_photos_replace:
+ * @fc: flickcurl context
+ * @photo_file: photo filename
+ * @photo_id: photo ID to replace
+ * @async: upload asynchronously boolean (non-0 true)
+ * 
+ * Replace a photo with a new file.
+ *
+ * Implements Replacing Photos (0.10)
+ * Implements Asynchronous Uploading (0.10)
+ * 
+ * Return value: #flickcurl_upload_status or NULL on failure
+ **/
+flickcurl_upload_status*
+flickcurl_photos_replace(flickcurl* fc, const char* photo_file,
+                         const char *photo_id, int async)
+{
+  return flickcurl_photos_replace_common(fc, photo_file, NULL,
+                                         photo_id, async);
+}
+
+
+/**
+ * flickcurl_photos_replace_buffer:
+ * @fc: flickcurl context
+ * @buffer: photo content
+ * @length: length of @buffer
+ * @photo_id: photo ID to replace
+ * @async: upload asynchronously boolean (non-0 true)
+ * 
+ * Replace a photo with one in memory.
+ *
+ * See flickcurl_photos_upload_buffer() for how @buffer is sent.
+ * 
+ * Return value: #flickcurl_upload_status or NULL on failure
+ **/
+flickcurl_upload_status*
+flickcurl_photos_replace_buffer(flickcurl* fc,
+                                const void* buffer, size_t length,
+                                const char *photo_id, int async)
+{
+  flickcurl_upload_stream stream;
+
+  if(!buffer)
+    return NULL;
+
+  memset(&stream, '\0', sizeof(stream));
+  stream.type=FLICKCURL_UPLOAD_STREAM_BUFFER;
+  stream.buffer=(const char*)buffer;
+  stream.length=(long)length;
+
+  return flickcurl_photos_replace_common(fc, NULL, &stream, photo_id, async);
+}
+
+
+/**
+ * flickcurl_photos_replace_fd:
+ * @fc: flickcurl context
+ * @fd: open file descriptor to read the photo from
+ * @photo_id: photo ID to replace
+ * @async: upload asynchronously boolean (non-0 true)
+ * 
+ * Replace a photo with one read from a file descriptor.
+ *
+ * See flickcurl_photos_upload_fd() for how @fd is read.
+ * 
+ * Return value: #flickcurl_upload_status or NULL on failure
+ **/
+flickcurl_upload_status*
+flickcurl_photos_replace_fd(flickcurl* fc, int fd,
+                            const char *photo_id, int async)
+{
+  flickcurl_upload_stream stream;
+
+  if(flickcurl_upload_stream_init_fd(fc, &stream, fd))
+    return NULL;
+
+  return flickcurl_photos_replace_common(fc, NULL, &stream, photo_id, async);
+}
+
+
+/**
+ * flickcurl_photos_replace_callback:
+ * @fc: flickcurl context
+ * @callback: function to read the photo
+ * @user_data: user data for @callback
+ * @length: length of the photo or -1 if not known
+ * @photo_id: photo ID to replace
+ * @async: upload asynchronously boolean (non-0 true)
+ * 
+ * Replace a photo with one read by a callback.
+ *
+ * See flickcurl_photos_upload_callback() for how @callback is used.
+ * 
+ * Return value: #flickcurl_upload_status or NULL on failure
+ **/
+flickcurl_upload_status*
+flickcurl_photos_replace_callback(flickcurl* fc,
+                                  flickcurl_upload_read_callback callback,
+                                  void* user_data, long length,
+                                  const char *photo_id, int async)
+{
+  flickcurl_upload_stream stream;
+
+  if(!callback)
+    return NULL;
+
+  memset(&stream, '\0', sizeof(stream));
+  stream.type=FLICKCURL_UPLOAD_STREAM_CALLBACK;
+  stream.read_callback=callback;
+  stream.read_callback_data=user_data;
+  stream.length=(length < 0) ? -1 : length;
+
+  return flickcurl_photos_replace_common(fc, NULL, &stream, photo_id, async);
+}
+
+
 /**
  * flickcurl_free_upload_status:
  * @status: status object
@@ -302,6 +673,7 @@ flickcurl_free_upload_status(flickcurl_upload_status* status)
     free(status->originalsecret);
   if(status->ticketid)
     free(status->ticketid);
+  free(status);
 }
 
 void
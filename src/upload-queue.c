@@ -0,0 +1,1044 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * upload-queue.c - Flickcurl queue of concurrent photo uploads
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#ifdef TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+#define FLICKCURL_UPLOAD_QUEUE_DEFAULT_MIN_CONCURRENCY 1
+#define FLICKCURL_UPLOAD_QUEUE_DEFAULT_MAX_CONCURRENCY 8
+
+/* change in throughput between windows treated as real, in percent */
+#define FLICKCURL_UPLOAD_QUEUE_RATE_CHANGE 10
+/* windows with no real change before trying one more upload at once */
+#define FLICKCURL_UPLOAD_QUEUE_PROBE_WINDOWS 4
+
+/* async upload ticket polling intervals in msec */
+#define FLICKCURL_UPLOAD_QUEUE_DEFAULT_MIN_POLL 1000
+#define FLICKCURL_UPLOAD_QUEUE_DEFAULT_MAX_POLL 30000
+/* most tickets checked in one flickr.photos.upload.checkTickets call */
+#define FLICKCURL_UPLOAD_QUEUE_MAX_POLL_TICKETS 100
+/* failed checkTickets calls in a row before giving up on those tickets */
+#define FLICKCURL_UPLOAD_QUEUE_MAX_POLL_FAILURES 5
+
+/* state of the MD5 of a job for a dedupe index */
+#define FLICKCURL_UPLOAD_JOB_HASH_NONE   0
+#define FLICKCURL_UPLOAD_JOB_HASH_QUEUED 1
+#define FLICKCURL_UPLOAD_JOB_HASH_DONE   2
+#define FLICKCURL_UPLOAD_JOB_HASH_FAILED 3
+
+
+typedef struct {
+  flickcurl_upload_queue* queue;
+  int job;
+  /* copy of the parameters; the strings are owned */
+  flickcurl_upload_params params;
+  /* size of the photo file or 0 if not known */
+  long size;
+  /* async upload waiting for its ticket to complete or NULL */
+  flickcurl_upload_status* status;
+  int ticket_id;
+  /* MD5 of the photo file when the session has a dedupe index */
+  int hash_state;
+  char hash[33];
+} flickcurl_upload_job;
+
+
+struct flickcurl_upload_queue_s {
+  flickcurl* fc;
+  flickcurl_multi* multi;
+
+  flickcurl_upload_queue_handler handler;
+  void* handler_data;
+
+  /* jobs in the order added, from @next not started */
+  flickcurl_upload_job** jobs;
+  int jobs_count;
+  int jobs_size;
+  int next;
+  int running;
+
+  /* uploads allowed in progress, adjusted between the min and max */
+  int concurrency;
+  int min_concurrency;
+  int max_concurrency;
+
+  /* throughput measurement window */
+  struct timeval window_start;
+  int window_jobs;
+  double window_bytes;
+  /* bytes/sec in the previous window or 0 if none */
+  double last_rate;
+  /* windows since the concurrency last changed */
+  int flat_windows;
+
+  /* async uploads: jobs with a ticket not yet complete, oldest first */
+  int async;
+  flickcurl_upload_job** tickets;
+  int tickets_count;
+  int tickets_size;
+  /* number of tickets in the checkTickets call in progress or 0 */
+  int polling;
+  /* checkTickets calls failed in a row */
+  int poll_failures;
+  long poll_interval;
+  long min_poll_interval;
+  long max_poll_interval;
+  struct timeval next_poll;
+
+#ifdef HAVE_PTHREAD_H
+  /* background hashing of jobs not started for a dedupe index */
+  pthread_t hash_thread;
+  int hash_running;
+  int hash_stop;
+  flickcurl_upload_job** hash_jobs;
+  int hash_jobs_count;
+  pthread_mutex_t hash_lock;
+  pthread_cond_t hash_cond;
+#endif
+};
+
+
+static char*
+flickcurl_upload_queue_strdup(const char* string)
+{
+  size_t len;
+  char* copy;
+
+  if(!string)
+    return NULL;
+
+  len=strlen(string);
+  copy=(char*)malloc(len + 1);
+  if(copy)
+    memcpy(copy, string, len + 1);
+  return copy;
+}
+
+
+static void
+flickcurl_free_upload_job(flickcurl_upload_job* job)
+{
+  if(job->params.photo_file)
+    free((char*)job->params.photo_file);
+  if(job->params.title)
+    free((char*)job->params.title);
+  if(job->params.description)
+    free((char*)job->params.description);
+  if(job->params.tags)
+    free((char*)job->params.tags);
+  if(job->status)
+    flickcurl_free_upload_status(job->status);
+  free(job);
+}
+
+
+/**
+ * flickcurl_new_upload_queue:
+ * @fc: flickcurl session
+ * @handler: upload completion handler
+ * @user_data: user data for @handler
+ *
+ * Create a queue of photo uploads to run concurrently
+ *
+ * Uploads added with flickcurl_upload_queue_add() are run by
+ * flickcurl_upload_queue_run() over a #flickcurl_multi, calling
+ * @handler with the result of each as it completes.
+ *
+ * The number of uploads in progress starts at the minimum set with
+ * flickcurl_upload_queue_set_concurrency() and is adjusted as they
+ * complete.  It goes up by one after a window of uploads that had
+ * higher throughput than the window before, or after a few windows
+ * with no change to try more, and down by one if the throughput
+ * fell.  It is halved when an upload fails with a network error or a
+ * HTTP 429 or 5xx response.  Uploads still start no
+ * faster than the request delay of @fc allows so lower it with
+ * flickcurl_set_request_delay().
+ *
+ * When @fc has a dedupe index set with flickcurl_set_dedupe_index(),
+ * the files are hashed in a background thread ahead of the uploads,
+ * files uploaded before are reported to @handler with only the photo
+ * ID in the status without being sent, and completed uploads are
+ * added to the index.
+ *
+ * Return value: new upload queue or NULL on failure
+ */
+flickcurl_upload_queue*
+flickcurl_new_upload_queue(flickcurl* fc,
+                           flickcurl_upload_queue_handler handler,
+                           void* user_data)
+{
+  flickcurl_upload_queue* queue;
+
+  if(!fc || !handler)
+    return NULL;
+
+  queue=(flickcurl_upload_queue*)calloc(1, sizeof(flickcurl_upload_queue));
+  if(!queue)
+    return NULL;
+
+  queue->multi=flickcurl_new_multi();
+  if(!queue->multi) {
+    free(queue);
+    return NULL;
+  }
+
+  queue->fc=fc;
+  queue->handler=handler;
+  queue->handler_data=user_data;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&queue->hash_lock, NULL);
+  pthread_cond_init(&queue->hash_cond, NULL);
+#endif
+
+  flickcurl_upload_queue_set_concurrency(queue,
+                                         FLICKCURL_UPLOAD_QUEUE_DEFAULT_MIN_CONCURRENCY,
+                                         FLICKCURL_UPLOAD_QUEUE_DEFAULT_MAX_CONCURRENCY);
+  flickcurl_upload_queue_set_poll_interval(queue,
+                                           FLICKCURL_UPLOAD_QUEUE_DEFAULT_MIN_POLL,
+                                           FLICKCURL_UPLOAD_QUEUE_DEFAULT_MAX_POLL);
+
+  return queue;
+}
+
+
+/**
+ * flickcurl_free_upload_queue:
+ * @queue: upload queue
+ *
+ * Destructor for an upload queue
+ *
+ * Uploads not yet run are dropped without calling the handler.
+ */
+void
+flickcurl_free_upload_queue(flickcurl_upload_queue* queue)
+{
+  int i;
+
+  FLICKCURL_ASSERT_OBJECT_POINTER_RETURN(queue, flickcurl_upload_queue);
+
+#ifdef HAVE_PTHREAD_H
+  if(queue->hash_running) {
+    pthread_mutex_lock(&queue->hash_lock);
+    queue->hash_stop=1;
+    pthread_mutex_unlock(&queue->hash_lock);
+    pthread_join(queue->hash_thread, NULL);
+  }
+  if(queue->hash_jobs)
+    free(queue->hash_jobs);
+  pthread_mutex_destroy(&queue->hash_lock);
+  pthread_cond_destroy(&queue->hash_cond);
+#endif
+
+  flickcurl_free_multi(queue->multi);
+
+  for(i=0; i < queue->jobs_count; i++) {
+    if(queue->jobs[i])
+      flickcurl_free_upload_job(queue->jobs[i]);
+  }
+  if(queue->jobs)
+    free(queue->jobs);
+  if(queue->tickets)
+    free(queue->tickets);
+
+  free(queue);
+}
+
+
+/**
+ * flickcurl_upload_queue_set_concurrency:
+ * @queue: upload queue
+ * @min_concurrency: minimum number of uploads in progress (>0)
+ * @max_concurrency: maximum number of uploads in progress
+ *
+ * Set the range the number of uploads in progress is adjusted in
+ *
+ * The default is 1 to 8.  Setting both the same turns off adjusting.
+ */
+void
+flickcurl_upload_queue_set_concurrency(flickcurl_upload_queue* queue,
+                                       int min_concurrency,
+                                       int max_concurrency)
+{
+  if(min_concurrency < 1)
+    min_concurrency=1;
+  if(max_concurrency < min_concurrency)
+    max_concurrency=min_concurrency;
+
+  queue->min_concurrency=min_concurrency;
+  queue->max_concurrency=max_concurrency;
+  if(queue->concurrency < min_concurrency)
+    queue->concurrency=min_concurrency;
+  else if(queue->concurrency > max_concurrency)
+    queue->concurrency=max_concurrency;
+
+  flickcurl_multi_set_max_transfers(queue->multi, max_concurrency);
+}
+
+
+/**
+ * flickcurl_upload_queue_set_async:
+ * @queue: upload queue
+ * @async: non-0 to upload asynchronously
+ *
+ * Set if uploads are processed asynchronously by Flickr
+ *
+ * An asynchronous upload returns as soon as the photo is received,
+ * with a ticket, so the next upload can start without waiting for
+ * Flickr to process it.  The queue checks the outstanding tickets
+ * together with flickr.photos.upload.checkTickets calls and reports
+ * each upload to the handler when its ticket completes, with the
+ * photo ID in the status.  See flickcurl_upload_queue_set_poll_interval().
+ */
+void
+flickcurl_upload_queue_set_async(flickcurl_upload_queue* queue, int async)
+{
+  queue->async=async;
+}
+
+
+/**
+ * flickcurl_upload_queue_set_poll_interval:
+ * @queue: upload queue
+ * @min_msec: shortest time between ticket checks in milliseconds
+ * @max_msec: longest time between ticket checks in milliseconds
+ *
+ * Set how often asynchronous upload tickets are checked
+ *
+ * Tickets are first checked @min_msec after an upload and the time
+ * doubles after each check where none completed, up to @max_msec.  It
+ * goes back to @min_msec when any complete.  The default is 1 to 30
+ * seconds.
+ */
+void
+flickcurl_upload_queue_set_poll_interval(flickcurl_upload_queue* queue,
+                                         long min_msec, long max_msec)
+{
+  if(min_msec < 1)
+    min_msec=1;
+  if(max_msec < min_msec)
+    max_msec=min_msec;
+
+  queue->min_poll_interval=min_msec;
+  queue->max_poll_interval=max_msec;
+  queue->poll_interval=min_msec;
+}
+
+
+/**
+ * flickcurl_upload_queue_get_concurrency:
+ * @queue: upload queue
+ *
+ * Get the number of uploads currently allowed in progress
+ *
+ * Return value: number of uploads
+ */
+int
+flickcurl_upload_queue_get_concurrency(flickcurl_upload_queue* queue)
+{
+  return queue->concurrency;
+}
+
+
+/**
+ * flickcurl_upload_queue_add:
+ * @queue: upload queue
+ * @params: upload parameters
+ *
+ * Add a photo upload to a queue
+ *
+ * @params is copied.  Uploads may be added before or while the queue
+ * is run, such as from the handler.
+ *
+ * Return value: job number (>=0) passed to the handler or <0 on failure
+ */
+int
+flickcurl_upload_queue_add(flickcurl_upload_queue* queue,
+                           flickcurl_upload_params* params)
+{
+  flickcurl_upload_job* job;
+
+  if(!params || !params->photo_file)
+    return -1;
+
+  if(queue->jobs_count == queue->jobs_size) {
+    int size=queue->jobs_size ? queue->jobs_size * 2 : 16;
+    flickcurl_upload_job** jobs;
+
+    jobs=(flickcurl_upload_job**)realloc(queue->jobs,
+                                         size * sizeof(flickcurl_upload_job*));
+    if(!jobs)
+      return -1;
+    queue->jobs=jobs;
+    queue->jobs_size=size;
+  }
+
+  job=(flickcurl_upload_job*)calloc(1, sizeof(flickcurl_upload_job));
+  if(!job)
+    return -1;
+
+  memcpy(&job->params, params, sizeof(flickcurl_upload_params));
+  job->params.photo_file=flickcurl_upload_queue_strdup(params->photo_file);
+  job->params.title=flickcurl_upload_queue_strdup(params->title);
+  job->params.description=flickcurl_upload_queue_strdup(params->description);
+  job->params.tags=flickcurl_upload_queue_strdup(params->tags);
+  if(!job->params.photo_file ||
+     (params->title && !job->params.title) ||
+     (params->description && !job->params.description) ||
+     (params->tags && !job->params.tags)) {
+    flickcurl_free_upload_job(job);
+    return -1;
+  }
+
+#ifdef HAVE_SYS_STAT_H
+  {
+    struct stat st;
+    if(!stat(job->params.photo_file, &st))
+      job->size=(long)st.st_size;
+  }
+#endif
+
+  job->queue=queue;
+  job->job=queue->jobs_count;
+  queue->jobs[queue->jobs_count++]=job;
+
+  return job->job;
+}
+
+
+#ifdef HAVE_PTHREAD_H
+static void*
+flickcurl_upload_queue_hash_run(void* arg)
+{
+  flickcurl_upload_queue* queue=(flickcurl_upload_queue*)arg;
+  int i;
+
+  for(i=0; i < queue->hash_jobs_count; i++) {
+    flickcurl_upload_job* job=queue->hash_jobs[i];
+    char hash[33];
+    int stop;
+    int rc=1;
+
+    pthread_mutex_lock(&queue->hash_lock);
+    stop=queue->hash_stop;
+    pthread_mutex_unlock(&queue->hash_lock);
+
+    if(!stop)
+      rc=flickcurl_dedupe_hash_file(job->params.photo_file, hash);
+
+    pthread_mutex_lock(&queue->hash_lock);
+    if(!rc)
+      memcpy(job->hash, hash, sizeof(hash));
+    job->hash_state=rc ? FLICKCURL_UPLOAD_JOB_HASH_FAILED : FLICKCURL_UPLOAD_JOB_HASH_DONE;
+    pthread_cond_broadcast(&queue->hash_cond);
+    pthread_mutex_unlock(&queue->hash_lock);
+  }
+
+  return NULL;
+}
+#endif
+
+
+/* start hashing the jobs not yet started in the background */
+static void
+flickcurl_upload_queue_hash_start(flickcurl_upload_queue* queue)
+{
+#ifdef HAVE_PTHREAD_H
+  int count=0;
+  int i;
+
+  if(queue->hash_running) {
+    flickcurl_upload_job* last=queue->hash_jobs[queue->hash_jobs_count-1];
+    int done;
+
+    pthread_mutex_lock(&queue->hash_lock);
+    done=(last->hash_state != FLICKCURL_UPLOAD_JOB_HASH_QUEUED);
+    pthread_mutex_unlock(&queue->hash_lock);
+    if(!done)
+      return;
+
+    pthread_join(queue->hash_thread, NULL);
+    queue->hash_running=0;
+  }
+
+  for(i=queue->next; i < queue->jobs_count; i++) {
+    if(queue->jobs[i]->hash_state == FLICKCURL_UPLOAD_JOB_HASH_NONE)
+      count++;
+  }
+  if(!count)
+    return;
+
+  if(queue->hash_jobs)
+    free(queue->hash_jobs);
+  queue->hash_jobs=(flickcurl_upload_job**)malloc(count * sizeof(flickcurl_upload_job*));
+  queue->hash_jobs_count=0;
+  if(!queue->hash_jobs)
+    return;
+
+  for(i=queue->next; i < queue->jobs_count; i++) {
+    flickcurl_upload_job* job=queue->jobs[i];
+    if(job->hash_state == FLICKCURL_UPLOAD_JOB_HASH_NONE) {
+      job->hash_state=FLICKCURL_UPLOAD_JOB_HASH_QUEUED;
+      queue->hash_jobs[queue->hash_jobs_count++]=job;
+    }
+  }
+
+  if(!pthread_create(&queue->hash_thread, NULL,
+                     flickcurl_upload_queue_hash_run, queue)) {
+    queue->hash_running=1;
+    return;
+  }
+
+  /* hash as each job is started instead */
+  for(i=0; i < queue->hash_jobs_count; i++)
+    queue->hash_jobs[i]->hash_state=FLICKCURL_UPLOAD_JOB_HASH_NONE;
+#endif
+}
+
+
+/* get the MD5 of a job, waiting for it if hashing in the background.
+ * Returns non-0 on failure
+ */
+static int
+flickcurl_upload_queue_hash_job(flickcurl_upload_queue* queue,
+                                flickcurl_upload_job* job)
+{
+  int state;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&queue->hash_lock);
+  while(job->hash_state == FLICKCURL_UPLOAD_JOB_HASH_QUEUED)
+    pthread_cond_wait(&queue->hash_cond, &queue->hash_lock);
+  state=job->hash_state;
+  pthread_mutex_unlock(&queue->hash_lock);
+#else
+  state=job->hash_state;
+#endif
+
+  if(state == FLICKCURL_UPLOAD_JOB_HASH_NONE) {
+    state=flickcurl_dedupe_hash_file(job->params.photo_file, job->hash) ?
+      FLICKCURL_UPLOAD_JOB_HASH_FAILED : FLICKCURL_UPLOAD_JOB_HASH_DONE;
+    job->hash_state=state;
+  }
+
+  return (state != FLICKCURL_UPLOAD_JOB_HASH_DONE);
+}
+
+
+/* add a completed upload to the dedupe index */
+static void
+flickcurl_upload_queue_record(flickcurl_upload_queue* queue,
+                              flickcurl_upload_job* job,
+                              flickcurl_upload_status* status)
+{
+  flickcurl_dedupe_index* index=queue->fc->dedupe_index;
+
+  if(index && status && status->photoid &&
+     job->hash_state == FLICKCURL_UPLOAD_JOB_HASH_DONE)
+    flickcurl_dedupe_index_add(index, job->hash, status->photoid);
+}
+
+
+/* report a finished job to the handler and free it */
+static void
+flickcurl_upload_queue_finish_job(flickcurl_upload_queue* queue,
+                                  flickcurl_upload_job* job,
+                                  flickcurl_upload_status* status)
+{
+  queue->handler(queue->handler_data, job->job, &job->params, status);
+
+  if(status)
+    flickcurl_free_upload_status(status);
+
+  queue->jobs[job->job]=NULL;
+  flickcurl_free_upload_job(job);
+}
+
+
+/* adjust the concurrency after a job completed */
+static void
+flickcurl_upload_queue_adjust(flickcurl_upload_queue* queue,
+                              flickcurl_upload_job* job, int congested)
+{
+  struct timeval now;
+  double elapsed;
+  double rate;
+
+  gettimeofday(&now, NULL);
+
+  if(congested) {
+    queue->concurrency/= 2;
+    if(queue->concurrency < queue->min_concurrency)
+      queue->concurrency=queue->min_concurrency;
+    queue->last_rate=0;
+    queue->flat_windows=0;
+    goto new_window;
+  }
+
+  queue->window_jobs++;
+  queue->window_bytes+= (double)(job->size > 0 ? job->size : 1);
+  if(queue->window_jobs < queue->concurrency)
+    return;
+
+  elapsed=(double)(now.tv_sec - queue->window_start.tv_sec) +
+          (double)(now.tv_usec - queue->window_start.tv_usec) / 1000000.0;
+  if(elapsed <= 0)
+    return;
+  rate=queue->window_bytes / elapsed;
+
+  if(queue->last_rate <= 0 ||
+     rate * 100 > queue->last_rate * (100 + FLICKCURL_UPLOAD_QUEUE_RATE_CHANGE) ||
+     ++queue->flat_windows >= FLICKCURL_UPLOAD_QUEUE_PROBE_WINDOWS) {
+    /* improving or time to see if more helps */
+    if(queue->concurrency < queue->max_concurrency)
+      queue->concurrency++;
+    queue->flat_windows=0;
+  } else if(rate * 100 < queue->last_rate * (100 - FLICKCURL_UPLOAD_QUEUE_RATE_CHANGE)) {
+    /* past the point where more uploads at once help */
+    if(queue->concurrency > queue->min_concurrency)
+      queue->concurrency--;
+    queue->flat_windows=0;
+  }
+  queue->last_rate=rate;
+
+  new_window:
+  queue->window_start=now;
+  queue->window_jobs=0;
+  queue->window_bytes=0;
+}
+
+
+/* add a job to wait for its ticket, returns non-0 on failure */
+static int
+flickcurl_upload_queue_add_ticket(flickcurl_upload_queue* queue,
+                                  flickcurl_upload_job* job)
+{
+  if(queue->tickets_count == queue->tickets_size) {
+    int size=queue->tickets_size ? queue->tickets_size * 2 : 16;
+    flickcurl_upload_job** tickets;
+
+    tickets=(flickcurl_upload_job**)realloc(queue->tickets,
+                                            size * sizeof(flickcurl_upload_job*));
+    if(!tickets)
+      return 1;
+    queue->tickets=tickets;
+    queue->tickets_size=size;
+  }
+
+  if(!queue->tickets_count) {
+    /* first outstanding ticket */
+    queue->poll_interval=queue->min_poll_interval;
+    gettimeofday(&queue->next_poll, NULL);
+    queue->next_poll.tv_sec+= queue->poll_interval / 1000;
+    queue->next_poll.tv_usec+= 1000 * (queue->poll_interval % 1000);
+    if(queue->next_poll.tv_usec >= 1000000) {
+      queue->next_poll.tv_sec++;
+      queue->next_poll.tv_usec-= 1000000;
+    }
+  }
+
+  queue->tickets[queue->tickets_count++]=job;
+  return 0;
+}
+
+
+/* set the next ticket check time after a check */
+static void
+flickcurl_upload_queue_schedule_poll(flickcurl_upload_queue* queue,
+                                     int completed)
+{
+  if(completed)
+    queue->poll_interval=queue->min_poll_interval;
+  else {
+    queue->poll_interval*= 2;
+    if(queue->poll_interval > queue->max_poll_interval)
+      queue->poll_interval=queue->max_poll_interval;
+  }
+
+  gettimeofday(&queue->next_poll, NULL);
+  queue->next_poll.tv_sec+= queue->poll_interval / 1000;
+  queue->next_poll.tv_usec+= 1000 * (queue->poll_interval % 1000);
+  if(queue->next_poll.tv_usec >= 1000000) {
+    queue->next_poll.tv_sec++;
+    queue->next_poll.tv_usec-= 1000000;
+  }
+}
+
+
+/* get msecs until the next ticket check is due */
+static long
+flickcurl_upload_queue_get_poll_wait(flickcurl_upload_queue* queue)
+{
+  struct timeval now;
+  long wait;
+
+  gettimeofday(&now, NULL);
+  wait=(queue->next_poll.tv_sec - now.tv_sec) * 1000L +
+       (queue->next_poll.tv_usec - now.tv_usec) / 1000L;
+  return (wait > 0) ? wait : 0;
+}
+
+
+/* Finish the job of a checked ticket @node if the upload is done.
+ * Return non-0 if a job was finished.
+ */
+static int
+flickcurl_upload_queue_ticket_done(flickcurl_upload_queue* queue,
+                                   xmlNodePtr node)
+{
+  xmlAttr* attr;
+  const char* ticket_id=NULL;
+  const char* photo_id=NULL;
+  int complete=0;
+  int invalid=0;
+  int i;
+
+  /* photo IDs do not fit the int of a flickcurl_ticket so read the
+   * attributes as strings
+   */
+  for(attr=node->properties; attr; attr=attr->next) {
+    const char *attr_name=(const char*)attr->name;
+    const char *attr_value;
+
+    if(!attr->children)
+      continue;
+    attr_value=(const char*)attr->children->content;
+
+    if(!strcmp(attr_name, "id"))
+      ticket_id=attr_value;
+    else if(!strcmp(attr_name, "complete"))
+      complete=atoi(attr_value);
+    else if(!strcmp(attr_name, "photoid"))
+      photo_id=attr_value;
+    else if(!strcmp(attr_name, "invalid"))
+      invalid=atoi(attr_value);
+  }
+
+  /* 0 is not complete, 1 complete, 2 failed */
+  if(!ticket_id || (!invalid && !complete))
+    return 0;
+
+  for(i=0; i < queue->tickets_count; i++) {
+    flickcurl_upload_job* job=queue->tickets[i];
+    flickcurl_upload_status* status=NULL;
+
+    if(job->ticket_id != atoi(ticket_id))
+      continue;
+
+    queue->tickets_count--;
+    memmove(&queue->tickets[i], &queue->tickets[i + 1],
+            (queue->tickets_count - i) * sizeof(flickcurl_upload_job*));
+
+    if(!invalid && complete == 1 && photo_id) {
+      status=job->status;
+      status->photoid=strdup(photo_id);
+      if(!status->photoid)
+        status=NULL;
+      else {
+        job->status=NULL;
+        flickcurl_upload_queue_record(queue, job, status);
+      }
+    }
+    flickcurl_upload_queue_finish_job(queue, job, status);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+static void
+flickcurl_upload_queue_poll_handler(void *user_data, flickcurl* fc,
+                                    int failed, xmlDocPtr doc,
+                                    const char* content,
+                                    size_t content_length)
+{
+  flickcurl_upload_queue* queue=(flickcurl_upload_queue*)user_data;
+  xmlXPathObjectPtr xpathObj=NULL;
+  int polled=queue->polling;
+  int completed=0;
+  int i;
+
+  queue->polling=0;
+
+  if(failed || !doc) {
+    if(++queue->poll_failures >= FLICKCURL_UPLOAD_QUEUE_MAX_POLL_FAILURES) {
+      /* report the polled uploads as failed rather than wait forever */
+      for(i=0; i < polled; i++)
+        flickcurl_upload_queue_finish_job(queue, queue->tickets[i], NULL);
+      queue->tickets_count-= polled;
+      memmove(&queue->tickets[0], &queue->tickets[polled],
+              queue->tickets_count * sizeof(flickcurl_upload_job*));
+      queue->poll_failures=0;
+    }
+  } else {
+    xmlXPathContextPtr xpathCtx;
+    const xmlChar* xpathExpr=(const xmlChar*)"/rsp/uploader/ticket";
+
+    queue->poll_failures=0;
+    xpathCtx=xmlXPathNewContext(doc);
+    if(xpathCtx) {
+      xpathObj=flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
+      if(!xpathObj)
+        flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"",
+                        xpathExpr);
+      xmlXPathFreeContext(xpathCtx);
+    }
+  }
+
+  if(xpathObj) {
+    xmlNodeSetPtr nodes=xpathObj->nodesetval;
+    int nodes_count=xmlXPathNodeSetGetLength(nodes);
+
+    for(i=0; i < nodes_count; i++) {
+      xmlNodePtr node=nodes->nodeTab[i];
+
+      if(node->type == XML_ELEMENT_NODE &&
+         flickcurl_upload_queue_ticket_done(queue, node))
+        completed++;
+    }
+    xmlXPathFreeObject(xpathObj);
+  }
+
+  flickcurl_upload_queue_schedule_poll(queue, completed);
+}
+
+
+/* check the oldest outstanding tickets */
+static void
+flickcurl_upload_queue_poll(flickcurl_upload_queue* queue)
+{
+  flickcurl* fc=queue->fc;
+  const char* parameters[2][2];
+  char* tickets_ids;
+  size_t len=0;
+  int count=queue->tickets_count;
+  int i;
+
+  if(count > FLICKCURL_UPLOAD_QUEUE_MAX_POLL_TICKETS)
+    count=FLICKCURL_UPLOAD_QUEUE_MAX_POLL_TICKETS;
+
+  /* ticket IDs are ints */
+  tickets_ids=(char*)malloc(count * 12 + 1);
+  if(!tickets_ids) {
+    flickcurl_upload_queue_schedule_poll(queue, 0);
+    return;
+  }
+  for(i=0; i < count; i++)
+    len+= sprintf(tickets_ids + len, (i ? ",%d" : "%d"),
+                  queue->tickets[i]->ticket_id);
+
+  parameters[0][0]  = "tickets";
+  parameters[0][1]  = tickets_ids;
+  parameters[1][0]  = NULL;
+
+  if(flickcurl_multi_add_method(queue->multi, fc,
+                                "flickr.photos.upload.checkTickets",
+                                parameters, 1, 0,
+                                flickcurl_upload_queue_poll_handler, queue))
+    flickcurl_upload_queue_schedule_poll(queue, 0);
+  else
+    queue->polling=count;
+
+  free(tickets_ids);
+}
+
+
+static void flickcurl_upload_queue_handler_multi(void *user_data, flickcurl* fc, int failed, xmlDocPtr doc, const char* content, size_t content_length);
+
+
+/* start jobs until the concurrency is reached */
+static void
+flickcurl_upload_queue_fill(flickcurl_upload_queue* queue)
+{
+  flickcurl* fc=queue->fc;
+  flickcurl_dedupe_index* index=fc->dedupe_index;
+
+  if(index)
+    flickcurl_upload_queue_hash_start(queue);
+
+  while(queue->running < queue->concurrency &&
+        queue->next < queue->jobs_count) {
+    flickcurl_upload_job* job=queue->jobs[queue->next++];
+
+    if(index && !flickcurl_upload_queue_hash_job(queue, job)) {
+      flickcurl_upload_status* status;
+      char* tags;
+
+      /* uploaded before */
+      status=flickcurl_dedupe_find_upload(index, job->hash);
+      if(status) {
+        flickcurl_upload_queue_finish_job(queue, job, status);
+        continue;
+      }
+
+      tags=flickcurl_dedupe_make_tags(index, job->params.tags, job->hash);
+      if(tags) {
+        if(job->params.tags)
+          free((char*)job->params.tags);
+        job->params.tags=tags;
+      }
+    }
+
+    if(!flickcurl_prepare_photos_upload(fc, &job->params, NULL,
+                                        queue->async) &&
+       !flickcurl_multi_add_prepared(queue->multi, fc, 0,
+                                     flickcurl_upload_queue_handler_multi,
+                                     job)) {
+      queue->running++;
+      continue;
+    }
+
+    /* could not even be started */
+    flickcurl_upload_queue_finish_job(queue, job, NULL);
+  }
+}
+
+
+static void
+flickcurl_upload_queue_handler_multi(void *user_data, flickcurl* fc,
+                                     int failed, xmlDocPtr doc,
+                                     const char* content,
+                                     size_t content_length)
+{
+  flickcurl_upload_job* job=(flickcurl_upload_job*)user_data;
+  flickcurl_upload_queue* queue=job->queue;
+  flickcurl_upload_status* status=NULL;
+  int congested;
+  int waiting=0;
+
+  queue->running--;
+
+  if(!failed && doc) {
+    status=flickcurl_build_upload_status(fc, doc);
+    if(!status)
+      failed=1;
+  }
+
+  /* Flickr API errors are about the photo, not the load */
+  congested=(failed && (!fc->status_code || fc->status_code == 429 ||
+                        fc->status_code >= 500));
+  flickcurl_upload_queue_adjust(queue, job, congested);
+
+  if(status && !status->photoid && status->ticketid) {
+    /* async upload: report it when the ticket completes */
+    job->ticket_id=atoi(status->ticketid);
+    if(!flickcurl_upload_queue_add_ticket(queue, job)) {
+      job->status=status;
+      waiting=1;
+    }
+  }
+
+  if(!waiting) {
+    flickcurl_upload_queue_record(queue, job, status);
+    flickcurl_upload_queue_finish_job(queue, job, status);
+  }
+
+  flickcurl_upload_queue_fill(queue);
+}
+
+
+/**
+ * flickcurl_upload_queue_run:
+ * @queue: upload queue
+ *
+ * Run all the uploads in a queue to completion
+ *
+ * Blocks until every upload added, including any added by the
+ * handler while running, has completed, including asynchronous
+ * uploads waiting for their tickets.  Each one is reported to the
+ * handler whether it succeeded or not.
+ *
+ * Return value: non-0 on failure
+ */
+int
+flickcurl_upload_queue_run(flickcurl_upload_queue* queue)
+{
+  int running=0;
+
+  gettimeofday(&queue->window_start, NULL);
+  queue->window_jobs=0;
+  queue->window_bytes=0;
+
+  flickcurl_upload_queue_fill(queue);
+
+  while(1) {
+    long wait= -1;
+
+    if(flickcurl_multi_perform(queue->multi, &running))
+      return 1;
+
+    if(queue->tickets_count && !queue->polling) {
+      wait=flickcurl_upload_queue_get_poll_wait(queue);
+      if(!wait) {
+        flickcurl_upload_queue_poll(queue);
+        continue;
+      }
+    }
+
+    if(!running) {
+      if(!queue->tickets_count)
+        break;
+      /* only waiting to check tickets */
+      flickcurl_msleep(wait);
+      continue;
+    }
+
+    if(flickcurl_multi_wait(queue->multi, wait))
+      return 1;
+  }
+
+  return 0;
+}
@@ -69,7 +69,7 @@ flickcurl_build_video(flickcurl* fc, xmlXPathContextPtr xpathCtx,
   int count=0;
   
   /* Now do video */
-  xpathObj = xmlXPathEvalExpression(xpathExpr, xpathCtx);
+  xpathObj = flickcurl_xpath_eval_expression(xpathExpr, xpathCtx);
   if(!xpathObj) {
     flickcurl_error(fc, "Unable to evaluate XPath expression \"%s\"", 
                     xpathExpr);
@@ -0,0 +1,206 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * xpath.c - Flickcurl compiled XPath expression cache
+ *
+ * Copyright (C) 2009, David Beckett http://www.dajobe.org/
+ *
+ * This file is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_flickcurl_config.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#undef HAVE_STDLIB_H
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include <flickcurl.h>
+#include <flickcurl_internal.h>
+
+
+/*
+ * The expressions evaluated by the builders are string literals or
+ * come from the static field tables so the set is small and fixed.
+ * Each is compiled once per process and the compiled form is shared
+ * by all sessions and threads; evaluating a compiled expression does
+ * not modify it.  The number of entries is capped in case a caller
+ * passes generated expressions, which are then compiled per call.
+ */
+#define FLICKCURL_XPATH_CACHE_BUCKETS 256
+#define FLICKCURL_XPATH_CACHE_MAX_ENTRIES 1024
+
+typedef struct flickcurl_xpath_cache_entry_s {
+  struct flickcurl_xpath_cache_entry_s* next;
+  unsigned int hash;
+  xmlChar* expr;
+  xmlXPathCompExprPtr comp;
+} flickcurl_xpath_cache_entry;
+
+
+static flickcurl_xpath_cache_entry* flickcurl_xpath_cache[FLICKCURL_XPATH_CACHE_BUCKETS];
+static int flickcurl_xpath_cache_count=0;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t flickcurl_xpath_cache_lock=PTHREAD_MUTEX_INITIALIZER;
+#define FLICKCURL_XPATH_CACHE_LOCK pthread_mutex_lock(&flickcurl_xpath_cache_lock)
+#define FLICKCURL_XPATH_CACHE_UNLOCK pthread_mutex_unlock(&flickcurl_xpath_cache_lock)
+#else
+#define FLICKCURL_XPATH_CACHE_LOCK
+#define FLICKCURL_XPATH_CACHE_UNLOCK
+#endif
+
+
+/* FNV-1a */
+static unsigned int
+flickcurl_xpath_hash(const xmlChar* expr)
+{
+  unsigned int hash=2166136261U;
+
+  for(; *expr; expr++) {
+    hash ^= (unsigned int)*expr;
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+
+/* call with the cache lock held */
+static flickcurl_xpath_cache_entry*
+flickcurl_xpath_cache_find(const xmlChar* expr, unsigned int hash)
+{
+  flickcurl_xpath_cache_entry* entry;
+
+  for(entry=flickcurl_xpath_cache[hash % FLICKCURL_XPATH_CACHE_BUCKETS];
+      entry; entry=entry->next) {
+    if(entry->hash == hash && !strcmp((const char*)entry->expr,
+                                      (const char*)expr))
+      return entry;
+  }
+  return NULL;
+}
+
+
+/*
+ * flickcurl_xpath_eval_expression:
+ * @xpathExpr: XPath expression
+ * @xpathCtx: XPath context
+ *
+ * INTERNAL - Evaluate an XPath expression using the compiled expression cache
+ *
+ * A replacement for xmlXPathEvalExpression() that compiles
+ * @xpathExpr only the first time it is seen.
+ *
+ * Return value: XPath object or NULL on failure
+ */
+xmlXPathObjectPtr
+flickcurl_xpath_eval_expression(const xmlChar* xpathExpr,
+                                xmlXPathContextPtr xpathCtx)
+{
+  flickcurl_xpath_cache_entry* entry;
+  xmlXPathCompExprPtr comp;
+  unsigned int hash;
+
+  hash=flickcurl_xpath_hash(xpathExpr);
+
+  FLICKCURL_XPATH_CACHE_LOCK;
+  entry=flickcurl_xpath_cache_find(xpathExpr, hash);
+  comp=entry ? entry->comp : NULL;
+  FLICKCURL_XPATH_CACHE_UNLOCK;
+
+  if(comp)
+    return xmlXPathCompiledEval(comp, xpathCtx);
+
+  comp=xmlXPathCompile(xpathExpr);
+  if(!comp)
+    return NULL;
+
+  FLICKCURL_XPATH_CACHE_LOCK;
+  /* another thread may have added it while this one was compiling */
+  entry=flickcurl_xpath_cache_find(xpathExpr, hash);
+  if(entry) {
+    xmlXPathFreeCompExpr(comp);
+    comp=entry->comp;
+  } else if(flickcurl_xpath_cache_count < FLICKCURL_XPATH_CACHE_MAX_ENTRIES) {
+    entry=(flickcurl_xpath_cache_entry*)calloc(1, sizeof(*entry));
+    if(entry) {
+      entry->expr=xmlStrdup(xpathExpr);
+      if(!entry->expr) {
+        free(entry);
+        entry=NULL;
+      }
+    }
+    if(entry) {
+      unsigned int bucket=hash % FLICKCURL_XPATH_CACHE_BUCKETS;
+      entry->hash=hash;
+      entry->comp=comp;
+      entry->next=flickcurl_xpath_cache[bucket];
+      flickcurl_xpath_cache[bucket]=entry;
+      flickcurl_xpath_cache_count++;
+    }
+  }
+  FLICKCURL_XPATH_CACHE_UNLOCK;
+
+  if(!entry) {
+    /* not cached: evaluate once and discard */
+    xmlXPathObjectPtr xpathObj=xmlXPathCompiledEval(comp, xpathCtx);
+    xmlXPathFreeCompExpr(comp);
+    return xpathObj;
+  }
+
+  return xmlXPathCompiledEval(comp, xpathCtx);
+}
+
+
+/*
+ * flickcurl_xpath_cache_terminate:
+ *
+ * INTERNAL - Free all compiled XPath expressions
+ *
+ * Called from flickcurl_finish() when no sessions are in use.
+ */
+void
+flickcurl_xpath_cache_terminate(void)
+{
+  int i;
+
+  FLICKCURL_XPATH_CACHE_LOCK;
+  for(i=0; i < FLICKCURL_XPATH_CACHE_BUCKETS; i++) {
+    flickcurl_xpath_cache_entry* entry=flickcurl_xpath_cache[i];
+
+    while(entry) {
+      flickcurl_xpath_cache_entry* next=entry->next;
+
+      xmlXPathFreeCompExpr(entry->comp);
+      xmlFree(entry->expr);
+      free(entry);
+      entry=next;
+    }
+    flickcurl_xpath_cache[i]=NULL;
+  }
+  flickcurl_xpath_cache_count=0;
+  FLICKCURL_XPATH_CACHE_UNLOCK;
+}
@@ -86,6 +86,8 @@ static int verbose=1;
 static const char* program;
 static FILE* output_fh;
 static const char *output_filename="<stdout>";
+/* persistent response cache file from config 'cache' or --cache */
+static char* cache_path=NULL;
 
 
 static const char*
@@ -119,6 +121,11 @@ my_set_config_var_handler(void* userdata, const char* key, const char* value)
     flickcurl_set_shared_secret(fc, value);
   else if(!strcmp(key, "auth_token"))
     flickcurl_set_auth_token(fc, value);
+  else if(!strcmp(key, "cache")) {
+    if(cache_path)
+      free(cache_path);
+    cache_path=strdup(value);
+  }
 }
 
 
@@ -137,9 +144,9 @@ my_set_config_var_handler(void* userdata, const char* key, const char* value)
 
 #ifdef HAVE_GETOPT_LONG
 /* + makes GNU getopt_long() never permute the arguments */
-#define GETOPT_STRING "+a:d:ho:qvV"
+#define GETOPT_STRING "+a:c:d:ho:qvV"
 #else
-#define GETOPT_STRING "a:d:ho:qvV"
+#define GETOPT_STRING "a:c:d:ho:qvV"
 #endif
 
 #ifdef FLICKCURL_MANPAGE
@@ -153,6 +160,7 @@ static struct option long_options[] =
 {
   /* name, has_arg, flag, val */
   {"auth",    1, 0, 'a'},
+  {"cache",   1, 0, 'c'},
   {"delay",   1, 0, 'd'},
   {"help",    0, 0, 'h'},
 #ifdef FLICKCURL_MANPAGE
@@ -4468,6 +4476,7 @@ main(int argc, char *argv[])
   char config_path[1024];
   int request_delay= -1;
   char *command=NULL;
+  flickcurl_cache* cache=NULL;
 
   output_fh=stdout;
   
@@ -4584,6 +4593,14 @@ main(int argc, char *argv[])
         }
         goto tidy;
 
+      case 'c':
+        if(optarg) {
+          if(cache_path)
+            free(cache_path);
+          cache_path=strdup(optarg);
+        }
+        break;
+
       case 'd':
         if(optarg)
           request_delay=atoi(optarg);
@@ -4699,6 +4716,17 @@ main(int argc, char *argv[])
   if(request_delay >= 0)
     flickcurl_set_request_delay(fc, request_delay);
 
+  if(cache_path) {
+    cache=flickcurl_new_cache(0, 0);
+    if(!cache || flickcurl_cache_set_persistent(cache, cache_path, 0)) {
+      fprintf(stderr, "%s: Failed to open cache file %s\n", program,
+              cache_path);
+      rc=1;
+      goto tidy;
+    }
+    flickcurl_set_cache(fc, cache);
+  }
+
   command=argv[0];
   
   /* allow old format commands to work */
@@ -4777,6 +4805,7 @@ main(int argc, char *argv[])
     fputs("\n", stdout);
 
     puts(HELP_TEXT("a", "auth FROB       ", "Authenticate with a FROB and write auth config"));
+    puts(HELP_TEXT("c", "cache FILE      ", "Keep read-only results in FILE between runs"));
     puts(HELP_TEXT("d", "delay DELAY     ", "Set delay between requests in milliseconds"));
     puts(HELP_TEXT("h", "help            ", "Print this help, then exit"));
 #ifdef FLICKCURL_MANPAGE
@@ -4838,6 +4867,12 @@ main(int argc, char *argv[])
   if(fc)
     flickcurl_free(fc);
 
+  if(cache)
+    flickcurl_free_cache(cache);
+
+  if(cache_path)
+    free(cache_path);
+
   flickcurl_finish();
 
   return(rc);